@@ -0,0 +1,120 @@
+#ifndef CAFFE_DETECTOR_HPP_
+#define CAFFE_DETECTOR_HPP_
+
+#ifdef USE_OPENCV
+#include <boost/function.hpp>
+#include <opencv2/core/core.hpp>
+
+#include <string>
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/net.hpp"
+#include "caffe/util/parse_config.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Runs a Fast R-CNN test net on images and their object proposals,
+ *        and post-processes its outputs into per-class detections.
+ *
+ * Several images share one padded input blob per forward pass. Detecting a
+ * sequence of images runs a three-stage pipeline: a loader thread reads and
+ * preprocesses the next batch and a post-processing thread decodes and
+ * suppresses the boxes of the previous one while the calling thread runs
+ * the net, so the net does not wait on the CPU work around it. Within a
+ * stage, the images of a batch are spread over caffe_parallel_for.
+ *
+ * Proposals that round to the same cells of the feature map at scale
+ * COMMON.DEDUP_BOXES (1/16 for conv5) pool identical features, so only one
+ * of them is forwarded and its outputs are shared by the others.
+ *
+ * With several DEPLOY.SCALES, every image is resized to each scale as its
+ * own entry of the input blob, so the levels of a pyramid go through the
+ * convolutions together in one forward pass, and each proposal is pooled
+ * from the single level where its area is closest to 224 x 224.
+ */
+class Detector {
+ public:
+  /// An image with its object proposals, [n][4] x1, y1, x2, y2 boxes.
+  struct Input {
+    cv::Mat image;
+    vector<float> boxes;
+  };
+
+  /// The outputs for the proposals of one image.
+  struct Detections {
+    int num_rois;
+    int num_classes;
+    /// [num_rois][num_classes][4] regressed boxes, clipped to the image.
+    vector<float> boxes;
+    /// [num_rois][num_classes] scores, zeroed for boxes under 32 pixels.
+    vector<float> scores;
+    /// Per class, the rois kept by NMS among those scoring at least
+    /// DEPLOY.CONF_THRESH, by decreasing score; empty for the background.
+    vector<vector<int> > keep;
+  };
+
+  /// Fills in image i; called from several threads at once.
+  typedef boost::function<void(int, Input*)> LoadFunction;
+  /// Receives image i and its detections, in order, from a single thread.
+  typedef boost::function<void(int, const Input&, const Detections&)>
+      ResultFunction;
+
+  Detector(const string& model_file, const string& weights_file,
+      const COMMON& common_cfg, const DEPLOY& deploy_cfg);
+
+  int num_classes() const { return num_classes_; }
+
+  /// Images per forward pass; larger batches use the net better but need
+  /// more memory, as each image is padded to the largest of its batch.
+  void set_images_per_batch(int images_per_batch);
+  int images_per_batch() const { return images_per_batch_; }
+
+  /// Detects objects in a single image.
+  void Detect(const Input& input, Detections* detections);
+
+  /// Detects objects in images [0, num_images) through the pipeline.
+  void Detect(int num_images, const LoadFunction& load,
+      const ResultFunction& result);
+
+ protected:
+  struct Batch;
+  struct Pipeline;
+
+  // The stages of a batch
+  void Prepare(Batch* batch);
+  void Forward(Batch* batch);
+  void Finish(Batch* batch);
+
+  void LoadImages(const LoadFunction& load, Batch* batch, int begin, int end);
+  // Resizes levels [begin, end) of the batch, image level / num_scales at
+  // scale level % num_scales
+  void PrepareLevels(Batch* batch, int begin, int end);
+  void PrepareROIs(Batch* batch, int begin, int end);
+  void FinishImages(Batch* batch, int begin, int end);
+
+  // Scale factors of the image at each of DEPLOY.SCALES, with the longer
+  // side capped at DEPLOY.MAX_SIZE
+  void GetImageScales(const cv::Mat& image, vector<float>* scales_factor);
+  void DecodeDetections(const Input& input, const float* pred_delta,
+      const float* pred_score, Detections* detections);
+
+  COMMON common_cfg_;
+  DEPLOY deploy_cfg_;
+  shared_ptr<Net<float> > net_;
+  Blob<float>* input_img_;
+  Blob<float>* input_rois_;
+  Blob<float>* output_bboxes_;
+  Blob<float>* output_probs_;
+  int num_classes_;
+  int images_per_batch_;
+
+  DISABLE_COPY_AND_ASSIGN(Detector);
+};
+
+}  // namespace caffe
+
+#endif  // USE_OPENCV
+#endif  // CAFFE_DETECTOR_HPP_
@@ -18,15 +18,18 @@ namespace caffe {
  */
 class InternalThread {
  public:
-  InternalThread() : thread_() {}
+  InternalThread() : threads_() {}
   virtual ~InternalThread();
 
   /**
    * Caffe's thread local state will be initialized using the current
    * thread values, e.g. device id, solver index etc. The random seed
    * is initialized using caffe_rng_rand.
+   *
+   * With num_threads > 1, InternalThreadEntry runs concurrently on that
+   * many threads, each seeded with its own caffe_rng_rand draw.
    */
-  void StartInternalThread();
+  void StartInternalThread(int num_threads = 1);
 
   /** Will not return until the internal thread has exited. */
   void StopInternalThread();
@@ -38,14 +41,15 @@ class InternalThread {
       with the code you want your thread to run. */
   virtual void InternalThreadEntry() {}
 
-  /* Should be tested when running loops to exit when requested. */
+  /* Should be tested when running loops to exit when requested.
+      Only valid on the internal threads. */
   bool must_stop();
 
  private:
   void entry(int device, Caffe::Brew mode, int rand_seed, int solver_count,
       bool root_solver);
 
-  shared_ptr<boost::thread> thread_;
+  vector<shared_ptr<boost::thread> > threads_;
 };
 
 }  // namespace caffe
@@ -6,6 +6,7 @@
 #include "caffe/blob.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/blocking_queue.hpp"
 #include "caffe/util/im2col.hpp"
 
 namespace caffe {
@@ -18,7 +19,7 @@ template <typename Dtype>
 class BaseConvolutionLayer : public Layer<Dtype> {
  public:
   explicit BaseConvolutionLayer(const LayerParameter& param)
-      : Layer<Dtype>(param) {}
+      : Layer<Dtype>(param), num_slots_(0) {}
   virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
   virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
@@ -41,6 +42,25 @@ class BaseConvolutionLayer : public Layer<Dtype> {
       weights);
   void backward_cpu_bias(Dtype* bias, const Dtype* input);
 
+  // Tiled, batch-parallel CPU passes over all num_ images of 2D
+  // convolutions, used when tiled_cpu(): each image is cut into tiles of
+  // output rows, and with the TILED engine into column bands too, that are
+  // spread over caffe_parallel_for, every thread with its own column buffer
+  // and weight gradient, which are summed in order at the end. A backward
+  // slot takes a fixed share of the tiles, so the gradients do not depend
+  // on the scheduling. For the input gradient, tiles are large enough that
+  // those two apart across or down do not overlap, so the tiles of each
+  // parity add theirs in up to four rounds. With the TILED engine, a
+  // tile's columns are kept within kTileBytes where its kernel allows, so
+  // they are multiplied while still in cache and col_buffer_ is never
+  // allocated. A NULL weights_diff or input_diff skips that gradient; bias
+  // may be NULL.
+  bool tiled_cpu();
+  void forward_cpu_tiles(const Dtype* input, const Dtype* weights,
+      const Dtype* bias, Dtype* output);
+  void backward_cpu_tiles(const Dtype* input, const Dtype* output_diff,
+      const Dtype* weights, Dtype* weights_diff, Dtype* input_diff);
+
 #ifndef CPU_ONLY
   void forward_gpu_gemm(const Dtype* col_input, const Dtype* weights,
       Dtype* output, bool skip_im2col = false);
@@ -92,6 +112,8 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   bool bias_term_;
   bool is_1x1_;
   bool force_nd_im2col_;
+  // ConvolutionParameter.engine is TILED
+  bool tiled_;
 
  private:
   // wrap im2col/col2im so we don't have to remember the (long) argument lists
@@ -156,6 +178,41 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   }
 #endif
 
+  inline void conv_im2col_tile_cpu(const Dtype* data, int row_begin,
+      int row_end, int col_begin, int col_end, Dtype* col_buff) {
+    im2col_tile_cpu(data, conv_in_channels_,
+        conv_input_shape_.cpu_data()[1], conv_input_shape_.cpu_data()[2],
+        kernel_shape_.cpu_data()[0], kernel_shape_.cpu_data()[1],
+        pad_.cpu_data()[0], pad_.cpu_data()[1],
+        stride_.cpu_data()[0], stride_.cpu_data()[1],
+        dilation_.cpu_data()[0], dilation_.cpu_data()[1],
+        row_begin, row_end, col_begin, col_end, col_buff);
+  }
+  inline void conv_col2im_tile_cpu(const Dtype* col_buff, int row_begin,
+      int row_end, int col_begin, int col_end, Dtype* data) {
+    col2im_tile_cpu(col_buff, conv_in_channels_,
+        conv_input_shape_.cpu_data()[1], conv_input_shape_.cpu_data()[2],
+        kernel_shape_.cpu_data()[0], kernel_shape_.cpu_data()[1],
+        pad_.cpu_data()[0], pad_.cpu_data()[1],
+        stride_.cpu_data()[0], stride_.cpu_data()[1],
+        dilation_.cpu_data()[0], dilation_.cpu_data()[1],
+        row_begin, row_end, col_begin, col_end, data);
+  }
+
+  // Sizes the tiles and the per-thread buffers for the current shapes and
+  // number of threads, and for the gradients a backward pass computes
+  void set_up_tiles(bool weights_diff, bool input_diff);
+  // The tasks [begin, end) of a forward pass
+  void forward_tiles_cpu(const Dtype* input, const Dtype* weights,
+      const Dtype* bias, Dtype* output, int begin, int end);
+  // The slots [begin, end) of a backward pass, each running its fixed
+  // share of the tasks in order with its own buffers; with a parity in
+  // [0, 4) only the tiles whose row index is even or odd as parity / 2 and
+  // whose column index is as parity % 2 are tasks
+  void backward_tiles_cpu(const Dtype* input, const Dtype* output_diff,
+      const Dtype* weights, bool weights_diff, Dtype* input_diff, int parity,
+      int begin, int end);
+
   int num_kernels_im2col_;
   int num_kernels_col2im_;
   int conv_out_channels_;
@@ -167,6 +224,27 @@ class BaseConvolutionLayer : public Layer<Dtype> {
 
   Blob<Dtype> col_buffer_;
   Blob<Dtype> bias_multiplier_;
+
+  // About the L2 cache of a core
+  static const int kTileBytes = 1 << 20;
+  int tiles_per_image_;
+  // tiles_down_ x tiles_across_ tiles of rows_per_tile_ x cols_per_tile_
+  // output pixels, the last ones in each direction clipped
+  int tiles_down_;
+  int tiles_across_;
+  int rows_per_tile_;
+  int cols_per_tile_;
+  // Per thread, [num_slots_] column buffer, output (gradient) tile and
+  // weight gradient, and the slots not in use
+  Blob<Dtype> thread_col_buffer_;
+  Blob<Dtype> thread_output_buffer_;
+  Blob<Dtype> thread_weight_diff_;
+  // Their host memory, taken before the threads use it
+  Dtype* thread_col_data_;
+  Dtype* thread_output_data_;
+  Dtype* thread_weight_diff_data_;
+  int num_slots_;
+  BlockingQueue<int> free_slots_;
 };
 
 }  // namespace caffe
@@ -1,6 +1,7 @@
 #ifndef CAFFE_DATA_LAYERS_HPP_
 #define CAFFE_DATA_LAYERS_HPP_
 
+#include <stdint.h>
 #include <vector>
 
 #include "caffe/blob.hpp"
@@ -12,6 +13,8 @@
 
 namespace caffe {
 
+class TimeHistogram;
+
 /**
  * @brief Provides base for data layers that feed blobs to the Net.
  *
@@ -86,14 +89,29 @@ template <typename Dtype>
 class BatchROI {
  public:
   Blob<Dtype> data_, label_, rois_, bboxes_target_, bboxes_weight_;
+  // Position of the batch in the stream, and the images picked for it
+  int64_t id_;
+  vector<int> inds_;
 };
 
+/**
+ * @brief Base for the ROI data layers, which prefetch batches on a pool of
+ *        loader threads.
+ *
+ * roi_data_param.prefetch batches are in flight at a time, loaded by
+ * roi_data_param.num_workers threads, besides the batch the tops share
+ * until the next Forward. Each batch is first reserved in stream
+ * order under a lock (reserve_batch), then loaded concurrently with the
+ * others (load_batch), and finally handed to Forward in stream order, so a
+ * layer whose load_batch only depends on what reserve_batch picked produces
+ * the same batches whatever the number of threads.
+ */
 template <typename Dtype>
 class BaseROIPrefetchingDataLayer :public BaseDataLayer<Dtype>, public InternalThread
 {
  public:
   explicit BaseROIPrefetchingDataLayer(const LayerParameter& param);
-  virtual ~BaseROIPrefetchingDataLayer() {}
+  virtual ~BaseROIPrefetchingDataLayer();
   // LayerSetUp: implements common data layer setup functionality, and calls
   // DataLayerSetUp to do special data layer setup for individual layer types.
   // This method may not be overridden.
@@ -105,23 +123,41 @@ class BaseROIPrefetchingDataLayer :public BaseDataLayer<Dtype>, public InternalT
   virtual void Forward_gpu(const vector<Blob<Dtype>*>& bottom,
 	  const vector<Blob<Dtype>*>& top);
 
-  // Prefetches batches (asynchronously if to GPU memory)
-  static const int PREFETCH_COUNT = 3;
-  
   protected:
-  BatchROI<Dtype> prefetch_roi_[PREFETCH_COUNT];
+  class Ordering;
+
+  vector<shared_ptr<BatchROI<Dtype> > > prefetch_roi_;
   BlockingQueue<BatchROI<Dtype>*> prefetch_roi_free_;
   BlockingQueue<BatchROI<Dtype>*> prefetch_roi_full_;
   Blob<Dtype> transformed_data_;
-  // The thread's function
+  // The threads' function
   virtual void InternalThreadEntry();
+  // Called in stream order, one batch at a time, with batch->id_ set; picks
+  // whatever depends on the previous batches, e.g. the next images of the
+  // epoch
+  virtual void reserve_batch(BatchROI<Dtype>* batch) {}
   virtual void load_batch(BatchROI<Dtype>* batch) = 0;
+  // Pops the next loaded batch for Forward, logging the pipeline statistics
+  // every roi_data_param.stats_interval batches
+  BatchROI<Dtype>* NextBatch();
+  // Points the tops at the blobs of the next batch instead of copying them,
+  // and returns the batch of the previous Forward, which the net is done
+  // with, to the loaders
+  void ShareNextBatch(const vector<Blob<Dtype>*>& top);
+
+  // "<layer name>/load" and "/reorder" (waiting to be delivered in order)
+  // times, see PipelineStats
+  TimeHistogram* load_time_;
+  TimeHistogram* reorder_time_;
+
+ private:
+  shared_ptr<Ordering> ordering_;
+  int free_queue_handle_, full_queue_handle_;
+  int64_t num_forwarded_;
+  // The batch the tops share, until the next Forward
+  BatchROI<Dtype>* forwarded_;
 };
 
-
-
-
-
 }  // namespace caffe
 
 #endif  // CAFFE_DATA_LAYERS_HPP_
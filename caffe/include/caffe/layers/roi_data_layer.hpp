@@ -9,10 +9,13 @@
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/roi_data_extractor.hpp"
 #include "caffe/util/parse_config.hpp"
+#include "caffe/util/rng.hpp"
 
 namespace caffe
 {
 
+    class RatioCounter;
+
     template <typename Dtype>
     class ROIDataLayer : public BaseROIPrefetchingDataLayer<Dtype>
     { 
@@ -36,9 +39,13 @@ namespace caffe
             
             void ReadCFGParameter();
 
+            //shuffles the roidb; with TRAIN.ASPECT_GROUPING, the images
+            //of a batch are all landscape or all portrait
             void ShuffleROIdbIndex();
 
-            void PrepImForBlob(const cv::Mat& im, cv::Mat& dst, int target_size, float &im_scale);
+            //scale that brings the shorter side of an image to target_size,
+            //capped so that the longer side does not exceed MAX_SIZE
+            float GetImageScale(int height, int width, int target_size);
 
             //build an input blob from the images in the roidb_ at the specified scales
             void GetImageBlob(const vector<int>& images_ind,
@@ -51,27 +58,46 @@ namespace caffe
                     int fg_rois_per_image,
                     int rois_per_image,
                     int num_classes,
+                    caffe::rng_t* rng,
                     BatchROI<Dtype>* batch);
 
             void GetNextBatchIndex(vector<int>& next_batch_inds);
 
             void GetNextBatch(const vector<int>& next_batch_inds,
+                              caffe::rng_t* rng,
                               BatchROI<Dtype>* batch);
 
+            //picks the images of the batch; called in batch order
+            virtual void reserve_batch(BatchROI<Dtype>* batch);
+
+            //loads the images picked by reserve_batch, with an RNG seeded
+            //from the batch id so that batches do not depend on which
+            //worker loads them
             virtual void load_batch(BatchROI<Dtype>* batch);
 
         private:
             struct TRAIN train_cfg_;
             struct COMMON common_cfg_;
-            vector<ROI> roidb_;
+            ROIDB roidb_;
             vector<string> img_name_list_;
             vector<string> classes_list_;
             //number of roidbs
             int num_roidb_;
+            //shuffles the roidb; only used from reserve_batch
             shared_ptr<Caffe::RNG> rng_;
+            //seed of the per-batch RNGs of load_batch
+            unsigned int rng_seed_;
             // current index of roidb
             int cur_ind_;
             vector<int> perm_;
+            //whether each image of the roidb is at least as wide as high
+            vector<char> landscape_;
+            //times of the loading stages, see PipelineStats
+            TimeHistogram* decode_time_;
+            TimeHistogram* preprocess_time_;
+            TimeHistogram* sample_time_;
+            //padding pixels of the input blobs out of all their pixels
+            RatioCounter* padding_ratio_;
                 
         
     };
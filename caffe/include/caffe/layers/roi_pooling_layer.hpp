@@ -16,7 +16,7 @@ template <typename Dtype>
 class ROIPoolingLayer : public Layer<Dtype> {
  public:
   explicit ROIPoolingLayer(const LayerParameter& param)
-      : Layer<Dtype>(param) {}
+      : Layer<Dtype>(param), argmax_skipped_(false) {}
   virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
   virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
@@ -39,6 +39,21 @@ class ROIPoolingLayer : public Layer<Dtype> {
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
 
+  // Copies rows [row_begin, row_end) of the num * height rows of
+  // bottom_data to bottom_nhwc, with the channels of a pixel contiguous.
+  void TransposeRows(const Dtype* bottom_data, Dtype* bottom_nhwc,
+      int row_begin, int row_end);
+  // Max pools ROIs [roi_begin, roi_end) of the NHWC bottom; ROIs write
+  // disjoint top slices. Either output may be NULL.
+  void ForwardROIs(const Dtype* bottom_nhwc, const Dtype* bottom_rois,
+      int batch_size, Dtype* top_data, int* argmax_data,
+      int roi_begin, int roi_end);
+  // Scatters the top diff of every ROI into channels [c_begin, c_end) of
+  // bottom_diff; a channel is only ever touched by a single call.
+  void BackwardChannels(const Dtype* top_diff, const Dtype* bottom_rois,
+      int num_rois, int batch_size, Dtype* bottom_diff,
+      int c_begin, int c_end);
+
   int channels_;
   int height_;
   int width_;
@@ -46,6 +61,10 @@ class ROIPoolingLayer : public Layer<Dtype> {
   int pooled_width_;
   Dtype spatial_scale_;
   Blob<int> max_idx_;
+  // Whether Forward_cpu left max_idx_ out of date
+  bool argmax_skipped_;
+  // The bottom feature map in NHWC layout, for the CPU forward
+  Blob<Dtype> bottom_nhwc_;
 };	
 	
 }
@@ -0,0 +1,102 @@
+#ifndef CAFFE_WINOGRAD_CONV_LAYER_HPP_
+#define CAFFE_WINOGRAD_CONV_LAYER_HPP_
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/blocking_queue.hpp"
+
+#include "caffe/layers/conv_layer.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Winograd implementation of ConvolutionLayer for 3x3 filters on the
+ *        CPU. Fallback to ConvolutionLayer for the GPU and the weight
+ *        gradient.
+ *
+ * F(m x m, 3 x 3) computes an m x m output tile from an (m + 2) x (m + 2)
+ * input tile with (m + 2)^2 multiplications per pair of input and output
+ * channels instead of 9 m^2: 16 instead of 36 for m = 2 and 36 instead of
+ * 144 for m = 4. The input tiles d and the filters g are transformed to
+ * V = B^T d B and U = G g G^T, each of the (m + 2)^2 positions of the tiles
+ * is a matrix product of U over the channels of V, and the output tile is
+ * A^T M A of the products M (Lavin and Gray, Fast Algorithms for
+ * Convolutional Neural Networks). The tiles of all the images are
+ * transformed and multiplied in blocks spread over caffe_parallel_for.
+ *
+ * The input gradient is the convolution of the output gradient with the
+ * filters rotated by 180 degrees, input and output channels swapped, and
+ * padding 2 - pad, so it takes the same path. U of both directions are
+ * kept until the weights change.
+ *
+ * Only stride 1, dilation 1, pad <= 2 and group 1 are supported, and the
+ * result differs from CAFFE's by rounding, more so for m = 4.
+ */
+template <typename Dtype>
+class WinogradConvolutionLayer : public ConvolutionLayer<Dtype> {
+ public:
+  explicit WinogradConvolutionLayer(const LayerParameter& param)
+      : ConvolutionLayer<Dtype>(param), num_slots_(0) {}
+  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+
+  // One convolution of the num_ images of input into output
+  struct Problem {
+    const Dtype* input;
+    int channels;
+    int height;
+    int width;
+    int pad_h;
+    int pad_w;
+    // [(m + 2)^2][out_channels][channels]
+    const Dtype* transformed;
+    int out_channels;
+    int height_out;
+    int width_out;
+    int tiles_w;
+    int tiles_per_image;
+    int tiles_per_block;
+    int blocks_per_image;
+    // NULL for no bias
+    const Dtype* bias;
+    Dtype* output;
+  };
+
+  // Transforms the weights into forward_weights_ and backward_weights_
+  // unless they are the same as last time
+  void update_transformed_weights();
+  void transform_weights_cpu(const Dtype* weights, Dtype* forward,
+      Dtype* backward, int begin, int end);
+  void convolve_cpu(Problem* problem);
+  void convolve_blocks_cpu(const Problem* problem, int begin, int end);
+
+  // About the L2 cache of a core
+  static const int kBlockBytes = 1 << 20;
+  // Output tile size m and input tile size m + 2
+  int tile_;
+  int alpha_;
+  Blob<Dtype> forward_weights_;
+  Blob<Dtype> backward_weights_;
+  // The weights forward_weights_ were transformed from
+  Blob<Dtype> weights_copy_;
+  bool transformed_;
+  // Per thread, [num_slots_] transformed input and products of a block,
+  // and the slots not in use
+  Blob<Dtype> thread_buffer_;
+  Dtype* thread_data_;
+  int num_slots_;
+  BlockingQueue<int> free_slots_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_WINOGRAD_CONV_LAYER_HPP_
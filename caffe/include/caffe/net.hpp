@@ -241,6 +241,11 @@ class Net {
   /// @brief Append a new parameter blob to the net.
   void AppendParam(const NetParameter& param, const int layer_id,
                    const int param_id);
+  /// @brief Assign the activations to shared buffers by their lifetimes,
+  /// and keep the assignment if apply.
+  void PlanMemory(bool apply);
+  /// @brief Point the planned tops of a layer at their shared buffers.
+  void BindPlannedTops(const int layer_id);
 
   /// @brief Helper for displaying debug info in Forward.
   void ForwardDebugInfo(const int layer_id);
@@ -304,6 +309,11 @@ class Net {
   vector<bool> has_params_decay_;
   /// The bytes of memory used by this net
   size_t memory_used_;
+  /// For a net with planned memory, the shared buffer of each blob (-1 for
+  /// its own memory), the buffers, and the blobs each layer binds to them
+  vector<int> blob_buffer_ids_;
+  vector<shared_ptr<SyncedMemory> > shared_buffers_;
+  vector<vector<int> > layer_planned_blob_ids_;
   /// Whether to compute and display debug info for the net.
   bool debug_info_;
   /// The root net that actually holds the shared layers in data parallelism
@@ -0,0 +1,63 @@
+#ifndef CAFFE_UTIL_BBOX_GEOMETRY_HPP_
+#define CAFFE_UTIL_BBOX_GEOMETRY_HPP_
+
+#include <cstddef>
+#include <vector>
+
+namespace caffe {
+
+/**
+ * @brief A set of boxes (x1, y1, x2, y2 in inclusive pixel coordinates, so
+ *        a box is x2 - x1 + 1 wide) held in structure-of-arrays form together
+ *        with their areas, so that IoU against many boxes vectorizes.
+ */
+class SoABoxes {
+ public:
+  SoABoxes() : n_(0), plane_(0) {}
+  /// See Reset.
+  SoABoxes(const float* boxes, const int n, const int stride = 4)
+      : n_(0), plane_(0) {
+    Reset(boxes, n, stride);
+  }
+
+  /**
+   * Loads n boxes whose coordinates start every stride floats, e.g. 4 for
+   * [n][4] boxes, 5 for [n][5] rois (pass rois + 1) or 4 * num_classes for
+   * the class-specific boxes of a detection output.
+   */
+  void Reset(const float* boxes, const int n, const int stride = 4);
+
+  int size() const { return n_; }
+  const float* x1() const { return plane(0); }
+  const float* y1() const { return plane(1); }
+  const float* x2() const { return plane(2); }
+  const float* y2() const { return plane(3); }
+  const float* area() const { return plane(4); }
+
+ private:
+  const float* plane(const int k) const {
+    return data_.empty() ? NULL : &data_[0] + k * plane_;
+  }
+
+  int n_;
+  // planes are padded to a multiple of 8 floats
+  int plane_;
+  std::vector<float> data_;
+};
+
+/**
+ * @brief Computes the IoU of box i of a with boxes [begin, end) of b into
+ *        iou[0 .. end - begin).
+ */
+void caffe_cpu_iou(const SoABoxes& a, const int i, const SoABoxes& b,
+    const int begin, const int end, float* iou);
+
+/**
+ * @brief Computes the a.size() x b.size() row-major IoU matrix. Columns are
+ *        processed in blocks so that the slice of b in use stays in cache.
+ */
+void caffe_cpu_iou(const SoABoxes& a, const SoABoxes& b, float* iou);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_BBOX_GEOMETRY_HPP_
@@ -1,11 +1,31 @@
 #ifndef CAFFE_UTIL_BLOCKING_QUEUE_HPP_
 #define CAFFE_UTIL_BLOCKING_QUEUE_HPP_
 
+#include <stdint.h>
+
 #include <queue>
 #include <string>
 
 namespace caffe {
 
+// Counters of a BlockingQueue since its creation
+struct BlockingQueueStats {
+  BlockingQueueStats()
+      : pushes(0), pops(0), stalls(0), stall_ms(0), depth_sum(0),
+        max_depth(0) {}
+
+  uint64_t pushes;
+  uint64_t pops;
+  // Pops that found the queue empty and had to wait, and their total wait
+  uint64_t stalls;
+  double stall_ms;
+  // Sum over pops of the queue size before popping, and the largest size
+  uint64_t depth_sum;
+  size_t max_depth;
+
+  double mean_depth() const { return pops ? double(depth_sum) / pops : 0; }
+};
+
 template<typename T>
 class BlockingQueue {
  public:
@@ -26,6 +46,8 @@ class BlockingQueue {
 
   size_t size() const;
 
+  BlockingQueueStats stats() const;
+
  protected:
   /**
    Move synchronization fields out instead of including boost/thread.hpp
@@ -36,6 +58,7 @@ class BlockingQueue {
 
   std::queue<T> queue_;
   shared_ptr<sync> sync_;
+  BlockingQueueStats stats_;
 
 DISABLE_COPY_AND_ASSIGN(BlockingQueue);
 };
@@ -0,0 +1,76 @@
+#ifndef CAFFE_UTIL_DETECTION_WRITER_HPP_
+#define CAFFE_UTIL_DETECTION_WRITER_HPP_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/internal_thread.hpp"
+#include "caffe/util/blocking_queue.hpp"
+
+namespace caffe {
+
+/// One detected object: an image and class index, its score and its
+/// x1, y1, x2, y2 box.
+struct DetectionRecord {
+  int32_t image;
+  int32_t label;
+  float score;
+  float box[4];
+};
+
+/**
+ * @brief Streams detections to a file from a background thread, so that
+ *        formatting and disk writes do not hold up detection.
+ *
+ * The BINARY format is an 8-byte "DETS" magic, a uint32 version and a
+ * reserved uint32, followed by packed DetectionRecord structs. The JSON
+ * format holds one object per line,
+ *   {"image": "000001", "class": "dog", "score": 0.912, "box": [...]}
+ * naming images and classes with the given lists.
+ */
+class DetectionWriter : public InternalThread {
+ public:
+  enum Format { BINARY, JSON };
+
+  static const uint32_t kVersion = 1;
+
+  DetectionWriter(const string& filename, Format format,
+      const vector<string>& image_names, const vector<string>& class_names);
+  /// Calls Close.
+  virtual ~DetectionWriter();
+
+  /// Queues the detections of one image; returns without waiting for them
+  /// to be written.
+  void Write(const vector<DetectionRecord>& records);
+  /// Writes all queued detections and closes the file.
+  void Close();
+
+  uint64_t num_written() const { return num_written_; }
+
+  /// Reads back a BINARY file.
+  static void Read(const string& filename, vector<DetectionRecord>* records);
+  /// Parses "binary" or "json".
+  static Format ParseFormat(const string& name);
+
+ protected:
+  virtual void InternalThreadEntry();
+  void WriteRecords(const vector<DetectionRecord>& records);
+
+  FILE* file_;
+  Format format_;
+  vector<string> image_names_;
+  vector<string> class_names_;
+  // Detections of an image, or NULL once closed
+  BlockingQueue<vector<DetectionRecord>*> queue_;
+  uint64_t num_written_;
+
+DISABLE_COPY_AND_ASSIGN(DetectionWriter);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_DETECTION_WRITER_HPP_
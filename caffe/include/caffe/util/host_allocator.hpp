@@ -0,0 +1,111 @@
+#ifndef CAFFE_UTIL_HOST_ALLOCATOR_HPP_
+#define CAFFE_UTIL_HOST_ALLOCATOR_HPP_
+
+#include <stdint.h>
+
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Process-wide allocator of the host memory of SyncedMemory when it
+ *        is not pinned for CUDA.
+ *
+ * Sizes are rounded up to classes a quarter of a power of two apart, so at
+ * most 25% is wasted, and freed blocks are kept per class for the next
+ * allocation of the class: blobs that grow and shrink with the inputs, as
+ * in detection, then stop going back to the system and zeroing their new
+ * memory every time. Blocks of kMapBytes or more are anonymous mappings,
+ * which the system hands out zeroed and untouched: they are not zeroed
+ * again, their pages are only placed, on the NUMA node of the thread that
+ * first writes them, when used, and they can be advised to use transparent
+ * huge pages. Each block remembers how much of it its owners may have
+ * written, so that zeroing a reused block only clears that dirty part,
+ * the rest of a mapped block being zero still. Blocks are aligned to
+ * kAlignment bytes. Safe to use from several threads. GlobalInit applies
+ * the Options of the --host_cache_mb and --huge_pages flags.
+ */
+class HostAllocator {
+ public:
+  static const size_t kAlignment = 64;
+  static const size_t kMapBytes = 1 << 20;
+
+  struct Options {
+    // Keep freed blocks for reuse, up to max_cached_bytes of them;
+    // otherwise every block goes back to the system when freed
+    bool pooled;
+    size_t max_cached_bytes;
+    // Advise the mapped blocks to use transparent huge pages
+    bool huge_pages;
+
+    Options() : pooled(true), max_cached_bytes(size_t(1) << 30),
+        huge_pages(true) {}
+  };
+
+  struct Stats {
+    uint64_t allocations;
+    // The allocations served from the freed blocks
+    uint64_t reuses;
+    uint64_t frees;
+    // The blocks given back to the system
+    uint64_t releases;
+    // The bytes zero-filled, which the clean parts of mapped blocks do not
+    // need
+    uint64_t zeroed_bytes;
+    size_t bytes_in_use;
+    size_t peak_bytes_in_use;
+    size_t cached_bytes;
+  };
+
+  static HostAllocator& Get();
+
+  /// Allocates at least size bytes, zero-filled if zero.
+  void* Allocate(size_t size, bool zero);
+  /// Frees a block from Allocate.
+  void Free(void* ptr);
+
+  /// Applies options, giving the freed blocks they no longer allow back
+  /// to the system.
+  void Configure(const Options& options);
+  Options options() const;
+  /// The Options set by the --host_cache_mb and --huge_pages flags.
+  static Options FlagOptions();
+  /// Gives all the freed blocks back to the system.
+  void Trim();
+  Stats stats() const;
+
+  /// The size of the blocks serving allocations of size bytes.
+  static size_t BlockSize(size_t size);
+
+ protected:
+  HostAllocator();
+
+  // Without the lock
+  void* SystemAllocate(size_t block_size, bool huge_pages);
+  void SystemFree(void* ptr, size_t block_size);
+
+  // See BlockingQueue::sync
+  class sync;
+
+  shared_ptr<sync> sync_;
+  Options options_;
+  Stats stats_;
+  struct Block {
+    size_t size;
+    // The leading bytes that may not be zero
+    size_t dirty_bytes;
+  };
+  // The allocated blocks, and the freed blocks of each size
+  std::map<void*, Block> blocks_;
+  std::map<size_t, vector<std::pair<void*, size_t> > > cached_;
+
+DISABLE_COPY_AND_ASSIGN(HostAllocator);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_HOST_ALLOCATOR_HPP_
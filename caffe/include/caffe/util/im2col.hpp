@@ -16,6 +16,18 @@ void im2col_cpu(const Dtype* data_im, const int channels,
     const int stride_w, const int dilation_h, const int dilation_w,
     Dtype* data_col);
 
+/// im2col_cpu restricted to the tile of output rows [row_begin, row_end)
+/// and columns [col_begin, col_end): fills the [channels * kernel_h *
+/// kernel_w][(row_end - row_begin) * (col_end - col_begin)] columns of that
+/// tile of the output.
+template <typename Dtype>
+void im2col_tile_cpu(const Dtype* data_im, const int channels,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w, const int dilation_h, const int dilation_w,
+    const int row_begin, const int row_end, const int col_begin,
+    const int col_end, Dtype* data_col);
+
 template <typename Dtype>
 void col2im_nd_cpu(const Dtype* data_col, const int num_spatial_axes,
     const int* im_shape, const int* col_shape,
@@ -29,6 +41,17 @@ void col2im_cpu(const Dtype* data_col, const int channels,
     const int stride_w, const int dilation_h, const int dilation_w,
     Dtype* data_im);
 
+/// The adjoint of im2col_tile_cpu: adds the columns of the tile of output
+/// rows [row_begin, row_end) and columns [col_begin, col_end) into data_im,
+/// which is not zeroed first.
+template <typename Dtype>
+void col2im_tile_cpu(const Dtype* data_col, const int channels,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w, const int dilation_h, const int dilation_w,
+    const int row_begin, const int row_end, const int col_begin,
+    const int col_end, Dtype* data_im);
+
 template <typename Dtype>
 void im2col_nd_gpu(const Dtype* data_im, const int num_spatial_axes,
     const int col_size, const int* im_shape, const int* col_shape,
@@ -0,0 +1,30 @@
+#ifndef CAFFE_UTIL_IMAGE_PREPROC_HPP_
+#define CAFFE_UTIL_IMAGE_PREPROC_HPP_
+
+#include <cstddef>
+
+namespace caffe {
+
+/**
+ * @brief Turns an 8-bit BGR image into a mean-subtracted CHW network input
+ *        in a single pass.
+ *
+ * The src_height x src_width image, whose rows start every src_step bytes,
+ * is resized to height x width with the bilinear sampling of
+ * cv::resize(INTER_LINEAR), optionally mirrored left-right, and mean[c] is
+ * subtracted from channel c. The result is written to the top-left corner of
+ * the three blob_height x blob_width planes starting at dst; the rest of the
+ * planes is zeroed, so dst may point at one image of a padded batch.
+ *
+ * Interpolation is linear, so this matches converting to float, subtracting
+ * the mean and resizing, up to rounding.
+ */
+template <typename Dtype>
+void caffe_cpu_prep_image(const unsigned char* src, const int src_height,
+    const int src_width, const size_t src_step, const int height,
+    const int width, const float* mean, const bool mirror,
+    const int blob_height, const int blob_width, Dtype* dst);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_IMAGE_PREPROC_HPP_
@@ -0,0 +1,39 @@
+#ifndef CAFFE_UTIL_NMS_HPP_
+#define CAFFE_UTIL_NMS_HPP_
+
+#include <vector>
+
+#include "caffe/util/bbox_geometry.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Greedy non-maximum suppression of boxes sorted by descending
+ *        score: a box is kept unless a kept box before it overlaps it with
+ *        an IoU above thresh. Appends the indices of the kept boxes to keep.
+ *
+ * Suppressed boxes are tracked in a bitmask. Each kept box computes its IoU
+ * with the following boxes 64 at a time, and skips blocks whose boxes are
+ * all suppressed already.
+ */
+void caffe_cpu_nms(const SoABoxes& boxes, const float thresh,
+    std::vector<int>* keep);
+
+/**
+ * @brief Per-class NMS of a detection output, all classes in one call.
+ *
+ * @param boxes [num_rois][4 * num_classes] class-specific boxes
+ * @param scores [num_rois][num_classes] class scores
+ * @param keep on return, (*keep)[c] holds the indices of the rois kept for
+ *        class c in descending score order, considering only rois scoring
+ *        at least conf_thresh. Class 0 is the background and left empty.
+ *
+ * Classes are processed in parallel on the thread pool.
+ */
+void caffe_cpu_nms_multiclass(const float* boxes, const float* scores,
+    const int num_rois, const int num_classes, const float conf_thresh,
+    const float nms_thresh, std::vector<std::vector<int> >* keep);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_NMS_HPP_
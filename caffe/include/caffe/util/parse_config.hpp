@@ -21,6 +21,7 @@ struct TRAIN
 	int SNAPSHOT_ITERS;
 	string SNAPSHOT_INFIX;
 	bool USE_PREFETCH;
+	bool ASPECT_GROUPING;
 };
 
 struct TEST
@@ -0,0 +1,127 @@
+#ifndef CAFFE_UTIL_PIPELINE_STATS_HPP_
+#define CAFFE_UTIL_PIPELINE_STATS_HPP_
+
+#include <stdint.h>
+
+#include <boost/function.hpp>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/blocking_queue.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Histogram of durations in power-of-two microsecond buckets; bucket
+ *        k counts durations in [2^k, 2^(k+1)) us, bucket 0 also those under
+ *        1 us. Safe to fill from several threads.
+ */
+class TimeHistogram {
+ public:
+  static const int kNumBuckets = 32;
+
+  struct Snapshot {
+    uint64_t count;
+    double total_ms;
+    double max_ms;
+    vector<uint64_t> buckets;
+
+    double mean_ms() const { return count ? total_ms / count : 0; }
+    /// Upper edge of the bucket holding the p-th fraction of the samples.
+    double percentile_ms(double p) const;
+  };
+
+  TimeHistogram();
+
+  void Add(float ms);
+  Snapshot snapshot() const;
+
+ protected:
+  // See BlockingQueue::sync
+  class sync;
+
+  shared_ptr<sync> sync_;
+  Snapshot data_;
+
+DISABLE_COPY_AND_ASSIGN(TimeHistogram);
+};
+
+/**
+ * @brief Times its own lifetime with a CPUTimer into a histogram.
+ */
+class StageTimer {
+ public:
+  explicit StageTimer(TimeHistogram* histogram) : histogram_(histogram) {
+    timer_.Start();
+  }
+  ~StageTimer() { histogram_->Add(timer_.MicroSeconds() / 1000); }
+
+ private:
+  TimeHistogram* histogram_;
+  CPUTimer timer_;
+
+DISABLE_COPY_AND_ASSIGN(StageTimer);
+};
+
+/**
+ * @brief Sums of a part and of its whole over samples, e.g. the padding
+ *        pixels of input blobs out of all their pixels. Safe to fill from
+ *        several threads.
+ */
+class RatioCounter {
+ public:
+  struct Snapshot {
+    uint64_t count;
+    double part;
+    double total;
+
+    double ratio() const { return total > 0 ? part / total : 0; }
+  };
+
+  RatioCounter();
+
+  void Add(double part, double total);
+  Snapshot snapshot() const;
+
+ protected:
+  class sync;
+
+  shared_ptr<sync> sync_;
+  Snapshot data_;
+
+DISABLE_COPY_AND_ASSIGN(RatioCounter);
+};
+
+/**
+ * @brief Process-wide registry of the timing histograms of named pipeline
+ *        stages (e.g. "data/decode") and of the counters of the queues
+ *        between them, to find out whether training waits on its data.
+ */
+class PipelineStats {
+ public:
+  /// The histogram of a stage, created on first use and never freed.
+  static TimeHistogram* Stage(const string& name);
+  /// The counter of a ratio, created on first use and never freed.
+  static RatioCounter* Ratio(const string& name);
+
+  /// Adds a queue to the reports until UnregisterQueue is called with the
+  /// returned handle.
+  static int RegisterQueue(const string& name,
+      const boost::function<BlockingQueueStats()>& stats);
+  static void UnregisterQueue(int handle);
+
+  /// Logs a line per stage, per ratio and per queue, and the HostAllocator
+  /// counters.
+  static void Log();
+  /// Writes every stage, ratio and queue and the HostAllocator counters as
+  /// a JSON object.
+  static void WriteJSON(std::ostream& out);
+  static void WriteJSON(const string& filename);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_PIPELINE_STATS_HPP_
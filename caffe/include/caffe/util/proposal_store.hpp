@@ -0,0 +1,66 @@
+#ifndef PROPOSAL_STORE_HPP
+#define PROPOSAL_STORE_HPP
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+
+namespace caffe
+{
+    /* ProposalStore - memory-mapped object proposals
+     *
+     * Proposal files hold the boxes of every image as x1, y1, x2, y2
+     * (0-based) behind a per-image offset index, as int16 when all
+     * coordinates are small integers (selective search boxes always are)
+     * and as float otherwise. Opening a file only maps it, so the boxes of
+     * an image are read when they are first used and memory does not grow
+     * with the dataset.
+     *
+     * Selective search .mat files (a cell array "boxes" of [n][4] 1-based
+     * y1, x1, y2, x2 boxes per image) are converted into data/cache the
+     * first time they are opened; tools/convert_proposals converts them
+     * ahead of time.
+     */
+    class ProposalStore
+    {
+    public:
+        ProposalStore();
+        ~ProposalStore();
+
+        // Maps a proposal file, or the conversion of a .mat file
+        void open(const std::string& path);
+
+        int num_images() const {return num_images_;}
+        int num_boxes(int i) const {return offsets_[i + 1] - offsets_[i];}
+        int64_t total_boxes() const {return offsets_[num_images_];}
+
+        // Copies the num_boxes(i) boxes of image i into boxes, [n][4]
+        void get_boxes(int i, float* boxes) const;
+
+        // Writes the proposals of image i, boxes[4 * offsets[i] ..
+        // 4 * offsets[i + 1]), to a proposal file (atomically, via a
+        // temporary file)
+        static void write(const std::string& path,
+                const std::vector<int64_t>& offsets,
+                const std::vector<float>& boxes);
+
+        // Converts a selective search .mat file to a proposal file
+        static void convert_mat(const std::string& mat_path,
+                const std::string& path);
+
+        static bool is_proposal_file(const std::string& path);
+
+        static const uint32_t kVersion = 1;
+
+    private:
+        boost::shared_ptr<void> storage_;
+        int num_images_;
+        int box_type_;
+        const int64_t* offsets_;
+        const void* boxes_;
+    };
+}
+
+#endif /* PROPOSAL_STORE_HPP */
@@ -2,23 +2,54 @@
 #define ROI_DATA_EXTRACTOR_HPP
 
 #include "caffe/3rdparty/pugixml.hpp"
+#include <boost/shared_ptr.hpp>
+#include <stdint.h>
 #include <vector>
 #include <string>
 
 
 namespace caffe
 {
-    struct ROI
+    /* ROIDB - training roidb in structure-of-arrays layout
+     *
+     * The per-box arrays of all images are concatenated: the boxes of image i
+     * are rows image_offsets[i] .. image_offsets[i+1]-1, and the first
+     * num_gt[i] of them are its ground-truth boxes. The arrays are either
+     * owned by the roidb, when built by ROIDataExtractor, or point into a
+     * mapped ROIDBCache file; storage keeps whichever alive.
+     */
+    struct ROIDB
     {
-	std::string image;
-	std::vector<std::vector<double> > boxes;
-	std::vector<int> gt_classes;
-	// gt_overlaps[][2]: maximum of IoU overlap between each example ROI and all ground-truth ROIs
-	// gt_overlaps[][1]: label of the ground-truth ROI corresponding to the maximum
-	// gt_overlaps[][0]: index of the ground-truth ROI
-	std::vector<std::vector<double> > gt_overlaps;
-	std::vector<std::vector<double> > targets;
-	bool flipped;
+        ROIDB();
+
+        int num_images;
+        int num_classes;
+        int64_t num_boxes;
+        std::vector<std::string> images;
+
+        const int64_t* image_offsets;  // [num_images + 1]
+        const int* num_gt;             // [num_images]
+        const unsigned char* flipped;  // [num_images]
+        const int* sizes;              // [num_images][2] width, height
+
+        const float* boxes;            // [num_boxes][4] x1, y1, x2, y2
+        // index within the image of the ground-truth box with the maximum
+        // IoU, the label of that box (0 if the IoU is 0) and the IoU itself
+        const int* gt_index;           // [num_boxes]
+        const int* label;              // [num_boxes]
+        const float* max_overlap;      // [num_boxes]
+        // normalized dx, dy, dw, dh to the ground-truth box, zero for boxes
+        // whose overlap is below 0.5
+        const float* targets;          // [num_boxes][4]
+
+        // per-class mean and stdev used to normalize the targets
+        const double* means;           // [num_classes][4]
+        const double* stds;            // [num_classes][4]
+
+        boost::shared_ptr<void> storage;
+
+        int64_t image_begin(int i) const {return image_offsets[i];}
+        int image_size(int i) const {return int(image_offsets[i + 1] - image_offsets[i]);}
     };
     
     class ROIDataExtractor
@@ -32,18 +63,27 @@ namespace caffe
                          bool use_flipped);
         ~ROIDataExtractor();
         
-        void getAttribute(pugi::xml_node node,
+        // Collects the labels and 0-based boxes of the objects (nodes
+        // called name) below node, and their difficult flags if asked for
+        static void getAttribute(pugi::xml_node node,
 		          std::string name,
 		          std::vector<std::string> &labels,
-		          std::vector<std::vector<double> > &bndboxes);
+		          std::vector<std::vector<double> > &bndboxes,
+		          std::vector<int>* difficult = NULL);
+        
         
+        // IoU of each of the num_gt ground-truth boxes with each of the
+        // num_boxes boxes, as a num_gt x num_boxes row-major matrix
+        void bbox_overlaps(const float* boxes, int num_boxes,
+                           const float* gt_boxes, int num_gt,
+                           std::vector<float> &overlaps);
         
-        void bbox_overlaps(const std::vector<std::vector<double> > &boxes,
-                           const std::vector<std::vector<double> > &gt_boxes,
-	                   std::vector<std::vector<double> > &overlaps);
         
+        bool roi_data_extract(ROIDB& roidb);
         
-        bool roi_data_extract(std::vector<ROI>& roidb);
+        // Saves the target statistics to data/cache/mean_std.txt, from where
+        // the solver un-normalizes bbox_pred when snapshotting
+        static void write_bbox_mean_std(const ROIDB& roidb);
         
     private:
         std::string dir_imgs_;
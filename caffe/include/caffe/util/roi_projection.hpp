@@ -0,0 +1,43 @@
+#ifndef CAFFE_UTIL_ROI_PROJECTION_HPP_
+#define CAFFE_UTIL_ROI_PROJECTION_HPP_
+
+#include <vector>
+
+namespace caffe {
+
+/**
+ * @brief Projects the [num_boxes][4] boxes of an image onto the levels of
+ *        its pyramid as [num_boxes][5] rois (level, x1, y1, x2, y2).
+ *
+ * The image is batch entry level_offset + j of the input blob at scale
+ * scales_factor[j]. With several scales, each roi is pooled from the level
+ * at which its area is closest to the 224 x 224 the net was pre-trained
+ * on.
+ */
+void caffe_cpu_project_rois(const float* boxes, const int num_boxes,
+    const std::vector<float>& scales_factor, const int level_offset,
+    float* rois);
+
+/**
+ * @brief Removes the [num_rois][5] rois that round to the same cells at
+ *        scale as an earlier one on the same level, keeping the first of
+ *        each in order, and sets rows[i] to the remaining row of roi i.
+ *
+ * Such rois pool identical features, e.g. at scale 1/16 for conv5. With
+ * scale <= 0 nothing is removed and rows[i] = i. Returns the number of
+ * remaining rois.
+ */
+int caffe_cpu_dedup_rois(float* rois, const int num_rois, const float scale,
+    int* rows);
+
+/**
+ * @brief Copies row rows[i] of the [][dim] data into row i of out, for i in
+ *        [0, num), giving the output of each box from the rows of
+ *        caffe_cpu_dedup_rois.
+ */
+void caffe_cpu_gather_rows(const float* data, const int dim,
+    const int* rows, const int num, float* out);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_ROI_PROJECTION_HPP_
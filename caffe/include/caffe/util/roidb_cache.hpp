@@ -0,0 +1,49 @@
+#ifndef ROIDB_CACHE_HPP
+#define ROIDB_CACHE_HPP
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "caffe/util/parse_config.hpp"
+#include "caffe/util/roi_data_extractor.hpp"
+
+namespace caffe
+{
+    /* ROIDBCache - binary cache of the training roidb
+     *
+     * Building the roidb parses every annotation, decodes the whole
+     * selective search .mat and computes overlaps and regression targets.
+     * The result is stored in data/cache as flat arrays behind a small header
+     * so that later runs only have to map the file.
+     *
+     * The cache is keyed by a hash of the image and class lists, the .mat
+     * file, the annotations of the listed images and USE_FLIPPED; any change
+     * to them selects a different cache file.
+     */
+    class ROIDBCache
+    {
+    public:
+        ROIDBCache(const struct COMMON& common_cfg, bool use_flipped);
+        ~ROIDBCache();
+
+        // Maps the cache file and points the roidb arrays into it; the
+        // mapping lives as long as the roidb. Returns false if the file is
+        // missing, stale or corrupt.
+        bool load(ROIDB& roidb);
+
+        // Writes the cache file (atomically, via a temporary file)
+        bool save(const ROIDB& roidb);
+
+        const std::string& path() const {return path_;}
+        uint64_t key() const {return key_;}
+
+        static const uint32_t kVersion = 3;
+
+    private:
+        uint64_t key_;
+        std::string path_;
+    };
+}
+
+#endif /* ROIDB_CACHE_HPP */
@@ -0,0 +1,34 @@
+#ifndef CAFFE_UTIL_THREAD_POOL_HPP_
+#define CAFFE_UTIL_THREAD_POOL_HPP_
+
+#include <boost/function.hpp>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Calls body(begin, end) on disjoint chunks covering [0, n), using a
+ *        process-wide pool of worker threads plus the calling thread, and
+ *        returns once every chunk has completed.
+ *
+ * Calls from several threads run concurrently, the workers taking chunks
+ * of the oldest region first, while each caller runs chunks of its own. A
+ * call made from inside a running body simply runs body(0, n) on the
+ * calling thread. Nesting is therefore always safe, just not parallel.
+ */
+void caffe_parallel_for(const int n,
+    const boost::function<void(int, int)>& body);
+
+/// Number of threads (including the caller) used by caffe_parallel_for.
+int caffe_get_num_threads();
+
+/**
+ * Resizes the pool. Defaults to the number of hardware threads; 1 disables
+ * threading altogether.
+ */
+void caffe_set_num_threads(const int num_threads);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_THREAD_POOL_HPP_
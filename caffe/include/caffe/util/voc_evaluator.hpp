@@ -0,0 +1,87 @@
+#ifndef CAFFE_UTIL_VOC_EVALUATOR_HPP_
+#define CAFFE_UTIL_VOC_EVALUATOR_HPP_
+
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/detection_writer.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Computes the PASCAL VOC average precision of each class as
+ *        detections stream in.
+ *
+ * The detections of an image are matched to its ground truth as soon as
+ * they are added: by decreasing score, a detection is a true positive if
+ * its highest-IoU ground-truth box of the class overlaps it by more than
+ * 0.5 and was not claimed by an earlier one, is ignored if that box is
+ * difficult, and is a false positive otherwise. This gives the same labels
+ * as matching all detections of a class in global score order, since the
+ * claimed boxes of an image only depend on its own detections. Only the
+ * score and label of each detection are kept for Evaluate.
+ */
+class VOCEvaluator {
+ public:
+  /// VOC07 averages the precision at 11 recall points, VOC12 (also used
+  /// from VOC2010 on) integrates the precision envelope over recall.
+  enum Metric { VOC07, VOC12 };
+
+  /// class_names[0] is the background, which is not evaluated.
+  VOCEvaluator(const vector<string>& class_names, Metric metric);
+
+  /// Reads the ground truth of images [0, image_names.size()) from
+  /// annotation_dir/<name>.xml, on the thread pool.
+  void LoadAnnotations(const string& annotation_dir,
+      const vector<string>& image_names);
+  /// Sets the ground truth of an image: [n][4] boxes with their class
+  /// indices and difficult flags.
+  void SetGroundTruth(int image, const vector<float>& boxes,
+      const vector<int>& labels, const vector<int>& difficult);
+
+  /// Matches all the detections of one image, whose image index must be
+  /// image; each image can be added once.
+  void AddDetections(int image, const vector<DetectionRecord>& records);
+
+  /// Computes the AP of each class in parallel into aps (0 for the
+  /// background) and returns their mean over the other classes.
+  float Evaluate(vector<float>* aps) const;
+
+  Metric metric() const { return metric_; }
+  int num_images() const { return ground_truth_.size(); }
+
+  /// AP of the precision/recall curve of detections sorted by score.
+  static float AveragePrecision(const vector<float>& recall,
+      const vector<float>& precision, Metric metric);
+  /// Parses "voc07" or "voc12".
+  static Metric ParseMetric(const string& name);
+
+ protected:
+  struct GroundTruth {
+    vector<float> boxes;
+    vector<int> labels;
+    vector<int> difficult;
+  };
+  // The matched detections of a class
+  struct ClassDetections {
+    vector<float> scores;
+    vector<char> true_positive;
+  };
+
+  void LoadImages(const string& annotation_dir,
+      const vector<string>& image_names, int begin, int end);
+  void EvaluateClasses(vector<float>* aps, int begin, int end) const;
+
+  vector<string> class_names_;
+  Metric metric_;
+  vector<GroundTruth> ground_truth_;
+  vector<bool> added_;
+  vector<ClassDetections> detections_;
+
+DISABLE_COPY_AND_ASSIGN(VOCEvaluator);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_VOC_EVALUATOR_HPP_
@@ -5,6 +5,7 @@
 #include <ctime>
 
 #include "caffe/common.hpp"
+#include "caffe/util/host_allocator.hpp"
 #include "caffe/util/rng.hpp"
 
 namespace caffe {
@@ -47,6 +48,8 @@ void GlobalInit(int* pargc, char*** pargv) {
   ::google::InitGoogleLogging(*(pargv)[0]);
   // Provide a backtrace on segfault.
   ::google::InstallFailureSignalHandler();
+  // Host memory pooling, from --host_cache_mb and --huge_pages.
+  HostAllocator::Get().Configure(HostAllocator::FlagOptions());
 }
 
 #ifdef CPU_ONLY  // CPU-only Caffe.
@@ -0,0 +1,353 @@
+#ifdef USE_OPENCV
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "caffe/detector.hpp"
+#include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/image_preproc.hpp"
+#include "caffe/util/nms.hpp"
+#include "caffe/util/roi_projection.hpp"
+#include "caffe/util/thread_pool.hpp"
+#include "caffe/util/upgrade_proto.hpp"
+
+namespace caffe {
+
+// The images of a forward pass, and everything computed for them
+struct Detector::Batch {
+  int begin;
+  vector<Input> inputs;
+  // Per image, the scale factor of each level and the scaled sizes
+  vector<vector<float> > scales_factor;
+  vector<vector<int> > heights;
+  vector<vector<int> > widths;
+  // Per image, its rois and the row among them of each of its boxes; rows
+  // are shared by boxes that project to the same conv cells
+  vector<vector<float> > image_rois;
+  vector<vector<int> > roi_rows;
+  // The rois of image i are rows [roi_offsets[i], roi_offsets[i + 1])
+  vector<int> roi_offsets;
+  Blob<float> data;
+  Blob<float> rois;
+  // Their host memory, written from several threads
+  float* data_ptr;
+  float* rois_ptr;
+  // Copies of the net outputs, which the next forward pass overwrites
+  Blob<float> pred_bboxes;
+  Blob<float> pred_probs;
+  vector<Detections> detections;
+};
+
+// The queues between the stages. A batch goes from free to prepared on the
+// loader thread, to forwarded on the calling thread and back to free on the
+// post-processing thread.
+struct Detector::Pipeline {
+  static const int kNumBatches = 3;
+
+  Detector* detector;
+  int num_images;
+  LoadFunction load;
+  ResultFunction result;
+  Batch batches[kNumBatches];
+  BlockingQueue<Batch*> free;
+  BlockingQueue<Batch*> prepared;
+  BlockingQueue<Batch*> forwarded;
+
+  int num_batches() const {
+    const int n = detector->images_per_batch_;
+    return (num_images + n - 1) / n;
+  }
+
+  void LoadBatches() {
+    const int n = detector->images_per_batch_;
+    for (int b = 0; b < num_batches(); ++b) {
+      Batch* batch = free.pop();
+      batch->begin = b * n;
+      batch->inputs.resize(std::min(n, num_images - batch->begin));
+      caffe_parallel_for(batch->inputs.size(), boost::bind(
+          &Detector::LoadImages, detector, boost::cref(load), batch, _1, _2));
+      detector->Prepare(batch);
+      prepared.push(batch);
+    }
+  }
+
+  void FinishBatches() {
+    for (int b = 0; b < num_batches(); ++b) {
+      Batch* batch = forwarded.pop();
+      detector->Finish(batch);
+      for (int i = 0; i < batch->inputs.size(); ++i) {
+        result(batch->begin + i, batch->inputs[i], batch->detections[i]);
+      }
+      free.push(batch);
+    }
+  }
+};
+
+Detector::Detector(const string& model_file, const string& weights_file,
+    const COMMON& common_cfg, const DEPLOY& deploy_cfg)
+    : common_cfg_(common_cfg), deploy_cfg_(deploy_cfg),
+      images_per_batch_(1) {
+  CHECK_EQ(common_cfg_.PIXEL_MEANS.size(), 3);
+  CHECK_GT(deploy_cfg_.SCALES.size(), 0);
+  NetParameter param;
+  ReadNetParamsFromTextFileOrDie(model_file, &param);
+  param.mutable_state()->set_phase(TEST);
+  // Only the inputs and outputs are read, so the activations can share
+  // memory
+  param.set_plan_memory(true);
+  net_.reset(new Net<float>(param));
+  net_->CopyTrainedLayersFrom(weights_file);
+
+  CHECK_EQ(net_->num_inputs(), 2) << "Network should have exactly two inputs.";
+  CHECK_EQ(net_->num_outputs(), 2) << "Network should have exactly two outpus.";
+  input_img_ = net_->input_blobs()[0];
+  input_rois_ = net_->input_blobs()[1];
+  output_bboxes_ = net_->output_blobs()[0];
+  output_probs_ = net_->output_blobs()[1];
+  CHECK_EQ(input_img_->channels(), 3) << "Input img should have three channels.";
+  num_classes_ = output_probs_->shape(1);
+}
+
+void Detector::set_images_per_batch(int images_per_batch) {
+  CHECK_GT(images_per_batch, 0);
+  images_per_batch_ = images_per_batch;
+}
+
+void Detector::Detect(const Input& input, Detections* detections) {
+  Batch batch;
+  batch.begin = 0;
+  batch.inputs.push_back(input);
+  Prepare(&batch);
+  Forward(&batch);
+  Finish(&batch);
+  *detections = batch.detections[0];
+}
+
+void Detector::Detect(int num_images, const LoadFunction& load,
+    const ResultFunction& result) {
+  Pipeline pipeline;
+  pipeline.detector = this;
+  pipeline.num_images = num_images;
+  pipeline.load = load;
+  pipeline.result = result;
+  for (int i = 0; i < Pipeline::kNumBatches; ++i) {
+    pipeline.free.push(&pipeline.batches[i]);
+  }
+  boost::thread loader(&Pipeline::LoadBatches, &pipeline);
+  boost::thread finisher(&Pipeline::FinishBatches, &pipeline);
+  for (int b = 0; b < pipeline.num_batches(); ++b) {
+    Batch* batch = pipeline.prepared.pop();
+    Forward(batch);
+    pipeline.forwarded.push(batch);
+  }
+  loader.join();
+  finisher.join();
+}
+
+void Detector::LoadImages(const LoadFunction& load, Batch* batch, int begin,
+    int end) {
+  for (int i = begin; i < end; ++i) {
+    load(batch->begin + i, &batch->inputs[i]);
+    CHECK_EQ(batch->inputs[i].image.type(), CV_8UC3)
+        << "Image " << batch->begin + i << " should be 8-bit BGR.";
+    CHECK_EQ(batch->inputs[i].boxes.size() % 4, 0);
+  }
+}
+
+void Detector::Prepare(Batch* batch) {
+  const int num_images = batch->inputs.size();
+  const int num_scales = deploy_cfg_.SCALES.size();
+  batch->scales_factor.resize(num_images);
+  batch->heights.resize(num_images);
+  batch->widths.resize(num_images);
+  batch->image_rois.resize(num_images);
+  batch->roi_rows.resize(num_images);
+  batch->roi_offsets.resize(num_images + 1);
+  batch->roi_offsets[0] = 0;
+  int max_height = 0;
+  int max_width = 0;
+  for (int i = 0; i < num_images; ++i) {
+    const cv::Mat& image = batch->inputs[i].image;
+    GetImageScales(image, &batch->scales_factor[i]);
+    batch->heights[i].resize(num_scales);
+    batch->widths[i].resize(num_scales);
+    for (int j = 0; j < num_scales; ++j) {
+      batch->heights[i][j] = round(batch->scales_factor[i][j] * image.rows);
+      batch->widths[i][j] = round(batch->scales_factor[i][j] * image.cols);
+      max_height = std::max(max_height, batch->heights[i][j]);
+      max_width = std::max(max_width, batch->widths[i][j]);
+    }
+  }
+  batch->data.Reshape(num_images * num_scales, 3, max_height, max_width);
+  batch->data_ptr = batch->data.mutable_cpu_data();
+  // Each level of each image is resized on its own, so that a pyramid of a
+  // single image keeps all the threads busy
+  caffe_parallel_for(num_images * num_scales,
+      boost::bind(&Detector::PrepareLevels, this, batch, _1, _2));
+  caffe_parallel_for(num_images,
+      boost::bind(&Detector::PrepareROIs, this, batch, _1, _2));
+  for (int i = 0; i < num_images; ++i) {
+    batch->roi_offsets[i + 1] = batch->roi_offsets[i] +
+        batch->image_rois[i].size() / 5;
+  }
+  batch->rois.Reshape(batch->roi_offsets[num_images], 5, 1, 1);
+  batch->rois_ptr = batch->rois.mutable_cpu_data();
+  for (int i = 0; i < num_images; ++i) {
+    std::copy(batch->image_rois[i].begin(), batch->image_rois[i].end(),
+        batch->rois_ptr + 5 * batch->roi_offsets[i]);
+  }
+}
+
+void Detector::PrepareLevels(Batch* batch, int begin, int end) {
+  const int num_scales = deploy_cfg_.SCALES.size();
+  for (int level = begin; level < end; ++level) {
+    const int i = level / num_scales;
+    const int j = level % num_scales;
+    const cv::Mat& image = batch->inputs[i].image;
+    caffe_cpu_prep_image(image.data, image.rows, image.cols, image.step,
+        batch->heights[i][j], batch->widths[i][j],
+        &common_cfg_.PIXEL_MEANS[0], false, batch->data.height(),
+        batch->data.width(), batch->data_ptr + batch->data.offset(level));
+  }
+}
+
+void Detector::PrepareROIs(Batch* batch, int begin, int end) {
+  const int num_scales = deploy_cfg_.SCALES.size();
+  for (int i = begin; i < end; ++i) {
+    const Input& input = batch->inputs[i];
+    const int num_boxes = input.boxes.size() / 4;
+    vector<float>& rois = batch->image_rois[i];
+    vector<int>& rows = batch->roi_rows[i];
+    rois.resize(5 * num_boxes);
+    rows.resize(num_boxes);
+    if (num_boxes == 0) {
+      continue;
+    }
+    caffe_cpu_project_rois(&input.boxes[0], num_boxes,
+        batch->scales_factor[i], i * num_scales, &rois[0]);
+    // Boxes whose rois round to the same cells of the conv feature map
+    // would pool the same features, so only the first goes through the net
+    rois.resize(5 * caffe_cpu_dedup_rois(&rois[0], num_boxes,
+        common_cfg_.DEDUP_BOXES, &rows[0]));
+  }
+}
+
+void Detector::Forward(Batch* batch) {
+  if (batch->rois.num() == 0) {
+    batch->pred_bboxes.Reshape(0, 4 * num_classes_, 1, 1);
+    batch->pred_probs.Reshape(0, num_classes_, 1, 1);
+    return;
+  }
+  input_img_->ReshapeLike(batch->data);
+  input_img_->ShareData(batch->data);
+  input_rois_->ReshapeLike(batch->rois);
+  input_rois_->ShareData(batch->rois);
+  net_->Reshape();
+  net_->Forward();
+  batch->pred_bboxes.CopyFrom(*output_bboxes_, false, true);
+  batch->pred_probs.CopyFrom(*output_probs_, false, true);
+}
+
+void Detector::Finish(Batch* batch) {
+  batch->detections.resize(batch->inputs.size());
+  // Bring the outputs to the host once, before the threads read them
+  batch->pred_bboxes.cpu_data();
+  batch->pred_probs.cpu_data();
+  caffe_parallel_for(batch->inputs.size(),
+      boost::bind(&Detector::FinishImages, this, batch, _1, _2));
+}
+
+void Detector::FinishImages(Batch* batch, int begin, int end) {
+  vector<float> pred_delta, pred_score;
+  for (int i = begin; i < end; ++i) {
+    // Scatter the outputs of the unique rois back to every box, which is
+    // then decoded from its own coordinates
+    const vector<int>& rows = batch->roi_rows[i];
+    const int offset = batch->roi_offsets[i];
+    const int num_boxes = rows.size();
+    pred_delta.resize(4 * num_classes_ * num_boxes);
+    pred_score.resize(num_classes_ * num_boxes);
+    if (num_boxes) {
+      caffe_cpu_gather_rows(
+          batch->pred_bboxes.cpu_data() + 4 * num_classes_ * offset,
+          4 * num_classes_, &rows[0], num_boxes, &pred_delta[0]);
+      caffe_cpu_gather_rows(
+          batch->pred_probs.cpu_data() + num_classes_ * offset,
+          num_classes_, &rows[0], num_boxes, &pred_score[0]);
+    }
+    Detections* detections = &batch->detections[i];
+    DecodeDetections(batch->inputs[i], pred_delta.data(), pred_score.data(),
+        detections);
+    if (detections->num_rois == 0) {
+      detections->keep.assign(num_classes_, vector<int>());
+      continue;
+    }
+    caffe_cpu_nms_multiclass(&detections->boxes[0], &detections->scores[0],
+        detections->num_rois, num_classes_, deploy_cfg_.CONF_THRESH,
+        deploy_cfg_.NMS, &detections->keep);
+  }
+}
+
+void Detector::GetImageScales(const cv::Mat& image,
+    vector<float>* scales_factor) {
+  int size_min = std::min(image.rows, image.cols);
+  int size_max = std::max(image.rows, image.cols);
+  scales_factor->clear();
+  for (int i = 0; i < deploy_cfg_.SCALES.size(); i ++) {
+    float im_scale = float(deploy_cfg_.SCALES[i]) / size_min;
+    if (round(im_scale * size_max) > deploy_cfg_.MAX_SIZE)
+      im_scale = float(deploy_cfg_.MAX_SIZE) / size_max;
+    scales_factor->push_back(im_scale);
+  }
+}
+
+void Detector::DecodeDetections(const Input& input, const float* pred_delta,
+    const float* pred_score, Detections* detections) {
+  const int num_rois = input.boxes.size() / 4;
+  const int num_classes = num_classes_;
+  const int rows = input.image.rows;
+  const int cols = input.image.cols;
+  detections->num_rois = num_rois;
+  detections->num_classes = num_classes;
+  vector<float>& pred_bboxes = detections->boxes;
+  vector<float>& pred_probs = detections->scores;
+  pred_bboxes.resize(num_rois * num_classes * 4);
+  pred_probs.resize(num_rois * num_classes);
+  for (int i = 0; i < num_rois; i ++) {
+    const float* box = &input.boxes[4 * i];
+    float center_x = (box[0] + box[2]) / 2;
+    float center_y = (box[1] + box[3]) / 2;
+    float width = box[2] - box[0] + 1.0;
+    float height = box[3] - box[1] + 1.0;
+    for (int j = 0; j < num_classes; j ++) {
+      pred_probs[i*num_classes+j] = pred_score[i*num_classes+j];
+      float pred_center_x = pred_delta[i*num_classes*4+4*j] * width + center_x;
+      float pred_center_y = pred_delta[i*num_classes*4+4*j+1] * height + center_y;
+      float pred_width = exp(pred_delta[i*num_classes*4+4*j+2]) * width;
+      float pred_height = exp(pred_delta[i*num_classes*4+4*j+3]) * height;
+      int pred_left = int(pred_center_x - 0.5 * pred_width);
+      int pred_right = int(pred_center_x + 0.5 * pred_width);
+      int pred_top = int(pred_center_y - 0.5 * pred_height);
+      int pred_bottom = int(pred_center_y + 0.5 * pred_height);
+
+      pred_left = pred_left > 0 ? pred_left : 0;
+      pred_right = pred_right < cols ? pred_right : cols - 1;
+      pred_top = pred_top > 0 ? pred_top : 0;
+      pred_bottom = pred_bottom < rows ? pred_bottom : rows - 1;
+
+      if (pred_right - pred_left < 32 || pred_bottom - pred_top < 32)
+        pred_probs[i*num_classes+j] = 0.0;
+
+      pred_bboxes[i*num_classes*4+4*j] = pred_left;
+      pred_bboxes[i*num_classes*4+4*j+1] = pred_top;
+      pred_bboxes[i*num_classes*4+4*j+2] = pred_right;
+      pred_bboxes[i*num_classes*4+4*j+3] = pred_bottom;
+    }
+  }
+}
+
+}  // namespace caffe
+#endif  // USE_OPENCV
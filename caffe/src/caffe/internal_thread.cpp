@@ -11,28 +11,36 @@ InternalThread::~InternalThread() {
 }
 
 bool InternalThread::is_started() const {
-  return thread_ && thread_->joinable();
+  return !threads_.empty() && threads_[0]->joinable();
 }
 
+// Only called from the internal threads, which must not read threads_
+// while StartInternalThread may still be adding to it
 bool InternalThread::must_stop() {
-  return thread_ && thread_->interruption_requested();
+  return boost::this_thread::interruption_requested();
 }
 
-void InternalThread::StartInternalThread() {
+void InternalThread::StartInternalThread(int num_threads) {
   CHECK(!is_started()) << "Threads should persist and not be restarted.";
+  CHECK_GE(num_threads, 1);
 
   int device = 0;
 #ifndef CPU_ONLY
   CUDA_CHECK(cudaGetDevice(&device));
 #endif
   Caffe::Brew mode = Caffe::mode();
-  int rand_seed = caffe_rng_rand();
   int solver_count = Caffe::solver_count();
   bool root_solver = Caffe::root_solver();
 
+  threads_.clear();
+  threads_.reserve(num_threads);
   try {
-    thread_.reset(new boost::thread(&InternalThread::entry, this, device, mode,
-          rand_seed, solver_count, root_solver));
+    for (int i = 0; i < num_threads; ++i) {
+      int rand_seed = caffe_rng_rand();
+      threads_.push_back(shared_ptr<boost::thread>(new boost::thread(
+          &InternalThread::entry, this, device, mode, rand_seed, solver_count,
+          root_solver)));
+    }
   } catch (std::exception& e) {
     LOG(FATAL) << "Thread exception: " << e.what();
   }
@@ -53,12 +61,16 @@ void InternalThread::entry(int device, Caffe::Brew mode, int rand_seed,
 
 void InternalThread::StopInternalThread() {
   if (is_started()) {
-    thread_->interrupt();
-    try {
-      thread_->join();
-    } catch (boost::thread_interrupted&) {
-    } catch (std::exception& e) {
-      LOG(FATAL) << "Thread exception: " << e.what();
+    for (int i = 0; i < threads_.size(); ++i) {
+      threads_[i]->interrupt();
+    }
+    for (int i = 0; i < threads_.size(); ++i) {
+      try {
+        threads_[i]->join();
+      } catch (boost::thread_interrupted&) {
+      } catch (std::exception& e) {
+        LOG(FATAL) << "Thread exception: " << e.what();
+      }
     }
   }
 }
@@ -1,3 +1,4 @@
+#include <boost/bind.hpp>
 #include <algorithm>
 #include <vector>
 
@@ -5,6 +6,7 @@
 #include "caffe/layers/base_conv_layer.hpp"
 #include "caffe/util/im2col.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
@@ -19,6 +21,11 @@ void BaseConvolutionLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   const int num_axes = bottom[0]->num_axes();
   num_spatial_axes_ = num_axes - first_spatial_axis;
   CHECK_GE(num_spatial_axes_, 0);
+  tiled_ = conv_param.engine() == ConvolutionParameter_Engine_TILED;
+  if (tiled_) {
+    CHECK(num_spatial_axes_ == 2 && !force_nd_im2col_ && !reverse_dimensions())
+        << "The TILED engine only implements 2D convolution.";
+  }
   vector<int> bottom_dim_blob_shape(1, num_spatial_axes_ + 1);
   vector<int> spatial_dim_blob_shape(1, std::max(num_spatial_axes_, 1));
   // Setup filter kernel dimensions (kernel_shape_).
@@ -320,6 +327,247 @@ void BaseConvolutionLayer<Dtype>::backward_cpu_bias(Dtype* bias,
       input, bias_multiplier_.cpu_data(), 1., bias);
 }
 
+template <typename Dtype>
+bool BaseConvolutionLayer<Dtype>::tiled_cpu() {
+  return (tiled_ || caffe_get_num_threads() > 1) && !reverse_dimensions() &&
+      !force_nd_im2col_ && num_spatial_axes_ == 2;
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::set_up_tiles(bool weights_diff,
+    bool input_diff) {
+  const int num_threads = caffe_get_num_threads();
+  const int height_out = output_shape_[0];
+  const int width_out = output_shape_[1];
+  // Tiles of min_size[0] rows and min_size[1] columns or more two apart
+  // read disjoint input, which only matters to the input gradient
+  int min_size[2] = {1, 1};
+  for (int i = 0; input_diff && i < 2; ++i) {
+    const int extent = dilation_.cpu_data()[i] *
+        (kernel_shape_.cpu_data()[i] - 1) + 1;
+    const int stride = stride_.cpu_data()[i];
+    min_size[i] = std::max(1, (extent + stride - 1) / stride - 1);
+  }
+  // With the TILED engine, rows are cut into column bands when min_size[0]
+  // of them do not fit in kTileBytes
+  const int col_bytes = kernel_dim_ * group_ * sizeof(Dtype);
+  tiles_across_ = 1;
+  if (tiled_) {
+    const int band_cols = std::max(1, kTileBytes / (min_size[0] * col_bytes));
+    tiles_across_ = std::max(1, std::min((width_out + band_cols - 1) /
+        band_cols, width_out / min_size[1]));
+  }
+  cols_per_tile_ = (width_out + tiles_across_ - 1) / tiles_across_;
+  tiles_across_ = (width_out + cols_per_tile_ - 1) / cols_per_tile_;
+  // At least a tile per thread, so that the column buffers of all the
+  // threads take no more memory than one of a whole image, a few tasks per
+  // thread over the batch to balance the load, and with the TILED engine
+  // tiles whose columns fit in the cache
+  const int wanted = std::max(num_threads,
+      (4 * num_threads + num_ - 1) / num_);
+  int wanted_down = (wanted + tiles_across_ - 1) / tiles_across_;
+  if (tiled_) {
+    const int cache_rows = std::max(1,
+        kTileBytes / (cols_per_tile_ * col_bytes));
+    wanted_down = std::max(wanted_down,
+        (height_out + cache_rows - 1) / cache_rows);
+  }
+  tiles_down_ = std::max(1, std::min(wanted_down, height_out / min_size[0]));
+  rows_per_tile_ = (height_out + tiles_down_ - 1) / tiles_down_;
+  tiles_down_ = (height_out + rows_per_tile_ - 1) / rows_per_tile_;
+  tiles_per_image_ = tiles_down_ * tiles_across_;
+  const int tile_size = rows_per_tile_ * cols_per_tile_;
+
+  if (num_slots_ != num_threads) {
+    int slot;
+    while (free_slots_.try_pop(&slot)) {}
+    for (slot = 0; slot < num_threads; ++slot) {
+      free_slots_.push(slot);
+    }
+    num_slots_ = num_threads;
+  }
+  vector<int> shape(2, num_slots_);
+  shape[1] = kernel_dim_ * group_ * tile_size;
+  thread_col_buffer_.Reshape(shape);
+  thread_col_data_ = thread_col_buffer_.mutable_cpu_data();
+  shape[1] = conv_out_channels_ * tile_size;
+  thread_output_buffer_.Reshape(shape);
+  thread_output_data_ = thread_output_buffer_.mutable_cpu_data();
+  if (weights_diff) {
+    shape[1] = this->blobs_[0]->count();
+    thread_weight_diff_.Reshape(shape);
+    thread_weight_diff_data_ = thread_weight_diff_.mutable_cpu_data();
+  }
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::forward_cpu_tiles(const Dtype* input,
+    const Dtype* weights, const Dtype* bias, Dtype* output) {
+  set_up_tiles(false, false);
+  if (bias) {
+    bias_multiplier_.cpu_data();
+  }
+  caffe_parallel_for(num_ * tiles_per_image_, boost::bind(
+      &BaseConvolutionLayer<Dtype>::forward_tiles_cpu, this, input, weights,
+      bias, output, _1, _2));
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::forward_tiles_cpu(const Dtype* input,
+    const Dtype* weights, const Dtype* bias, Dtype* output, int begin,
+    int end) {
+  const int slot = free_slots_.pop();
+  const int width_out = output_shape_[1];
+  const int tile_size = rows_per_tile_ * cols_per_tile_;
+  Dtype* col_buff = thread_col_data_ + slot * kernel_dim_ * group_ * tile_size;
+  Dtype* output_tile = thread_output_data_ +
+      slot * conv_out_channels_ * tile_size;
+  for (int task = begin; task < end; ++task) {
+    const int n = task / tiles_per_image_;
+    const int tile = task % tiles_per_image_;
+    const int row_begin = tile / tiles_across_ * rows_per_tile_;
+    const int row_end = std::min(row_begin + rows_per_tile_, output_shape_[0]);
+    const int col_begin = tile % tiles_across_ * cols_per_tile_;
+    const int col_end = std::min(col_begin + cols_per_tile_, width_out);
+    const int tile_width = col_end - col_begin;
+    const int cols = (row_end - row_begin) * tile_width;
+    conv_im2col_tile_cpu(input + n * bottom_dim_, row_begin, row_end,
+        col_begin, col_end, col_buff);
+    // A whole image is written in place, a tile is scattered afterwards
+    Dtype* out = tiles_per_image_ == 1 ? output + n * top_dim_ : output_tile;
+    for (int g = 0; g < group_; ++g) {
+      caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, conv_out_channels_ /
+          group_, cols, kernel_dim_,
+          (Dtype)1., weights + weight_offset_ * g, col_buff + kernel_dim_ *
+          cols * g, (Dtype)0., out + conv_out_channels_ / group_ * cols * g);
+    }
+    if (bias) {
+      caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_output_, cols, 1,
+          (Dtype)1., bias, bias_multiplier_.cpu_data(), (Dtype)1., out);
+    }
+    if (tiles_per_image_ > 1) {
+      Dtype* image = output + n * top_dim_ + row_begin * width_out +
+          col_begin;
+      for (int c = 0; c < num_output_; ++c) {
+        for (int h = 0; h < row_end - row_begin; ++h) {
+          caffe_copy(tile_width, output_tile + c * cols + h * tile_width,
+              image + c * out_spatial_dim_ + h * width_out);
+        }
+      }
+    }
+  }
+  free_slots_.push(slot);
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::backward_cpu_tiles(const Dtype* input,
+    const Dtype* output_diff, const Dtype* weights, Dtype* weights_diff,
+    Dtype* input_diff) {
+  set_up_tiles(weights_diff != NULL, input_diff != NULL);
+  if (weights_diff) {
+    caffe_set(thread_weight_diff_.count(), Dtype(0),
+        thread_weight_diff_data_);
+  }
+  // Each slot takes a fixed range of the tasks, so that its weight
+  // gradient sums the same tiles in the same order whatever the scheduling
+  if (input_diff) {
+    caffe_set(num_ * bottom_dim_, Dtype(0), input_diff);
+    for (int parity = 0; parity < 4; ++parity) {
+      const int tiles = (tiles_down_ + 1 - parity / 2) / 2 *
+          ((tiles_across_ + 1 - parity % 2) / 2);
+      if (tiles) {
+        caffe_parallel_for(num_slots_, boost::bind(
+            &BaseConvolutionLayer<Dtype>::backward_tiles_cpu, this, input,
+            output_diff, weights, weights_diff != NULL, input_diff, parity,
+            _1, _2));
+      }
+    }
+  } else {
+    caffe_parallel_for(num_slots_, boost::bind(
+        &BaseConvolutionLayer<Dtype>::backward_tiles_cpu, this, input,
+        output_diff, weights, true, input_diff, -1, _1, _2));
+  }
+  if (weights_diff) {
+    const int count = this->blobs_[0]->count();
+    for (int slot = 0; slot < num_slots_; ++slot) {
+      caffe_axpy(count, Dtype(1), thread_weight_diff_data_ + slot * count,
+          weights_diff);
+    }
+  }
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::backward_tiles_cpu(const Dtype* input,
+    const Dtype* output_diff, const Dtype* weights, bool weights_diff,
+    Dtype* input_diff, int parity, int begin, int end) {
+  const int width_out = output_shape_[1];
+  const int tile_size = rows_per_tile_ * cols_per_tile_;
+  const int step = parity < 0 ? 1 : 2;
+  const int first_down = parity < 0 ? 0 : parity / 2;
+  const int first_across = parity < 0 ? 0 : parity % 2;
+  const int down = (tiles_down_ - first_down + step - 1) / step;
+  const int across = (tiles_across_ - first_across + step - 1) / step;
+  const int num_tasks = num_ * down * across;
+  for (int slot = begin; slot < end; ++slot) {
+    Dtype* col_buff = thread_col_data_ +
+        slot * kernel_dim_ * group_ * tile_size;
+    Dtype* output_tile = thread_output_data_ +
+        slot * conv_out_channels_ * tile_size;
+    Dtype* weights_diff_slot = thread_weight_diff_data_ +
+        slot * this->blobs_[0]->count();
+    const int task_begin = static_cast<int64_t>(num_tasks) * slot /
+        num_slots_;
+    const int task_end = static_cast<int64_t>(num_tasks) * (slot + 1) /
+        num_slots_;
+    for (int task = task_begin; task < task_end; ++task) {
+      const int n = task / (down * across);
+      const int tile = task % (down * across);
+      const int row_begin = (first_down + tile / across * step) *
+          rows_per_tile_;
+      const int row_end = std::min(row_begin + rows_per_tile_,
+          output_shape_[0]);
+      const int col_begin = (first_across + tile % across * step) *
+          cols_per_tile_;
+      const int col_end = std::min(col_begin + cols_per_tile_, width_out);
+      const int tile_width = col_end - col_begin;
+      const int cols = (row_end - row_begin) * tile_width;
+      const Dtype* diff = output_diff + n * top_dim_;
+      if (tiles_per_image_ > 1) {
+        const Dtype* image = diff + row_begin * width_out + col_begin;
+        for (int c = 0; c < num_output_; ++c) {
+          for (int h = 0; h < row_end - row_begin; ++h) {
+            caffe_copy(tile_width, image + c * out_spatial_dim_ +
+                h * width_out, output_tile + c * cols + h * tile_width);
+          }
+        }
+        diff = output_tile;
+      }
+      if (weights_diff) {
+        conv_im2col_tile_cpu(input + n * bottom_dim_, row_begin, row_end,
+            col_begin, col_end, col_buff);
+        for (int g = 0; g < group_; ++g) {
+          caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans,
+              conv_out_channels_ / group_, kernel_dim_, cols,
+              (Dtype)1., diff + conv_out_channels_ / group_ * cols * g,
+              col_buff + kernel_dim_ * cols * g,
+              (Dtype)1., weights_diff_slot + weight_offset_ * g);
+        }
+      }
+      if (input_diff) {
+        for (int g = 0; g < group_; ++g) {
+          caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, kernel_dim_, cols,
+              conv_out_channels_ / group_,
+              (Dtype)1., weights + weight_offset_ * g,
+              diff + conv_out_channels_ / group_ * cols * g,
+              (Dtype)0., col_buff + kernel_dim_ * cols * g);
+        }
+        conv_col2im_tile_cpu(col_buff, row_begin, row_end, col_begin,
+            col_end, input_diff + n * bottom_dim_);
+      }
+    }
+  }
+}
+
 #ifndef CPU_ONLY
 
 template <typename Dtype>
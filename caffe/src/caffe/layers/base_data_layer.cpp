@@ -1,4 +1,6 @@
+#include <boost/bind.hpp>
 #include <boost/thread.hpp>
+#include <algorithm>
 #include <vector>
 
 #include "caffe/blob.hpp"
@@ -8,6 +10,7 @@
 #include "caffe/layers/base_data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/pipeline_stats.hpp"
 
 namespace caffe {
 
@@ -124,16 +127,44 @@ void BasePrefetchingDataLayer<Dtype>::Forward_cpu(
   prefetch_free_.push(batch);
 }
 
+// Hands out batch ids and delivers the batches in id order. Kept out of the
+// header, which nvcc sees, as it needs boost/thread.hpp.
+template <typename Dtype>
+class BaseROIPrefetchingDataLayer<Dtype>::Ordering {
+ public:
+  Ordering() : next_reserve_(0), next_push_(0) {}
+
+  boost::mutex mutex_;
+  boost::condition_variable pushed_;
+  int64_t next_reserve_;
+  int64_t next_push_;
+};
+
 template <typename Dtype>
 BaseROIPrefetchingDataLayer<Dtype>::BaseROIPrefetchingDataLayer(
     const LayerParameter& param)
     : BaseDataLayer<Dtype>(param),
-      prefetch_roi_free_(), prefetch_roi_full_() {
-  for (int i = 0; i < PREFETCH_COUNT; ++i) {
-    prefetch_roi_free_.push(&prefetch_roi_[i]);
+      prefetch_roi_free_(), prefetch_roi_full_(),
+      load_time_(NULL), reorder_time_(NULL),
+      ordering_(new Ordering()), free_queue_handle_(-1),
+      full_queue_handle_(-1), num_forwarded_(0), forwarded_(NULL) {
+  const int prefetch = param.roi_data_param().prefetch();
+  CHECK_GT(prefetch, 0) << "roi_data_param.prefetch must be positive";
+  // One more for the batch the tops share
+  prefetch_roi_.resize(prefetch + 1);
+  for (int i = 0; i < prefetch_roi_.size(); ++i) {
+    prefetch_roi_[i].reset(new BatchROI<Dtype>());
+    prefetch_roi_free_.push(prefetch_roi_[i].get());
   }
 }
 
+template <typename Dtype>
+BaseROIPrefetchingDataLayer<Dtype>::~BaseROIPrefetchingDataLayer() {
+  if (free_queue_handle_ >= 0) {
+    PipelineStats::UnregisterQueue(free_queue_handle_);
+    PipelineStats::UnregisterQueue(full_queue_handle_);
+  }
+}
 
 template <typename Dtype>
 void BaseROIPrefetchingDataLayer<Dtype>::LayerSetUp(
@@ -143,34 +174,50 @@ void BaseROIPrefetchingDataLayer<Dtype>::LayerSetUp(
   // cpu_data calls so that the prefetch thread does not accidentally make
   // simultaneous cudaMalloc calls when the main thread is running. In some
   // GPUs this seems to cause failures if we do not so.
-  for(int i = 0; i < PREFETCH_COUNT; i++)
+  for(int i = 0; i < prefetch_roi_.size(); i++)
   {
-      this->prefetch_roi_[i].data_.mutable_cpu_data();
+      this->prefetch_roi_[i]->data_.mutable_cpu_data();
       if(this->output_labels_)
-          this->prefetch_roi_[i].label_.mutable_cpu_data();
-      this->prefetch_roi_[i].rois_.mutable_cpu_data();
-      this->prefetch_roi_[i].bboxes_target_.mutable_cpu_data();
-      this->prefetch_roi_[i].bboxes_weight_.mutable_cpu_data();
+          this->prefetch_roi_[i]->label_.mutable_cpu_data();
+      this->prefetch_roi_[i]->rois_.mutable_cpu_data();
+      this->prefetch_roi_[i]->bboxes_target_.mutable_cpu_data();
+      this->prefetch_roi_[i]->bboxes_weight_.mutable_cpu_data();
   }
 
 #ifndef CPU_ONLY
   if(Caffe::mode() == Caffe::GPU)
   {
-        for(int i = 0; i < BaseROIPrefetchingDataLayer::PREFETCH_COUNT; i++)
+        for(int i = 0; i < prefetch_roi_.size(); i++)
   {
-      this->prefetch_roi_[i].data_.mutable_cpu_data();
+      this->prefetch_roi_[i]->data_.mutable_cpu_data();
       if(this->output_labels_)
-          this->prefetch_roi_[i].label_.mutable_cpu_data();
-      this->prefetch_roi_[i].rois_.mutable_cpu_data();
-      this->prefetch_roi_[i].bboxes_target_.mutable_cpu_data();
-      this->prefetch_roi_[i].bboxes_weight_.mutable_cpu_data();
+          this->prefetch_roi_[i]->label_.mutable_cpu_data();
+      this->prefetch_roi_[i]->rois_.mutable_cpu_data();
+      this->prefetch_roi_[i]->bboxes_target_.mutable_cpu_data();
+      this->prefetch_roi_[i]->bboxes_weight_.mutable_cpu_data();
   }
   }
 #endif
   
+  // More workers than slots would only wait for a free slot
+  const int num_workers = std::min<int>(
+      this->layer_param_.roi_data_param().num_workers(),
+      this->layer_param_.roi_data_param().prefetch());
+  CHECK_GT(num_workers, 0) << "roi_data_param.num_workers must be positive";
+  // Stalls of the free queue are workers waiting for Forward, stalls of the
+  // full queue Forward waiting for the workers
+  const string& name = this->layer_param_.name();
+  load_time_ = PipelineStats::Stage(name + "/load");
+  reorder_time_ = PipelineStats::Stage(name + "/reorder");
+  free_queue_handle_ = PipelineStats::RegisterQueue(name + "/free",
+      boost::bind(&BlockingQueue<BatchROI<Dtype>*>::stats,
+          &prefetch_roi_free_));
+  full_queue_handle_ = PipelineStats::RegisterQueue(name + "/full",
+      boost::bind(&BlockingQueue<BatchROI<Dtype>*>::stats,
+          &prefetch_roi_full_));
   DLOG(INFO) << "Initializing prefetch";
   this->data_transformer_->InitRand();
-  StartInternalThread();
+  StartInternalThread(num_workers);
   DLOG(INFO) << "Prefetch initialized.";
 }
 
@@ -183,17 +230,36 @@ void BaseROIPrefetchingDataLayer<Dtype>::InternalThreadEntry() {
   }
 #endif
 
+  Ordering& ordering = *ordering_;
   try {
     while (!must_stop()) {
       BatchROI<Dtype>* batch = prefetch_roi_free_.pop();
-      load_batch(batch);
+      {
+        boost::mutex::scoped_lock lock(ordering.mutex_);
+        batch->id_ = ordering.next_reserve_++;
+        reserve_batch(batch);
+      }
+      {
+        StageTimer timer(load_time_);
+        load_batch(batch);
+      }
 #ifndef CPU_ONLY
       if (Caffe::mode() == Caffe::GPU) {
         batch->data_.data().get()->async_gpu_push(stream);
         CUDA_CHECK(cudaStreamSynchronize(stream));
       }
 #endif
+      // Wait for the batches reserved earlier, so Forward sees them in order
+      boost::mutex::scoped_lock lock(ordering.mutex_);
+      if (ordering.next_push_ != batch->id_) {
+        StageTimer timer(reorder_time_);
+        while (ordering.next_push_ != batch->id_) {
+          ordering.pushed_.wait(lock);
+        }
+      }
       prefetch_roi_full_.push(batch);
+      ++ordering.next_push_;
+      ordering.pushed_.notify_all();
     }
   } catch (boost::thread_interrupted&) {
     // Interrupted exception is expected on shutdown
@@ -207,32 +273,52 @@ void BaseROIPrefetchingDataLayer<Dtype>::InternalThreadEntry() {
 
 
 template <typename Dtype>
-void BaseROIPrefetchingDataLayer<Dtype>::Forward_cpu(
-    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
-    BatchROI<Dtype>* batch = prefetch_roi_full_.pop("Data layer prefetch queue empty");
-    //Reshape to loaded data
-    top[0]->ReshapeLike(batch->data_);
-    caffe_copy(batch->data_.count(), batch->data_.cpu_data(), top[0]->mutable_cpu_data());
-    if(this->output_labels_)
-    {
-        top[2]->ReshapeLike(batch->label_);
-        caffe_copy(batch->label_.count(), batch->label_.cpu_data(), top[2]->mutable_cpu_data());
-    }
-    top[1]->ReshapeLike(batch->rois_);
-    caffe_copy(batch->rois_.count(), batch->rois_.cpu_data(), top[1]->mutable_cpu_data());
-    
-    top[3]->ReshapeLike(batch->bboxes_target_);
-    caffe_copy(batch->bboxes_target_.count(), batch->bboxes_target_.cpu_data(), top[3]->mutable_cpu_data());
-    
-    top[4]->ReshapeLike(batch->bboxes_weight_);
-    caffe_copy(batch->bboxes_weight_.count(), batch->bboxes_weight_.cpu_data(), top[4]->mutable_cpu_data());
-    
-    prefetch_roi_free_.push(batch);
-    DLOG(INFO) << "Prefetch copied";
-
+BatchROI<Dtype>* BaseROIPrefetchingDataLayer<Dtype>::NextBatch() {
+  BatchROI<Dtype>* batch =
+      prefetch_roi_full_.pop("Data layer prefetch queue empty");
+  const int interval = this->layer_param_.roi_data_param().stats_interval();
+  if (interval > 0 && ++num_forwarded_ % interval == 0) {
+    PipelineStats::Log();
+  }
+  return batch;
 }
 
+template <typename Dtype>
+void BaseROIPrefetchingDataLayer<Dtype>::ShareNextBatch(
+    const vector<Blob<Dtype>*>& top) {
+  // The previous batch is free to be overwritten as soon as it is pushed,
+  // but nothing reads the tops before they share the next one
+  if (forwarded_) {
+#ifndef CPU_ONLY
+    // The kernels of the previous backward may still be reading it, and
+    // the loader pushes it to the GPU on a stream of its own
+    if (Caffe::mode() == Caffe::GPU) {
+      CUDA_CHECK(cudaStreamSynchronize(cudaStreamDefault));
+    }
+#endif
+    prefetch_roi_free_.push(forwarded_);
+  }
+  BatchROI<Dtype>* batch = NextBatch();
+  top[0]->ReshapeLike(batch->data_);
+  top[0]->ShareData(batch->data_);
+  if (this->output_labels_) {
+    top[2]->ReshapeLike(batch->label_);
+    top[2]->ShareData(batch->label_);
+  }
+  top[1]->ReshapeLike(batch->rois_);
+  top[1]->ShareData(batch->rois_);
+  top[3]->ReshapeLike(batch->bboxes_target_);
+  top[3]->ShareData(batch->bboxes_target_);
+  top[4]->ReshapeLike(batch->bboxes_weight_);
+  top[4]->ShareData(batch->bboxes_weight_);
+  forwarded_ = batch;
+}
 
+template <typename Dtype>
+void BaseROIPrefetchingDataLayer<Dtype>::Forward_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  ShareNextBatch(top);
+}
 
 #ifdef CPU_ONLY
 STUB_GPU_FORWARD(BasePrefetchingDataLayer, Forward);
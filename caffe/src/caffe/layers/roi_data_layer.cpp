@@ -1,13 +1,17 @@
 #include "caffe/layers/roi_data_layer.hpp"
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 
+#include "caffe/util/image_preproc.hpp"
 #include "caffe/util/io.hpp"
+#include "caffe/util/pipeline_stats.hpp"
 #include "caffe/util/rng.hpp"
 #include <sys/stat.h>
 #include <time.h>
 #include "opencv2/opencv.hpp"
 #include "caffe/util/roi_data_extractor.hpp"
+#include "caffe/util/roidb_cache.hpp"
 #include "caffe/util/parse_config.hpp"
 #include <vector>
 #include <string>
@@ -62,13 +66,13 @@ namespace caffe
         top[2]->Reshape(train_cfg_.BATCH_SIZE, 1, 1, 1);
         top[3]->Reshape(train_cfg_.BATCH_SIZE, 4*num_classes, 1, 1);
         top[4]->Reshape(train_cfg_.BATCH_SIZE, 4*num_classes, 1, 1);
-        for(int i = 0; i < this->PREFETCH_COUNT; i ++)
+        for(int i = 0; i < this->prefetch_roi_.size(); i ++)
         {
-            this->prefetch_roi_[i].data_.Reshape(train_cfg_.IMS_PER_BATCH, channels, height, width);
-            this->prefetch_roi_[i].rois_.Reshape(train_cfg_.BATCH_SIZE, 5, 1, 1);
-            this->prefetch_roi_[i].label_.Reshape(train_cfg_.BATCH_SIZE, 1, 1, 1);
-            this->prefetch_roi_[i].bboxes_target_.Reshape(train_cfg_.BATCH_SIZE, 4*num_classes, 1, 1);
-            this->prefetch_roi_[i].bboxes_weight_.Reshape(train_cfg_.BATCH_SIZE, 4*num_classes, 1, 1);
+            this->prefetch_roi_[i]->data_.Reshape(train_cfg_.IMS_PER_BATCH, channels, height, width);
+            this->prefetch_roi_[i]->rois_.Reshape(train_cfg_.BATCH_SIZE, 5, 1, 1);
+            this->prefetch_roi_[i]->label_.Reshape(train_cfg_.BATCH_SIZE, 1, 1, 1);
+            this->prefetch_roi_[i]->bboxes_target_.Reshape(train_cfg_.BATCH_SIZE, 4*num_classes, 1, 1);
+            this->prefetch_roi_[i]->bboxes_weight_.Reshape(train_cfg_.BATCH_SIZE, 4*num_classes, 1, 1);
                    
         }
         DLOG(INFO) << "Input img size: " << top[0]->num() << ", " << top[0]->channels() << ", "
@@ -82,20 +86,41 @@ namespace caffe
         DLOG(INFO) << "Input target weight size: " << top[4]->num() << ", " << top[4]->channels() << ", "
                 << top[4]->height() << ", " << top[4]->width();
 
-        ROIDataExtractor roi_data_extractor(common_cfg_.DIR_IMGS,
-        		common_cfg_.IMGS_LIST,
-                common_cfg_.CLASSES_LIST,
-                common_cfg_.DIR_ANNOTATIONS,
-                common_cfg_.SS_MAT,
-                train_cfg_.USE_FLIPPED);
-        roi_data_extractor.roi_data_extract(roidb_);
-        num_roidb_ = roidb_.size();
+        ROIDBCache roidb_cache(common_cfg_, train_cfg_.USE_FLIPPED);
+        if(roidb_cache.load(roidb_))
+        {
+            // The solver reads the statistics back when snapshotting
+            ROIDataExtractor::write_bbox_mean_std(roidb_);
+        }
+        else
+        {
+            ROIDataExtractor roi_data_extractor(common_cfg_.DIR_IMGS,
+                    common_cfg_.IMGS_LIST,
+                    common_cfg_.CLASSES_LIST,
+                    common_cfg_.DIR_ANNOTATIONS,
+                    common_cfg_.SS_MAT,
+                    train_cfg_.USE_FLIPPED);
+            roi_data_extractor.roi_data_extract(roidb_);
+            roidb_cache.save(roidb_);
+        }
+        num_roidb_ = roidb_.num_images;
+        decode_time_ = PipelineStats::Stage(this->layer_param_.name() + "/decode");
+        preprocess_time_ = PipelineStats::Stage(this->layer_param_.name() + "/preprocess");
+        sample_time_ = PipelineStats::Stage(this->layer_param_.name() + "/sample_rois");
+        padding_ratio_ = PipelineStats::Ratio(this->layer_param_.name() + "/padding");
+        if (train_cfg_.ASPECT_GROUPING && train_cfg_.IMS_PER_BATCH > 1)
+        {
+            landscape_.resize(num_roidb_);
+            for (int i = 0; i < num_roidb_; i ++)
+                landscape_[i] = roidb_.sizes[2 * i] >= roidb_.sizes[2 * i + 1];
+        }
         cur_ind_ = 0;
         perm_.resize(num_roidb_);
         for(int i = 0; i < num_roidb_; i ++)
         	perm_[i] = i;
         const unsigned int rng_seed = caffe_rng_rand();
         rng_.reset(new Caffe::RNG(rng_seed));
+        rng_seed_ = caffe_rng_rand();
         ShuffleROIdbIndex();
     }
     
@@ -105,35 +130,45 @@ namespace caffe
     {
     	CHECK(rng_);
     	caffe::rng_t* random_generator = static_cast<caffe::rng_t*>(rng_->generator());
-    	shuffle(perm_.begin(), perm_.end(), random_generator);
     	cur_ind_ = 0;
+    	if (landscape_.empty())
+    	{
+    		shuffle(perm_.begin(), perm_.end(), random_generator);
+    		return;
+    	}
+    	//shuffle the landscape and the portrait images apart and cut them
+    	//into batches, so that only the batch across the two is mixed, then
+    	//shuffle the batches; the remainder of the epoch goes last
+    	vector<int> landscape, portrait;
+    	for(int i = 0; i < num_roidb_; i ++)
+    		(landscape_[i] ? landscape : portrait).push_back(i);
+    	shuffle(landscape.begin(), landscape.end(), random_generator);
+    	shuffle(portrait.begin(), portrait.end(), random_generator);
+    	vector<int> grouped(landscape);
+    	grouped.insert(grouped.end(), portrait.begin(), portrait.end());
+    	const int ims_per_batch = train_cfg_.IMS_PER_BATCH;
+    	vector<int> batches(num_roidb_ / ims_per_batch);
+    	for(int i = 0; i < batches.size(); i ++)
+    		batches[i] = i;
+    	shuffle(batches.begin(), batches.end(), random_generator);
+    	for(int i = 0; i < batches.size(); i ++)
+    		std::copy(grouped.begin() + batches[i] * ims_per_batch,
+    				grouped.begin() + (batches[i] + 1) * ims_per_batch,
+    				perm_.begin() + i * ims_per_batch);
+    	std::copy(grouped.begin() + batches.size() * ims_per_batch,
+    			grouped.end(), perm_.begin() + batches.size() * ims_per_batch);
     }
-    
+
     template<typename Dtype>
-    void ROIDataLayer<Dtype>::PrepImForBlob(const cv::Mat& im, cv::Mat& dst, int target_size, float& im_scale)
+    float ROIDataLayer<Dtype>::GetImageScale(int height, int width, int target_size)
     {
-    	int height = im.rows;
-    	int width = im.cols;
-
-    	im.convertTo(dst, CV_32FC3);
-    	for(int i = 0; i < height; i ++)
-    	{
-    		float *ptr = (float *)dst.row(i).data;
-    		for(int j = 0; j < width; j ++)
-    		{
-    			ptr[3*j] -= common_cfg_.PIXEL_MEANS[0];
-    			ptr[3*j+1] -= common_cfg_.PIXEL_MEANS[1];
-    			ptr[3*j+2] -= common_cfg_.PIXEL_MEANS[2];
-    		}
-    	}
     	int im_size_min = std::min(height, width);
     	int im_size_max = std::max(height, width);
         
-    	im_scale = float(target_size)/float(im_size_min);
+    	float im_scale = float(target_size)/float(im_size_min);
     	if (round(im_scale * im_size_max) > train_cfg_.MAX_SIZE)
     		im_scale = float(train_cfg_.MAX_SIZE) / float(im_size_max);
-    	cv::resize(dst, dst, cv::Size(round(im_scale*width), round(im_scale*height)));
-
+    	return im_scale;
     }
     
     
@@ -146,45 +181,44 @@ namespace caffe
     	CHECK(images_ind.size() == scales.size());
     	int num_images = images_ind.size();
         vector<cv::Mat> vec_ims(num_images);
+        vector<int> heights(num_images), widths(num_images);
         vec_im_scales.resize(num_images);
+        int max_height = 0;
+        int max_width = 0;
     	for(int i = 0; i < num_images; i ++)
     	{
     		int ind = images_ind[i];
-                if (ind >= img_name_list_.size())
-                    ind -= img_name_list_.size();
-    		cv::Mat img = ReadImageToCVMat(common_cfg_.DIR_IMGS + "/" + img_name_list_[ind] + ".jpg", true);
-    		if(roidb_[i].flipped == true)
-    			cv::flip(img, img, 1);
-    		int target_size = scales[i];
-    		PrepImForBlob(img, vec_ims[i], target_size, vec_im_scales[i]);
+    		{
+    			StageTimer timer(decode_time_);
+    			vec_ims[i] = ReadImageToCVMat(common_cfg_.DIR_IMGS + "/" + roidb_.images[ind] + ".jpg", true);
+    		}
+    		CHECK(vec_ims[i].data) << "Could not load " << roidb_.images[ind];
+    		CHECK_EQ(vec_ims[i].type(), CV_8UC3);
+    		float im_scale = GetImageScale(vec_ims[i].rows, vec_ims[i].cols, scales[i]);
+    		vec_im_scales[i] = im_scale;
+    		heights[i] = round(im_scale * vec_ims[i].rows);
+    		widths[i] = round(im_scale * vec_ims[i].cols);
+    		max_height = std::max(max_height, heights[i]);
+    		max_width = std::max(max_width, widths[i]);
     	}
-        int max_height = vec_ims[0].rows;
-        int max_width = vec_ims[0].cols;
-        for(int i = 1; i < num_images; i ++)
-        {
-            max_height = std::max(max_height, vec_ims[i].rows);
-            max_width = std::max(max_width, vec_ims[i].cols);
-        }
 
+        // Resize, flip, subtract the mean and pad straight into the blob
+        CHECK_EQ(common_cfg_.PIXEL_MEANS.size(), 3);
+        StageTimer timer(preprocess_time_);
         batch->data_.Reshape(num_images, 3, max_height, max_width);
-        int num_pixels_each_plane = batch->data_.count(2);
-
-
         for(int i = 0; i < num_images; i ++)
         {
-            cv::Mat mat_temp(max_height, max_width, CV_32FC3, cv::Scalar::all(0));
-            // ROI copy of cv::Mat failed in this manner
-            //mat_temp(cv::Range(0,max_height), cv::Range(0,max_width)) = vec_ims[i];
-            //cv::Rect(, , width, height))
-            vec_ims[i].copyTo(mat_temp(cv::Rect(0,0,vec_ims[i].cols,vec_ims[i].rows)));
-            vector<cv::Mat> vec_mat_temp;
-            cv::split(mat_temp, vec_mat_temp);
-            for(int c = 0; c < vec_mat_temp.size(); c ++)
-            {
-                int offset_cur = batch->data_.offset(i, c);
-                caffe_copy(num_pixels_each_plane, (Dtype*)vec_mat_temp[c].data, batch->data_.mutable_cpu_data()+offset_cur);
-            }
+            const cv::Mat& img = vec_ims[i];
+            caffe_cpu_prep_image(img.data, img.rows, img.cols, img.step,
+                    heights[i], widths[i], &common_cfg_.PIXEL_MEANS[0],
+                    roidb_.flipped[images_ind[i]], max_height, max_width,
+                    batch->data_.mutable_cpu_data() + batch->data_.offset(i));
         }
+        double image_pixels = 0;
+        for(int i = 0; i < num_images; i ++)
+            image_pixels += double(heights[i]) * widths[i];
+        const double blob_pixels = double(num_images) * max_height * max_width;
+        padding_ratio_->Add(blob_pixels - image_pixels, blob_pixels);
     }
     
     template<typename Dtype>
@@ -193,27 +227,35 @@ namespace caffe
             int fg_rois_per_image,
             int rois_per_image,
             int num_classes,
+            caffe::rng_t* rng,
             BatchROI<Dtype>* batch)
     {
     	int num_images = images_ind.size();
-    	Dtype *labels_array = new Dtype[rois_per_image * num_images];
-    	Dtype *boxes_array = new Dtype[5 * rois_per_image * num_images];
-    	Dtype *targets_array = new Dtype[4*num_classes*rois_per_image*num_images];
-    	Dtype *targets_loss_weight_array = new Dtype[4*num_classes*rois_per_image*num_images];
-        memset(labels_array, 0, rois_per_image * num_images * sizeof(Dtype));
-        memset(boxes_array, 0, 5 * rois_per_image * num_images * sizeof(Dtype));
-    	memset(targets_array, 0, 4*num_classes*rois_per_image*num_images * sizeof(Dtype));
-    	memset(targets_loss_weight_array, 0, 4*num_classes*rois_per_image*num_images * sizeof(Dtype));
+    	Dtype *labels_array = batch->label_.mutable_cpu_data();
+    	Dtype *boxes_array = batch->rois_.mutable_cpu_data();
+    	Dtype *targets_array = batch->bboxes_target_.mutable_cpu_data();
+    	Dtype *targets_loss_weight_array = batch->bboxes_weight_.mutable_cpu_data();
+    	caffe_set(rois_per_image * num_images, Dtype(0), labels_array);
+    	caffe_set(5 * rois_per_image * num_images, Dtype(0), boxes_array);
+    	caffe_set(4*num_classes*rois_per_image*num_images, Dtype(0), targets_array);
+    	caffe_set(4*num_classes*rois_per_image*num_images, Dtype(0), targets_loss_weight_array);
+    	vector<int> fg_inds, bg_inds;
     	for(int k = 0; k < num_images; k ++)
     	{
         	int ind = images_ind[k];
-            vector<vector<double> > *overlaps = &roidb_[ind].gt_overlaps;
-            vector<int> fg_inds, bg_inds;
-            for(int i = 0; i < (*overlaps).size(); i ++)
+            const int64_t begin = roidb_.image_begin(ind);
+            const int num_boxes = roidb_.image_size(ind);
+            const float *overlaps = roidb_.max_overlap + begin;
+            const float *boxes = roidb_.boxes + 4 * begin;
+            const int *labels = roidb_.label + begin;
+            const float *targets = roidb_.targets + 4 * begin;
+            fg_inds.clear();
+            bg_inds.clear();
+            for(int i = 0; i < num_boxes; i ++)
             {
-            	if ((*overlaps)[i][2] >= train_cfg_.FG_THRESH)
+            	if (overlaps[i] >= train_cfg_.FG_THRESH)
             		fg_inds.push_back(i);
-            	if ((*overlaps)[i][2] >= train_cfg_.BG_THRESH_LO && (*overlaps)[i][2] < train_cfg_.BG_THRESH_HI)
+            	if (overlaps[i] >= train_cfg_.BG_THRESH_LO && overlaps[i] < train_cfg_.BG_THRESH_HI)
             		bg_inds.push_back(i);
             }
 
@@ -226,26 +268,26 @@ namespace caffe
 
            
             //Sample foreground/background regions
-            CHECK(rng_);
-            caffe::rng_t* random_generator = static_cast<caffe::rng_t*>(rng_->generator());
             if (fg_inds.size() > 0)
-        	shuffle(fg_inds.begin(), fg_inds.end(), random_generator);
+        	shuffle(fg_inds.begin(), fg_inds.end(), rng);
             if (bg_inds.size() > 0)
-        	shuffle(bg_inds.begin(), bg_inds.end(), random_generator);
+        	shuffle(bg_inds.begin(), bg_inds.end(), rng);
             
         	for(int i = 0; i < fg_rois_per_this_image; i ++)
         	{
         		int ind_fg_roi_chosed = fg_inds[i];
-        		int ind_class = roidb_[ind].gt_overlaps[ind_fg_roi_chosed][1];
+        		int ind_class = labels[ind_fg_roi_chosed];
         		labels_array[k*rois_per_image+i] = ind_class;
         		boxes_array[5*k*rois_per_image+5*i] = k;
         		for(int j = 0; j < 4; j ++)
-        			boxes_array[5*(k*rois_per_image+i)+j+1] = roidb_[ind].boxes[ind_fg_roi_chosed][j] * random_scales[k];
+        			boxes_array[5*(k*rois_per_image+i)+j+1] = boxes[4*ind_fg_roi_chosed+j] * random_scales[k];
 
-        		for(int j = 4*ind_class, j_ = 0; j < 4*(ind_class+1), j_ < 4; j ++, j_ ++)
+        		Dtype *roi_targets = targets_array + 4*num_classes*(k*rois_per_image+i) + 4*ind_class;
+        		Dtype *roi_weights = targets_loss_weight_array + 4*num_classes*(k*rois_per_image+i) + 4*ind_class;
+        		for(int j = 0; j < 4; j ++)
         		{
-        			targets_array[4*num_classes*(k*rois_per_image+i) + j] = roidb_[ind].targets[ind_fg_roi_chosed][j_+1];
-        			targets_loss_weight_array[4*num_classes*(k*rois_per_image+i) + j] = (Dtype)1;
+        			roi_targets[j] = targets[4*ind_fg_roi_chosed+j];
+        			roi_weights[j] = (Dtype)1;
         		}
 
         	}
@@ -255,26 +297,16 @@ namespace caffe
         		labels_array[k*rois_per_image+i] = 0;
         		boxes_array[5*k*rois_per_image+5*i] = k;
         		for(int j = 0; j < 4; j ++)
-        			boxes_array[5*k*rois_per_image+5*i+j+1] = roidb_[ind].boxes[ind_bg_roi_chosed][j] * random_scales[k];
+        			boxes_array[5*k*rois_per_image+5*i+j+1] = boxes[4*ind_bg_roi_chosed+j] * random_scales[k];
         	}
     	}
-
-    	caffe_copy(rois_per_image * num_images, labels_array, batch->label_.mutable_cpu_data());
-    	caffe_copy(5 * rois_per_image * num_images, boxes_array, batch->rois_.mutable_cpu_data());
-    	caffe_copy(4*num_classes*rois_per_image*num_images, targets_array, batch->bboxes_target_.mutable_cpu_data());
-    	caffe_copy(4*num_classes*rois_per_image*num_images, targets_loss_weight_array, batch->bboxes_weight_.mutable_cpu_data());
-        
-    	delete [] labels_array;
-    	delete [] boxes_array;
-    	delete [] targets_array;
-    	delete [] targets_loss_weight_array;
     }
     
         template<typename Dtype>
     void ROIDataLayer<Dtype>::GetNextBatchIndex(vector<int>& next_batch_inds)
     {
     	next_batch_inds.clear();
-    	if (cur_ind_ + train_cfg_.IMS_PER_BATCH >= num_roidb_)
+    	if (cur_ind_ + train_cfg_.IMS_PER_BATCH > num_roidb_)
     		ShuffleROIdbIndex();
     	for(int i = 0; i < train_cfg_.IMS_PER_BATCH; i ++)
     		next_batch_inds.push_back(perm_[cur_ind_ + i]);
@@ -284,12 +316,11 @@ namespace caffe
 
     template<typename Dtype>
     void ROIDataLayer<Dtype>::GetNextBatch(const vector<int>& next_batch_inds,
+            caffe::rng_t* rng,
             BatchROI<Dtype>* batch)
     {
     	int num_scales = train_cfg_.SCALES.size();
     	int num_images = next_batch_inds.size();
-    	CHECK(rng_);
-    	caffe::rng_t *rng = static_cast<caffe::rng_t*>(rng_->generator());
     	//sample random scales to use for each image in this batch
     	vector<int> random_scales(num_images);
     	for(int i = 0; i < num_images; i ++)
@@ -301,9 +332,16 @@ namespace caffe
 
         std::vector<float> scale_ratios;
     	GetImageBlob(next_batch_inds, random_scales, scale_ratios, batch);
-    	SampleROIs(next_batch_inds, scale_ratios, fg_rois_per_image, rois_per_image, classes_list_.size(), batch);
+    	StageTimer timer(sample_time_);
+    	SampleROIs(next_batch_inds, scale_ratios, fg_rois_per_image, rois_per_image, classes_list_.size(), rng, batch);
     }
     
+    template<typename Dtype>
+    void ROIDataLayer<Dtype>::reserve_batch(BatchROI<Dtype>* batch)
+    {
+    	GetNextBatchIndex(batch->inds_);
+    }
+
     template<typename Dtype>
     void ROIDataLayer<Dtype>::load_batch(BatchROI<Dtype>* batch)
     {  
@@ -312,15 +350,10 @@ namespace caffe
         CHECK(batch->rois_.count());
         CHECK(batch->bboxes_target_.count());
         CHECK(batch->bboxes_weight_.count());
-    	vector<int> next_batch_inds;
-    	GetNextBatchIndex(next_batch_inds);
-    	GetNextBatch(next_batch_inds, batch);
+        Caffe::RNG batch_rng(rng_seed_ + static_cast<unsigned int>(batch->id_));
+    	GetNextBatch(batch->inds_, static_cast<caffe::rng_t*>(batch_rng.generator()), batch);
     }
 
-#ifdef CPU_ONLY
-STUB_GPU(ROIDataLayer);
-#endif
-
 INSTANTIATE_CLASS(ROIDataLayer);
 REGISTER_LAYER_CLASS(ROIData);
     
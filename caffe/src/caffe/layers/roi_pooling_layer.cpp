@@ -1,5 +1,15 @@
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include <boost/bind.hpp>
+#include <algorithm>
 #include <cfloat>
+#include <vector>
+
 #include "caffe/layers/roi_pooling_layer.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 using std::max;
 using std::min;
@@ -32,29 +42,154 @@ void ROIPoolingLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
       pooled_width_);
   max_idx_.Reshape(bottom[1]->num(), channels_, pooled_height_,
       pooled_width_);
+  bottom_nhwc_.Reshape(bottom[0]->num(), height_, width_, channels_);
+}
+
+// Max pools channels [0, channels) of the bin [hstart, hend) x
+// [wstart, wend) of an image whose pixels are stride values apart into
+// maxval[c] and maxidx[c], the index h * width + w of the first maximum in
+// row-major order; the bin is not empty.
+template <typename Dtype>
+static void max_pool_bin_channels(const Dtype* data, const int width,
+    const int stride, const int channels, const int hstart, const int hend,
+    const int wstart, const int wend, Dtype* maxval, int* maxidx) {
+  for (int c = 0; c < channels; ++c) {
+    maxval[c] = -FLT_MAX;
+    maxidx[c] = -1;
+  }
+  for (int h = hstart; h < hend; ++h) {
+    for (int w = wstart; w < wend; ++w) {
+      const int index = h * width + w;
+      const Dtype* pixel = data + index * stride;
+      for (int c = 0; c < channels; ++c) {
+        if (pixel[c] > maxval[c]) {
+          maxval[c] = pixel[c];
+          maxidx[c] = index;
+        }
+      }
+    }
+  }
+}
+
+// Max pools all the channels of a bin of an NHWC image. The channels of a
+// pixel are contiguous, so they are processed in SIMD-width blocks whose
+// running maximum stays in registers while the bin is walked.
+template <typename Dtype>
+static void max_pool_bin(const Dtype* data, const int width,
+    const int channels, const int hstart, const int hend, const int wstart,
+    const int wend, Dtype* maxval, int* maxidx) {
+  max_pool_bin_channels(data, width, channels, channels, hstart, hend,
+      wstart, wend, maxval, maxidx);
 }
 
+#if defined(__AVX__) || defined(__SSE2__)
+template <>
+void max_pool_bin<float>(const float* data, const int width,
+    const int channels, const int hstart, const int hend, const int wstart,
+    const int wend, float* maxval, int* maxidx) {
+  int c = 0;
+#ifdef __AVX__
+  for (; c + 8 <= channels; c += 8) {
+    __m256 vmax = _mm256_set1_ps(-FLT_MAX);
+    __m256 vidx = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+    for (int h = hstart; h < hend; ++h) {
+      for (int w = wstart; w < wend; ++w) {
+        const int index = h * width + w;
+        const __m256 v = _mm256_loadu_ps(data + index * channels + c);
+        const __m256 greater = _mm256_cmp_ps(v, vmax, _CMP_GT_OQ);
+        vmax = _mm256_blendv_ps(vmax, v, greater);
+        vidx = _mm256_blendv_ps(vidx,
+            _mm256_castsi256_ps(_mm256_set1_epi32(index)), greater);
+      }
+    }
+    _mm256_storeu_ps(maxval + c, vmax);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(maxidx + c),
+        _mm256_castps_si256(vidx));
+  }
+#else
+  for (; c + 4 <= channels; c += 4) {
+    __m128 vmax = _mm_set1_ps(-FLT_MAX);
+    __m128i vidx = _mm_set1_epi32(-1);
+    for (int h = hstart; h < hend; ++h) {
+      for (int w = wstart; w < wend; ++w) {
+        const int index = h * width + w;
+        const __m128 v = _mm_loadu_ps(data + index * channels + c);
+        const __m128i greater = _mm_castps_si128(_mm_cmpgt_ps(v, vmax));
+        vmax = _mm_or_ps(_mm_and_ps(_mm_castsi128_ps(greater), v),
+            _mm_andnot_ps(_mm_castsi128_ps(greater), vmax));
+        vidx = _mm_or_si128(_mm_and_si128(greater, _mm_set1_epi32(index)),
+            _mm_andnot_si128(greater, vidx));
+      }
+    }
+    _mm_storeu_ps(maxval + c, vmax);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(maxidx + c), vidx);
+  }
+#endif
+  max_pool_bin_channels(data + c, width, channels, channels - c, hstart,
+      hend, wstart, wend, maxval + c, maxidx + c);
+}
+#endif
+
 template <typename Dtype>
 void ROIPoolingLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
-  const Dtype* bottom_data = bottom[0]->cpu_data();
   const Dtype* bottom_rois = bottom[1]->cpu_data();
   // Number of ROIs
   int num_rois = bottom[1]->num();
   int batch_size = bottom[0]->num();
-  int top_count = top[0]->count();
   Dtype* top_data = top[0]->mutable_cpu_data();
-  caffe_set(top_count, Dtype(-FLT_MAX), top_data);
-  int* argmax_data = max_idx_.mutable_cpu_data();
-  caffe_set(top_count, -1, argmax_data);
+  // Testing seldom backpropagates, so it skips recording the argmax, which
+  // is as large as the output; Backward_cpu recomputes it if needed
+  argmax_skipped_ = this->phase_ != TRAIN;
+  int* argmax_data = argmax_skipped_ ? NULL : max_idx_.mutable_cpu_data();
+  // Every ROI reads all channels of its bins, so the feature map is first
+  // transposed to NHWC, where they are contiguous
+  caffe_parallel_for(batch_size * height_, boost::bind(
+      &ROIPoolingLayer<Dtype>::TransposeRows, this, bottom[0]->cpu_data(),
+      bottom_nhwc_.mutable_cpu_data(), _1, _2));
+  caffe_parallel_for(num_rois, boost::bind(
+      &ROIPoolingLayer<Dtype>::ForwardROIs, this, bottom_nhwc_.cpu_data(),
+      bottom_rois, batch_size, top_data, argmax_data, _1, _2));
+}
+
+template <typename Dtype>
+void ROIPoolingLayer<Dtype>::TransposeRows(const Dtype* bottom_data,
+      Dtype* bottom_nhwc, int row_begin, int row_end) {
+  const int spatial_dim = height_ * width_;
+  for (int row = row_begin; row < row_end; ++row) {
+    const int n = row / height_;
+    const int h = row % height_;
+    const Dtype* src = bottom_data + n * channels_ * spatial_dim + h * width_;
+    Dtype* dst = bottom_nhwc + row * width_ * channels_;
+    for (int c = 0; c < channels_; ++c) {
+      for (int w = 0; w < width_; ++w) {
+        dst[w * channels_ + c] = src[c * spatial_dim + w];
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void ROIPoolingLayer<Dtype>::ForwardROIs(const Dtype* bottom_nhwc,
+      const Dtype* bottom_rois, int batch_size, Dtype* top_data,
+      int* argmax_data, int roi_begin, int roi_end) {
+  const int bottom_dim = channels_ * height_ * width_;
+  const int top_dim = channels_ * pooled_height_ * pooled_width_;
+  const int pooled_dim = pooled_height_ * pooled_width_;
+  vector<int> hstart(pooled_height_), hend(pooled_height_);
+  vector<int> wstart(pooled_width_), wend(pooled_width_);
+  // The pooled ROI with the channels of a bin contiguous, [ph][pw][c]
+  vector<Dtype> maxval(pooled_dim * channels_);
+  vector<int> maxidx(pooled_dim * channels_);
 
   // For each ROI R = [batch_index x1 y1 x2 y2]: max pool over R
-  for (int n = 0; n < num_rois; ++n) {
-    int roi_batch_ind = bottom_rois[0];
-    int roi_start_w = round(bottom_rois[1] * spatial_scale_);
-    int roi_start_h = round(bottom_rois[2] * spatial_scale_);
-    int roi_end_w = round(bottom_rois[3] * spatial_scale_);
-    int roi_end_h = round(bottom_rois[4] * spatial_scale_);
+  for (int n = roi_begin; n < roi_end; ++n) {
+    const Dtype* roi = bottom_rois + n * 5;
+    int roi_batch_ind = roi[0];
+    int roi_start_w = round(roi[1] * spatial_scale_);
+    int roi_start_h = round(roi[2] * spatial_scale_);
+    int roi_end_w = round(roi[3] * spatial_scale_);
+    int roi_end_h = round(roi[4] * spatial_scale_);
     CHECK_GE(roi_batch_ind, 0);
     CHECK_LT(roi_batch_ind, batch_size);
 
@@ -65,63 +200,123 @@ void ROIPoolingLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const Dtype bin_size_w = static_cast<Dtype>(roi_width)
                              / static_cast<Dtype>(pooled_width_);
 
-    const Dtype* batch_data = bottom_data + bottom[0]->offset(roi_batch_ind);
+    // Compute the pooling regions of the ROI once for all channels:
+    //  start (included) = floor(ph * roi_height / pooled_height_)
+    //  end (excluded) = ceil((ph + 1) * roi_height / pooled_height_)
+    for (int ph = 0; ph < pooled_height_; ++ph) {
+      hstart[ph] = static_cast<int>(floor(static_cast<Dtype>(ph)
+                                          * bin_size_h));
+      hend[ph] = static_cast<int>(ceil(static_cast<Dtype>(ph + 1)
+                                       * bin_size_h));
+      hstart[ph] = min(max(hstart[ph] + roi_start_h, 0), height_);
+      hend[ph] = min(max(hend[ph] + roi_start_h, 0), height_);
+    }
+    for (int pw = 0; pw < pooled_width_; ++pw) {
+      wstart[pw] = static_cast<int>(floor(static_cast<Dtype>(pw)
+                                          * bin_size_w));
+      wend[pw] = static_cast<int>(ceil(static_cast<Dtype>(pw + 1)
+                                       * bin_size_w));
+      wstart[pw] = min(max(wstart[pw] + roi_start_w, 0), width_);
+      wend[pw] = min(max(wend[pw] + roi_start_w, 0), width_);
+    }
 
-    for (int c = 0; c < channels_; ++c) {
-      for (int ph = 0; ph < pooled_height_; ++ph) {
-        for (int pw = 0; pw < pooled_width_; ++pw) {
-          // Compute pooling region for this output unit:
-          //  start (included) = floor(ph * roi_height / pooled_height_)
-          //  end (excluded) = ceil((ph + 1) * roi_height / pooled_height_)
-          int hstart = static_cast<int>(floor(static_cast<Dtype>(ph)
-                                              * bin_size_h));
-          int wstart = static_cast<int>(floor(static_cast<Dtype>(pw)
-                                              * bin_size_w));
-          int hend = static_cast<int>(ceil(static_cast<Dtype>(ph + 1)
-                                           * bin_size_h));
-          int wend = static_cast<int>(ceil(static_cast<Dtype>(pw + 1)
-                                           * bin_size_w));
-
-          hstart = min(max(hstart + roi_start_h, 0), height_);
-          hend = min(max(hend + roi_start_h, 0), height_);
-          wstart = min(max(wstart + roi_start_w, 0), width_);
-          wend = min(max(wend + roi_start_w, 0), width_);
-
-          bool is_empty = (hend <= hstart) || (wend <= wstart);
-
-          const int pool_index = ph * pooled_width_ + pw;
-          if (is_empty) {
-            top_data[pool_index] = 0;
-            argmax_data[pool_index] = -1;
-          }
+    const Dtype* batch_data = bottom_nhwc + roi_batch_ind * bottom_dim;
+    Dtype* roi_top_data = top_data ? top_data + n * top_dim : NULL;
+    int* roi_argmax_data = argmax_data ? argmax_data + n * top_dim : NULL;
 
-          for (int h = hstart; h < hend; ++h) {
-            for (int w = wstart; w < wend; ++w) {
-              const int index = h * width_ + w;
-              if (batch_data[index] > top_data[pool_index]) {
-                top_data[pool_index] = batch_data[index];
-                argmax_data[pool_index] = index;
-              }
-            }
+    for (int ph = 0; ph < pooled_height_; ++ph) {
+      for (int pw = 0; pw < pooled_width_; ++pw) {
+        const int pool_index = ph * pooled_width_ + pw;
+        Dtype* bin_maxval = &maxval[pool_index * channels_];
+        int* bin_maxidx = &maxidx[pool_index * channels_];
+        if (hend[ph] <= hstart[ph] || wend[pw] <= wstart[pw]) {
+          // Define an empty pooling region to be zero; argmax = -1 causes
+          // nothing to be backprop'd
+          std::fill(bin_maxval, bin_maxval + channels_, Dtype(0));
+          std::fill(bin_maxidx, bin_maxidx + channels_, -1);
+        } else {
+          max_pool_bin(batch_data, width_, channels_, hstart[ph], hend[ph],
+              wstart[pw], wend[pw], bin_maxval, bin_maxidx);
+        }
+      }
+    }
+    // Transpose to [c][ph][pw] in blocks of channels, so that both the
+    // reads and the writes of a block stay within a few cache lines
+    const int kBlock = 16;
+    for (int c_begin = 0; c_begin < channels_; c_begin += kBlock) {
+      const int c_end = min(c_begin + kBlock, channels_);
+      for (int i = 0; i < pooled_dim; ++i) {
+        if (roi_top_data) {
+          for (int c = c_begin; c < c_end; ++c) {
+            roi_top_data[c * pooled_dim + i] = maxval[i * channels_ + c];
+          }
+        }
+        if (roi_argmax_data) {
+          for (int c = c_begin; c < c_end; ++c) {
+            roi_argmax_data[c * pooled_dim + i] = maxidx[i * channels_ + c];
           }
         }
       }
-      // Increment all data pointers by one channel
-      batch_data += bottom[0]->offset(0, 1);
-      top_data += top[0]->offset(0, 1);
-      argmax_data += max_idx_.offset(0, 1);
     }
-    // Increment ROI data pointer
-    bottom_rois += bottom[1]->offset(1);
   }
 }
 
 template <typename Dtype>
 void ROIPoolingLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
-  NOT_IMPLEMENTED;
+  if (!propagate_down[0]) {
+    return;
+  }
+  const Dtype* bottom_rois = bottom[1]->cpu_data();
+  if (argmax_skipped_) {
+    // Pool again for the argmax alone, leaving the top untouched
+    caffe_parallel_for(bottom[0]->num() * height_, boost::bind(
+        &ROIPoolingLayer<Dtype>::TransposeRows, this, bottom[0]->cpu_data(),
+        bottom_nhwc_.mutable_cpu_data(), _1, _2));
+    caffe_parallel_for(top[0]->num(), boost::bind(
+        &ROIPoolingLayer<Dtype>::ForwardROIs, this, bottom_nhwc_.cpu_data(),
+        bottom_rois, bottom[0]->num(), static_cast<Dtype*>(NULL),
+        max_idx_.mutable_cpu_data(), _1, _2));
+    argmax_skipped_ = false;
+  }
+  const Dtype* top_diff = top[0]->cpu_diff();
+  Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
+  // Every ROI of a given channel scatters into the same bottom plane, so the
+  // work is split by channel rather than by ROI to avoid write conflicts.
+  caffe_parallel_for(channels_, boost::bind(
+      &ROIPoolingLayer<Dtype>::BackwardChannels, this, top_diff, bottom_rois,
+      top[0]->num(), bottom[0]->num(), bottom_diff, _1, _2));
 }
 
+template <typename Dtype>
+void ROIPoolingLayer<Dtype>::BackwardChannels(const Dtype* top_diff,
+      const Dtype* bottom_rois, int num_rois, int batch_size,
+      Dtype* bottom_diff, int c_begin, int c_end) {
+  const int spatial_dim = height_ * width_;
+  const int pooled_dim = pooled_height_ * pooled_width_;
+  const int* argmax_data = max_idx_.cpu_data();
+
+  for (int n = 0; n < batch_size; ++n) {
+    caffe_set((c_end - c_begin) * spatial_dim, Dtype(0),
+        bottom_diff + (n * channels_ + c_begin) * spatial_dim);
+  }
+  for (int n = 0; n < num_rois; ++n) {
+    int roi_batch_ind = bottom_rois[n * 5];
+    Dtype* batch_diff = bottom_diff + roi_batch_ind * channels_ * spatial_dim;
+    for (int c = c_begin; c < c_end; ++c) {
+      const int offset = (n * channels_ + c) * pooled_dim;
+      const Dtype* offset_top_diff = top_diff + offset;
+      const int* offset_argmax_data = argmax_data + offset;
+      Dtype* offset_bottom_diff = batch_diff + c * spatial_dim;
+      for (int i = 0; i < pooled_dim; ++i) {
+        const int bottom_index = offset_argmax_data[i];
+        if (bottom_index >= 0) {
+          offset_bottom_diff[bottom_index] += offset_top_diff[i];
+        }
+      }
+    }
+  }
+}
 
 #ifdef CPU_ONLY
 STUB_GPU(ROIPoolingLayer);
@@ -1,10 +1,18 @@
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include <cmath>
+
 #include "caffe/layers/smooth_L1_loss_layer.hpp"
+#include "caffe/util/math_functions.hpp"
 
 namespace caffe {
 
 template <typename Dtype>
 void SmoothL1LossLayer<Dtype>::LayerSetUp(
   const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  LossLayer<Dtype>::LayerSetUp(bottom, top);
   has_weights_ = (bottom.size() == 3);
 }
 
@@ -26,16 +34,130 @@ void SmoothL1LossLayer<Dtype>::Reshape(
       bottom[0]->height(), bottom[0]->width());
 }
 
+// Fused smooth L1 kernel: for d = w * (a - b) (w = 1 if absent) returns
+// sum f(d) and stores f'(d) in grad, where
+//   f(x)  = 0.5 * x^2    if |x| < 1       f'(x) = x         if |x| < 1
+//         = |x| - 0.5    otherwise              = sign(x)   otherwise
+template <typename Dtype>
+static Dtype smooth_l1_fused(const int n, const Dtype* a, const Dtype* b,
+    const Dtype* w, Dtype* grad) {
+  Dtype loss = 0;
+  for (int i = 0; i < n; ++i) {
+    Dtype val = a[i] - b[i];
+    if (w) {
+      val *= w[i];
+    }
+    Dtype abs_val = std::abs(val);
+    if (abs_val < 1) {
+      loss += 0.5 * val * val;
+      grad[i] = val;
+    } else {
+      loss += abs_val - 0.5;
+      grad[i] = (Dtype(0) < val) - (val < Dtype(0));
+    }
+  }
+  return loss;
+}
+
+#if defined(__AVX__) || defined(__SSE2__)
+template <>
+float smooth_l1_fused<float>(const int n, const float* a, const float* b,
+    const float* w, float* grad) {
+  int i = 0;
+#ifdef __AVX__
+  const __m256 sign_mask = _mm256_set1_ps(-0.f);
+  const __m256 one = _mm256_set1_ps(1.f);
+  const __m256 half = _mm256_set1_ps(0.5f);
+  __m256 acc = _mm256_setzero_ps();
+  for (; i + 8 <= n; i += 8) {
+    __m256 val = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+    if (w) {
+      val = _mm256_mul_ps(val, _mm256_loadu_ps(w + i));
+    }
+    const __m256 abs_val = _mm256_andnot_ps(sign_mask, val);
+    const __m256 small = _mm256_cmp_ps(abs_val, one, _CMP_LT_OQ);
+    const __m256 quad = _mm256_mul_ps(half, _mm256_mul_ps(val, val));
+    const __m256 lin = _mm256_sub_ps(abs_val, half);
+    const __m256 sign = _mm256_or_ps(_mm256_and_ps(val, sign_mask), one);
+    acc = _mm256_add_ps(acc, _mm256_blendv_ps(lin, quad, small));
+    _mm256_storeu_ps(grad + i, _mm256_blendv_ps(sign, val, small));
+  }
+  float lanes[8];
+  _mm256_storeu_ps(lanes, acc);
+  float loss = lanes[0] + lanes[1] + lanes[2] + lanes[3] +
+      lanes[4] + lanes[5] + lanes[6] + lanes[7];
+#else
+  const __m128 sign_mask = _mm_set1_ps(-0.f);
+  const __m128 one = _mm_set1_ps(1.f);
+  const __m128 half = _mm_set1_ps(0.5f);
+  __m128 acc = _mm_setzero_ps();
+  for (; i + 4 <= n; i += 4) {
+    __m128 val = _mm_sub_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i));
+    if (w) {
+      val = _mm_mul_ps(val, _mm_loadu_ps(w + i));
+    }
+    const __m128 abs_val = _mm_andnot_ps(sign_mask, val);
+    const __m128 small = _mm_cmplt_ps(abs_val, one);
+    const __m128 quad = _mm_mul_ps(half, _mm_mul_ps(val, val));
+    const __m128 lin = _mm_sub_ps(abs_val, half);
+    const __m128 sign = _mm_or_ps(_mm_and_ps(val, sign_mask), one);
+    acc = _mm_add_ps(acc, _mm_or_ps(_mm_and_ps(small, quad),
+        _mm_andnot_ps(small, lin)));
+    _mm_storeu_ps(grad + i, _mm_or_ps(_mm_and_ps(small, val),
+        _mm_andnot_ps(small, sign)));
+  }
+  float lanes[4];
+  _mm_storeu_ps(lanes, acc);
+  float loss = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#endif
+  for (; i < n; ++i) {
+    float val = a[i] - b[i];
+    if (w) {
+      val *= w[i];
+    }
+    float abs_val = std::abs(val);
+    if (abs_val < 1) {
+      loss += 0.5f * val * val;
+      grad[i] = val;
+    } else {
+      loss += abs_val - 0.5f;
+      grad[i] = (0.f < val) - (val < 0.f);
+    }
+  }
+  return loss;
+}
+#endif
+
 template <typename Dtype>
 void SmoothL1LossLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
-  NOT_IMPLEMENTED;
+  int count = bottom[0]->count();
+  // Unlike the GPU path, diff_ holds the gradient f'(d) right after the
+  // forward pass, so Backward_cpu only has to scale it.
+  Dtype loss = smooth_l1_fused(
+      count,
+      bottom[0]->cpu_data(),
+      bottom[1]->cpu_data(),
+      has_weights_ ? bottom[2]->cpu_data() : NULL,
+      diff_.mutable_cpu_data());
+  top[0]->mutable_cpu_data()[0] = loss / bottom[0]->num();
 }
 
 template <typename Dtype>
 void SmoothL1LossLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
-  NOT_IMPLEMENTED;
+  for (int i = 0; i < 2; ++i) {
+    if (propagate_down[i]) {
+      const Dtype sign = (i == 0) ? 1 : -1;
+      const Dtype alpha = sign * top[0]->cpu_diff()[0] / bottom[i]->num();
+      caffe_cpu_axpby(
+          bottom[i]->count(),              // count
+          alpha,                           // alpha
+          diff_.cpu_data(),                // x
+          Dtype(0),                        // beta
+          bottom[i]->mutable_cpu_diff());  // y
+    }
+  }
 }
 
 #ifdef CPU_ONLY
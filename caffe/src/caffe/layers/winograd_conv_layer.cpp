@@ -0,0 +1,358 @@
+#include <boost/bind.hpp>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "caffe/layers/winograd_conv_layer.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
+
+namespace caffe {
+
+namespace {
+
+// G of F(2 x 2, 3 x 3) and F(4 x 4, 3 x 3)
+const double kG2[4 * 3] = {
+  1,    0,   0,
+  0.5,  0.5, 0.5,
+  0.5, -0.5, 0.5,
+  0,    0,   1
+};
+const double kG4[6 * 3] = {
+  1. / 4,   0,        0,
+  -1. / 6,  -1. / 6,  -1. / 6,
+  -1. / 6,  1. / 6,   -1. / 6,
+  1. / 24,  1. / 12,  1. / 6,
+  1. / 24,  -1. / 12, 1. / 6,
+  0,        0,        1
+};
+
+// u = G g G^T of a 3 x 3 filter g and an [alpha][3] G
+template <typename Dtype>
+void transform_filter(const double* G, int alpha, const Dtype* g, Dtype* u) {
+  double t[6 * 3];
+  for (int i = 0; i < alpha; ++i) {
+    for (int j = 0; j < 3; ++j) {
+      t[i * 3 + j] = G[i * 3] * g[j] + G[i * 3 + 1] * g[3 + j] +
+          G[i * 3 + 2] * g[6 + j];
+    }
+  }
+  for (int i = 0; i < alpha; ++i) {
+    for (int j = 0; j < alpha; ++j) {
+      u[i * alpha + j] = t[i * 3] * G[j * 3] + t[i * 3 + 1] * G[j * 3 + 1] +
+          t[i * 3 + 2] * G[j * 3 + 2];
+    }
+  }
+}
+
+// y = B^T x of the (m + 2) x[i * xs], into y[i * ys]
+template <int M, typename Dtype>
+inline void input_1d(const Dtype* x, int xs, Dtype* y, int ys) {
+  if (M == 2) {
+    y[0] = x[0] - x[2 * xs];
+    y[ys] = x[xs] + x[2 * xs];
+    y[2 * ys] = x[2 * xs] - x[xs];
+    y[3 * ys] = x[xs] - x[3 * xs];
+  } else {
+    const Dtype x1 = x[xs], x2 = x[2 * xs], x3 = x[3 * xs], x4 = x[4 * xs];
+    y[0] = 4 * x[0] - 5 * x2 + x4;
+    y[ys] = x3 + x4 - 4 * (x1 + x2);
+    y[2 * ys] = x4 - x3 + 4 * (x1 - x2);
+    y[3 * ys] = x4 - x2 + 2 * (x3 - x1);
+    y[4 * ys] = x4 - x2 + 2 * (x1 - x3);
+    y[5 * ys] = 4 * x1 - 5 * x3 + x[5 * xs];
+  }
+}
+
+// y = A^T x of the (m + 2) x[i * xs], into the m y[i * ys]
+template <int M, typename Dtype>
+inline void output_1d(const Dtype* x, int xs, Dtype* y, int ys) {
+  if (M == 2) {
+    y[0] = x[0] + x[xs] + x[2 * xs];
+    y[ys] = x[xs] - x[2 * xs] - x[3 * xs];
+  } else {
+    const Dtype a = x[xs] + x[2 * xs], b = x[xs] - x[2 * xs];
+    const Dtype c = x[3 * xs] + x[4 * xs], d = x[3 * xs] - x[4 * xs];
+    y[0] = x[0] + a + c;
+    y[ys] = b + 2 * d;
+    y[2 * ys] = a + 4 * c;
+    y[3 * ys] = b + 8 * d + x[5 * xs];
+  }
+}
+
+// v = B^T d B of an [m + 2][m + 2] input tile d
+template <int M, typename Dtype>
+void transform_input(const Dtype* d, Dtype* v) {
+  const int alpha = M + 2;
+  Dtype t[6 * 6];
+  for (int j = 0; j < alpha; ++j) {
+    input_1d<M>(d + j, alpha, t + j, alpha);
+  }
+  for (int i = 0; i < alpha; ++i) {
+    input_1d<M>(t + i * alpha, 1, v + i * alpha, 1);
+  }
+}
+
+// y = A^T x A of the [m + 2][m + 2] products x of an [m][m] output tile
+template <int M, typename Dtype>
+void transform_output(const Dtype* x, Dtype* y) {
+  const int alpha = M + 2;
+  Dtype t[4 * 6];
+  for (int j = 0; j < alpha; ++j) {
+    output_1d<M>(x + j, alpha, t + j, alpha);
+  }
+  for (int i = 0; i < M; ++i) {
+    output_1d<M>(t + i * alpha, 1, y + i * M, 1);
+  }
+}
+
+}  // namespace
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::LayerSetUp(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  ConvolutionLayer<Dtype>::LayerSetUp(bottom, top);
+  CHECK(this->num_spatial_axes_ == 2 && !this->force_nd_im2col_)
+      << "The WINOGRAD engine only implements 2D convolution.";
+  for (int i = 0; i < 2; ++i) {
+    CHECK_EQ(this->kernel_shape_.cpu_data()[i], 3)
+        << "The WINOGRAD engine only implements 3x3 filters.";
+    CHECK_EQ(this->stride_.cpu_data()[i], 1)
+        << "The WINOGRAD engine only implements stride 1.";
+    CHECK_EQ(this->dilation_.cpu_data()[i], 1)
+        << "The WINOGRAD engine only implements dilation 1.";
+    CHECK_LE(this->pad_.cpu_data()[i], 2)
+        << "The WINOGRAD engine only implements pad <= 2.";
+  }
+  CHECK_EQ(this->group_, 1) << "The WINOGRAD engine does not implement groups.";
+  tile_ = this->layer_param_.convolution_param().winograd_tile();
+  CHECK(tile_ == 2 || tile_ == 4) << "winograd_tile must be 2 or 4.";
+  alpha_ = tile_ + 2;
+  transformed_ = false;
+}
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::update_transformed_weights() {
+  const Blob<Dtype>& weights = *this->blobs_[0];
+  if (transformed_ && weights_copy_.count() == weights.count() &&
+      memcmp(weights_copy_.cpu_data(), weights.cpu_data(),
+          weights.count() * sizeof(Dtype)) == 0) {
+    return;
+  }
+  weights_copy_.ReshapeLike(weights);
+  caffe_copy(weights.count(), weights.cpu_data(),
+      weights_copy_.mutable_cpu_data());
+  vector<int> shape(3, alpha_ * alpha_);
+  shape[1] = this->num_output_;
+  shape[2] = this->channels_;
+  forward_weights_.Reshape(shape);
+  shape[1] = this->channels_;
+  shape[2] = this->num_output_;
+  backward_weights_.Reshape(shape);
+  caffe_parallel_for(this->num_output_, boost::bind(
+      &WinogradConvolutionLayer<Dtype>::transform_weights_cpu, this,
+      weights_copy_.cpu_data(), forward_weights_.mutable_cpu_data(),
+      backward_weights_.mutable_cpu_data(), _1, _2));
+  transformed_ = true;
+}
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::transform_weights_cpu(
+    const Dtype* weights, Dtype* forward, Dtype* backward, int begin,
+    int end) {
+  const int channels = this->channels_;
+  const int num_output = this->num_output_;
+  const double* G = tile_ == 2 ? kG2 : kG4;
+  Dtype rotated[9];
+  Dtype u[6 * 6];
+  for (int k = begin; k < end; ++k) {
+    for (int c = 0; c < channels; ++c) {
+      const Dtype* g = weights + (k * channels + c) * 9;
+      transform_filter(G, alpha_, g, u);
+      for (int xi = 0; xi < alpha_ * alpha_; ++xi) {
+        forward[(xi * num_output + k) * channels + c] = u[xi];
+      }
+      for (int i = 0; i < 9; ++i) {
+        rotated[i] = g[8 - i];
+      }
+      transform_filter(G, alpha_, rotated, u);
+      for (int xi = 0; xi < alpha_ * alpha_; ++xi) {
+        backward[(xi * channels + c) * num_output + k] = u[xi];
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::convolve_cpu(Problem* problem) {
+  Problem& p = *problem;
+  p.height_out = p.height + 2 * p.pad_h - 2;
+  p.width_out = p.width + 2 * p.pad_w - 2;
+  p.tiles_w = (p.width_out + tile_ - 1) / tile_;
+  p.tiles_per_image = (p.height_out + tile_ - 1) / tile_ * p.tiles_w;
+  // Blocks whose transformed tiles and products fit in the cache, but wide
+  // enough for the matrix products and enough of them for all the threads
+  const int num_threads = caffe_get_num_threads();
+  const int positions = alpha_ * alpha_;
+  const int tile_bytes = positions * (p.channels + p.out_channels) *
+      sizeof(Dtype);
+  const int balanced = (this->num_ * p.tiles_per_image + 4 * num_threads - 1)
+      / (4 * num_threads);
+  p.tiles_per_block = std::max(1, std::min(std::min(balanced,
+      p.tiles_per_image), std::max(16, kBlockBytes / tile_bytes)));
+  p.blocks_per_image = (p.tiles_per_image + p.tiles_per_block - 1) /
+      p.tiles_per_block;
+
+  if (num_slots_ != num_threads) {
+    int slot;
+    while (free_slots_.try_pop(&slot)) {}
+    for (slot = 0; slot < num_threads; ++slot) {
+      free_slots_.push(slot);
+    }
+    num_slots_ = num_threads;
+  }
+  vector<int> shape(2, num_slots_);
+  shape[1] = positions * (p.channels + p.out_channels) * p.tiles_per_block;
+  thread_buffer_.Reshape(shape);
+  thread_data_ = thread_buffer_.mutable_cpu_data();
+  caffe_parallel_for(this->num_ * p.blocks_per_image, boost::bind(
+      &WinogradConvolutionLayer<Dtype>::convolve_blocks_cpu, this, problem,
+      _1, _2));
+}
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::convolve_blocks_cpu(
+    const Problem* problem, int begin, int end) {
+  const Problem& p = *problem;
+  const int slot = free_slots_.pop();
+  const int positions = alpha_ * alpha_;
+  const int channels = p.channels;
+  const int out_channels = p.out_channels;
+  // [positions][channels][tiles] transformed input tiles and
+  // [positions][out_channels][tiles] products
+  Dtype* V = thread_data_ + slot * positions * (channels + out_channels) *
+      p.tiles_per_block;
+  Dtype* M = V + positions * channels * p.tiles_per_block;
+  Dtype d[6 * 6];
+  Dtype v[6 * 6];
+  Dtype y[4 * 4];
+  for (int task = begin; task < end; ++task) {
+    const int n = task / p.blocks_per_image;
+    const int first = task % p.blocks_per_image * p.tiles_per_block;
+    const int tiles = std::min(p.tiles_per_block, p.tiles_per_image - first);
+    const Dtype* input = p.input + n * channels * p.height * p.width;
+    for (int c = 0; c < channels; ++c) {
+      const Dtype* plane = input + c * p.height * p.width;
+      for (int t = 0; t < tiles; ++t) {
+        const int y0 = (first + t) / p.tiles_w * tile_ - p.pad_h;
+        const int x0 = (first + t) % p.tiles_w * tile_ - p.pad_w;
+        if (y0 >= 0 && x0 >= 0 && y0 + alpha_ <= p.height &&
+            x0 + alpha_ <= p.width) {
+          for (int i = 0; i < alpha_; ++i) {
+            for (int j = 0; j < alpha_; ++j) {
+              d[i * alpha_ + j] = plane[(y0 + i) * p.width + x0 + j];
+            }
+          }
+        } else {
+          for (int i = 0; i < alpha_; ++i) {
+            const int h = y0 + i;
+            for (int j = 0; j < alpha_; ++j) {
+              const int w = x0 + j;
+              d[i * alpha_ + j] = h >= 0 && h < p.height && w >= 0 &&
+                  w < p.width ? plane[h * p.width + w] : 0;
+            }
+          }
+        }
+        if (tile_ == 2) {
+          transform_input<2>(d, v);
+        } else {
+          transform_input<4>(d, v);
+        }
+        for (int xi = 0; xi < positions; ++xi) {
+          V[(xi * channels + c) * tiles + t] = v[xi];
+        }
+      }
+    }
+    for (int xi = 0; xi < positions; ++xi) {
+      caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, out_channels, tiles,
+          channels, (Dtype)1., p.transformed + xi * out_channels * channels,
+          V + xi * channels * tiles, (Dtype)0., M + xi * out_channels * tiles);
+    }
+    Dtype* output = p.output + n * out_channels * p.height_out * p.width_out;
+    for (int k = 0; k < out_channels; ++k) {
+      const Dtype bias = p.bias ? p.bias[k] : 0;
+      Dtype* plane = output + k * p.height_out * p.width_out;
+      for (int t = 0; t < tiles; ++t) {
+        for (int xi = 0; xi < positions; ++xi) {
+          d[xi] = M[(xi * out_channels + k) * tiles + t];
+        }
+        if (tile_ == 2) {
+          transform_output<2>(d, y);
+        } else {
+          transform_output<4>(d, y);
+        }
+        const int y0 = (first + t) / p.tiles_w * tile_;
+        const int x0 = (first + t) % p.tiles_w * tile_;
+        const int rows = std::min(tile_, p.height_out - y0);
+        const int cols = std::min(tile_, p.width_out - x0);
+        for (int i = 0; i < rows; ++i) {
+          for (int j = 0; j < cols; ++j) {
+            plane[(y0 + i) * p.width_out + x0 + j] = y[i * tile_ + j] + bias;
+          }
+        }
+      }
+    }
+  }
+  free_slots_.push(slot);
+}
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::Forward_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  update_transformed_weights();
+  for (int i = 0; i < bottom.size(); ++i) {
+    Problem p;
+    p.input = bottom[i]->cpu_data();
+    p.channels = this->channels_;
+    p.height = this->input_shape(1);
+    p.width = this->input_shape(2);
+    p.pad_h = this->pad_.cpu_data()[0];
+    p.pad_w = this->pad_.cpu_data()[1];
+    p.transformed = forward_weights_.cpu_data();
+    p.out_channels = this->num_output_;
+    p.bias = this->bias_term_ ? this->blobs_[1]->cpu_data() : NULL;
+    p.output = top[i]->mutable_cpu_data();
+    convolve_cpu(&p);
+  }
+}
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::Backward_cpu(
+    const vector<Blob<Dtype>*>& top, const vector<bool>& propagate_down,
+    const vector<Blob<Dtype>*>& bottom) {
+  // The bias and weight gradients
+  ConvolutionLayer<Dtype>::Backward_cpu(top,
+      vector<bool>(propagate_down.size(), false), bottom);
+  for (int i = 0; i < top.size(); ++i) {
+    if (!propagate_down[i]) {
+      continue;
+    }
+    update_transformed_weights();
+    Problem p;
+    p.input = top[i]->cpu_diff();
+    p.channels = this->num_output_;
+    p.height = this->output_shape_[0];
+    p.width = this->output_shape_[1];
+    p.pad_h = 2 - this->pad_.cpu_data()[0];
+    p.pad_w = 2 - this->pad_.cpu_data()[1];
+    p.transformed = backward_weights_.cpu_data();
+    p.out_channels = this->channels_;
+    p.bias = NULL;
+    p.output = bottom[i]->mutable_cpu_diff();
+    convolve_cpu(&p);
+  }
+}
+
+INSTANTIATE_CLASS(WinogradConvolutionLayer);
+
+}  // namespace caffe
@@ -1,4 +1,5 @@
 #include <algorithm>
+#include <cstring>
 #include <map>
 #include <set>
 #include <string>
@@ -278,11 +279,169 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
   for (size_t layer_id = 0; layer_id < layer_names_.size(); ++layer_id) {
     layer_names_index_[layer_names_[layer_id]] = layer_id;
   }
+  if (phase_ == TEST) {
+    PlanMemory(param.plan_memory());
+  }
   ShareWeights();
   debug_info_ = param.debug_info();
   LOG_IF(INFO, Caffe::root_solver()) << "Network initialization done.";
 }
 
+template <typename Dtype>
+void Net<Dtype>::PlanMemory(bool apply) {
+  const int num_layers = layers_.size();
+  const int num_blobs = blobs_.size();
+  // The layers that produce and last read each blob. The tops that share
+  // the memory of a bottom, in Split layers or as set up by Reshape or
+  // Flatten layers, take their source's memory instead of their own, and
+  // keep it alive while they are.
+  vector<int> first(num_blobs, -1), last(num_blobs, -1), source(num_blobs);
+  for (int blob_id = 0; blob_id < num_blobs; ++blob_id) {
+    source[blob_id] = blob_id;
+  }
+  for (int layer_id = 0; layer_id < num_layers; ++layer_id) {
+    const vector<int>& bottom_ids = bottom_id_vecs_[layer_id];
+    const bool split = strcmp(layers_[layer_id]->type(), "Split") == 0;
+    for (int bottom_id = 0; bottom_id < bottom_ids.size(); ++bottom_id) {
+      last[bottom_ids[bottom_id]] = layer_id;
+    }
+    for (int top_id = 0; top_id < top_id_vecs_[layer_id].size(); ++top_id) {
+      const int blob_id = top_id_vecs_[layer_id][top_id];
+      if (first[blob_id] < 0) {
+        first[blob_id] = layer_id;
+      }
+      last[blob_id] = layer_id;
+      const Blob<Dtype>* top = top_vecs_[layer_id][top_id];
+      for (int bottom_id = 0; bottom_id < bottom_ids.size(); ++bottom_id) {
+        const Blob<Dtype>* bottom = bottom_vecs_[layer_id][bottom_id];
+        if (bottom_ids[bottom_id] != blob_id && (split ||
+            (top->count() && bottom->count() &&
+             top->data() == bottom->data()))) {
+          source[blob_id] = source[bottom_ids[bottom_id]];
+        }
+      }
+    }
+  }
+  for (int i = 0; i < net_output_blob_indices_.size(); ++i) {
+    last[net_output_blob_indices_[i]] = num_layers;
+  }
+  for (int blob_id = 0; blob_id < num_blobs; ++blob_id) {
+    last[source[blob_id]] = std::max(last[source[blob_id]], last[blob_id]);
+  }
+
+  // Going through the layers, give each top it produces the smallest free
+  // buffer that fits it, or else the largest, which grows, before freeing
+  // the buffers of the blobs the layer reads last. Blobs that are not
+  // produced from bottoms, like inputs and data, keep their own memory.
+  vector<vector<int> > dying(num_layers + 1);
+  for (int blob_id = 0; blob_id < num_blobs; ++blob_id) {
+    if (source[blob_id] == blob_id && first[blob_id] >= 0) {
+      dying[last[blob_id]].push_back(blob_id);
+    }
+  }
+  blob_buffer_ids_.assign(num_blobs, -1);
+  layer_planned_blob_ids_.assign(num_layers, vector<int>());
+  vector<size_t> buffer_sizes;
+  vector<bool> buffer_free;
+  for (int layer_id = 0; layer_id < num_layers; ++layer_id) {
+    for (int top_id = 0; top_id < top_id_vecs_[layer_id].size(); ++top_id) {
+      const int blob_id = top_id_vecs_[layer_id][top_id];
+      if (first[blob_id] != layer_id || source[blob_id] != blob_id ||
+          last[blob_id] == num_layers || bottom_id_vecs_[layer_id].empty()) {
+        continue;
+      }
+      const size_t size = blobs_[blob_id]->count() * sizeof(Dtype);
+      int best = -1;
+      for (int i = 0; i < buffer_sizes.size(); ++i) {
+        if (!buffer_free[i]) {
+          continue;
+        }
+        const bool fits = buffer_sizes[i] >= size;
+        const bool best_fits = best >= 0 && buffer_sizes[best] >= size;
+        if (best < 0 ||
+            (fits && (!best_fits || buffer_sizes[i] < buffer_sizes[best])) ||
+            (!fits && !best_fits && buffer_sizes[i] > buffer_sizes[best])) {
+          best = i;
+        }
+      }
+      if (best < 0) {
+        best = buffer_sizes.size();
+        buffer_sizes.push_back(0);
+        buffer_free.push_back(false);
+      }
+      buffer_sizes[best] = std::max(buffer_sizes[best], size);
+      buffer_free[best] = false;
+      blob_buffer_ids_[blob_id] = best;
+      layer_planned_blob_ids_[layer_id].push_back(blob_id);
+    }
+    for (int i = 0; i < dying[layer_id].size(); ++i) {
+      if (blob_buffer_ids_[dying[layer_id][i]] >= 0) {
+        buffer_free[blob_buffer_ids_[dying[layer_id][i]]] = true;
+      }
+    }
+  }
+
+  size_t naive = 0, planned = 0;
+  for (int blob_id = 0; blob_id < num_blobs; ++blob_id) {
+    const size_t size = blobs_[blob_id]->count() * sizeof(Dtype);
+    naive += size;
+    planned += blob_buffer_ids_[blob_id] < 0 ? size : 0;
+  }
+  for (int i = 0; i < buffer_sizes.size(); ++i) {
+    planned += buffer_sizes[i];
+  }
+  LOG_IF(INFO, Caffe::root_solver())
+      << "Memory required for data with " << buffer_sizes.size()
+      << " shared buffers: " << planned << " instead of " << naive
+      << (apply ? "" : " (set plan_memory to use them)");
+  if (apply) {
+    shared_buffers_.resize(buffer_sizes.size());
+  } else {
+    blob_buffer_ids_.clear();
+    layer_planned_blob_ids_.clear();
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::BindPlannedTops(const int layer_id) {
+  // The final shapes of the tops, which Forward keeps
+  layers_[layer_id]->Reshape(bottom_vecs_[layer_id], top_vecs_[layer_id]);
+  const vector<int>& blob_ids = layer_planned_blob_ids_[layer_id];
+  for (int i = 0; i < blob_ids.size(); ++i) {
+    Blob<Dtype>* blob = blobs_[blob_ids[i]].get();
+    if (!blob->count()) {
+      continue;
+    }
+    const int buffer_id = blob_buffer_ids_[blob_ids[i]];
+    shared_ptr<SyncedMemory>& buffer = shared_buffers_[buffer_id];
+    const size_t size = blob->count() * sizeof(Dtype);
+    vector<int> bound(1, blob_ids[i]);
+    if (!buffer || buffer->size() < size) {
+      // The other blobs of a buffer are dead, but should not point at
+      // freed memory
+      buffer.reset(new SyncedMemory(size));
+      bound.clear();
+      for (int blob_id = 0; blob_id < blobs_.size(); ++blob_id) {
+        if (blob_buffer_ids_[blob_id] == buffer_id &&
+            blobs_[blob_id]->count()) {
+          bound.push_back(blob_id);
+        }
+      }
+    }
+    for (int j = 0; j < bound.size(); ++j) {
+      const shared_ptr<SyncedMemory>& data = blobs_[bound[j]]->data();
+      switch (Caffe::mode()) {
+      case Caffe::CPU:
+        data->set_cpu_data(buffer->mutable_cpu_data());
+        break;
+      case Caffe::GPU:
+        data->set_gpu_data(buffer->mutable_gpu_data());
+        break;
+      }
+    }
+  }
+}
+
 template <typename Dtype>
 void Net<Dtype>::FilterNet(const NetParameter& param,
     NetParameter* param_filtered) {
@@ -547,6 +706,10 @@ Dtype Net<Dtype>::ForwardFromTo(int start, int end) {
   Dtype loss = 0;
   for (int i = start; i <= end; ++i) {
     // LOG(ERROR) << "Forwarding " << layer_names_[i];
+    if (!layer_planned_blob_ids_.empty() &&
+        !layer_planned_blob_ids_[i].empty()) {
+      BindPlannedTops(i);
+    }
     Dtype layer_loss = layers_[i]->Forward(bottom_vecs_[i], top_vecs_[i]);
     loss += layer_loss;
     if (debug_info_) { ForwardDebugInfo(i); }
@@ -25,8 +25,7 @@ SyncedMemory::~SyncedMemory() {
 inline void SyncedMemory::to_cpu() {
   switch (head_) {
   case UNINITIALIZED:
-    CaffeMallocHost(&cpu_ptr_, size_, &cpu_malloc_use_cuda_);
-    caffe_memset(size_, 0, cpu_ptr_);
+    CaffeMallocHost(&cpu_ptr_, size_, &cpu_malloc_use_cuda_, true);
     head_ = HEAD_AT_CPU;
     own_cpu_data_ = true;
     break;
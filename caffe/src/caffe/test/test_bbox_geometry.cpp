@@ -0,0 +1,113 @@
+#include <algorithm>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/bbox_geometry.hpp"
+#include "caffe/util/rng.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class BBoxGeometryTest : public ::testing::Test {
+ protected:
+  BBoxGeometryTest() {
+    Caffe::set_random_seed(1701);
+  }
+
+  // n random [n][stride] boxes, the first 4 values of each being the box
+  void RandomBoxes(const int n, const int stride, vector<float>* boxes) {
+    rng_t* rng = caffe_rng();
+    boxes->resize(n * stride);
+    for (int i = 0; i < n; ++i) {
+      const float x1 = (*rng)() % 100;
+      const float y1 = (*rng)() % 100;
+      (*boxes)[i * stride] = x1;
+      (*boxes)[i * stride + 1] = y1;
+      (*boxes)[i * stride + 2] = x1 + (*rng)() % 50;
+      (*boxes)[i * stride + 3] = y1 + (*rng)() % 50;
+      for (int k = 4; k < stride; ++k) {
+        (*boxes)[i * stride + k] = -1;
+      }
+    }
+  }
+
+  static float ReferenceIoU(const float* a, const float* b) {
+    const float w = std::max(0.f,
+        std::min(a[2], b[2]) - std::max(a[0], b[0]) + 1);
+    const float h = std::max(0.f,
+        std::min(a[3], b[3]) - std::max(a[1], b[1]) + 1);
+    const float area_a = (a[2] - a[0] + 1) * (a[3] - a[1] + 1);
+    const float area_b = (b[2] - b[0] + 1) * (b[3] - b[1] + 1);
+    return w * h / (area_a + area_b - w * h);
+  }
+};
+
+TEST_F(BBoxGeometryTest, TestReset) {
+  const float boxes[] = {0, 1, 9, 4, 0, 5, 5, 5, 5, 0};
+  SoABoxes soa(boxes, 2, 5);
+  ASSERT_EQ(2, soa.size());
+  EXPECT_EQ(0, soa.x1()[0]);
+  EXPECT_EQ(1, soa.y1()[0]);
+  EXPECT_EQ(9, soa.x2()[0]);
+  EXPECT_EQ(4, soa.y2()[0]);
+  EXPECT_EQ(40, soa.area()[0]);
+  EXPECT_EQ(5, soa.x1()[1]);
+  EXPECT_EQ(1, soa.area()[1]);
+}
+
+TEST_F(BBoxGeometryTest, TestIoURow) {
+  // Sizes that exercise the vector loops as well as the scalar tail
+  const int sizes[] = {1, 7, 8, 13, 33};
+  for (int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+    const int n = sizes[s];
+    vector<float> boxes;
+    RandomBoxes(n, 4, &boxes);
+    SoABoxes soa(&boxes[0], n);
+    vector<float> iou(n);
+    for (int i = 0; i < n; ++i) {
+      caffe_cpu_iou(soa, i, soa, 0, n, &iou[0]);
+      for (int j = 0; j < n; ++j) {
+        EXPECT_NEAR(ReferenceIoU(&boxes[4 * i], &boxes[4 * j]), iou[j], 1e-6);
+      }
+      EXPECT_FLOAT_EQ(1, iou[i]);
+    }
+    // A sub-range is written from the start of the output
+    if (n > 2) {
+      caffe_cpu_iou(soa, 0, soa, 1, n, &iou[0]);
+      for (int j = 1; j < n; ++j) {
+        EXPECT_NEAR(ReferenceIoU(&boxes[0], &boxes[4 * j]), iou[j - 1], 1e-6);
+      }
+    }
+  }
+}
+
+TEST_F(BBoxGeometryTest, TestIoUMatrix) {
+  const int n = 5;
+  const int m = 1500;
+  const int stride = 12;
+  vector<float> a, b;
+  RandomBoxes(n, 4, &a);
+  RandomBoxes(m, stride, &b);
+  vector<float> iou(n * m);
+  caffe_cpu_iou(SoABoxes(&a[0], n), SoABoxes(&b[0], m, stride), &iou[0]);
+  for (int i = 0; i < n; ++i) {
+    for (int j = 0; j < m; ++j) {
+      EXPECT_NEAR(ReferenceIoU(&a[4 * i], &b[stride * j]), iou[i * m + j],
+          1e-6);
+    }
+  }
+}
+
+TEST_F(BBoxGeometryTest, TestDisjoint) {
+  const float boxes[] = {0, 0, 9, 9, 10, 0, 19, 9};
+  SoABoxes soa(boxes, 2);
+  float iou[2];
+  caffe_cpu_iou(soa, 0, soa, 0, 2, iou);
+  EXPECT_EQ(1, iou[0]);
+  EXPECT_EQ(0, iou[1]);
+}
+
+}  // namespace caffe
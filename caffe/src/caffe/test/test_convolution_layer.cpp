@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <cmath>
 #include <vector>
 
 #include "gtest/gtest.h"
@@ -6,6 +8,8 @@
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
 #include "caffe/layers/conv_layer.hpp"
+#include "caffe/layers/winograd_conv_layer.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 #ifdef USE_CUDNN
 #include "caffe/layers/cudnn_conv_layer.hpp"
@@ -630,7 +634,10 @@ TYPED_TEST(ConvolutionLayerTest, TestNDAgainst2D) {
   Blob<Dtype> result_2d;
   Blob<Dtype> backward_result_2d;
   Blob<Dtype> backward_weight_result_2d;
-  // Test with 2D im2col
+  // Test with 2D im2col, serially: the tiled passes of several threads sum
+  // in another order than ND im2col
+  const int saved_num_threads = caffe_get_num_threads();
+  caffe_set_num_threads(1);
   {
     caffe_set(this->blob_top_->count(), Dtype(0),
               this->blob_top_->mutable_cpu_data());
@@ -658,6 +665,7 @@ TYPED_TEST(ConvolutionLayerTest, TestNDAgainst2D) {
     backward_result_2d.CopyFrom(*this->blob_bottom_, copy_diff, reshape);
     backward_weight_result_2d.CopyFrom(weights, copy_diff, reshape);
   }
+  caffe_set_num_threads(saved_num_threads);
   Blob<Dtype> result_nd;
   Blob<Dtype> backward_result_nd;
   Blob<Dtype> backward_weight_result_nd;
@@ -706,6 +714,179 @@ TYPED_TEST(ConvolutionLayerTest, TestNDAgainst2D) {
   }
 }
 
+// Runs a set up convolution forward and backward on bottom with
+// num_threads threads, with its outputs as their own gradients, and keeps
+// the outputs and the input and weight gradients in results.
+template <typename Dtype>
+void RunConvolution(Layer<Dtype>* layer, Blob<Dtype>* bottom,
+    int num_threads, Blob<Dtype> results[3]) {
+  const int saved_num_threads = caffe_get_num_threads();
+  caffe_set_num_threads(num_threads);
+  Blob<Dtype> top;
+  vector<Blob<Dtype>*> bottom_vec(1, bottom);
+  vector<Blob<Dtype>*> top_vec(1, &top);
+  layer->Reshape(bottom_vec, top_vec);
+  layer->Forward(bottom_vec, top_vec);
+  caffe_copy(top.count(), top.cpu_data(), top.mutable_cpu_diff());
+  for (int i = 0; i < layer->blobs().size(); ++i) {
+    caffe_set(layer->blobs()[i]->count(), Dtype(0),
+        layer->blobs()[i]->mutable_cpu_diff());
+  }
+  layer->Backward(top_vec, vector<bool>(1, true), bottom_vec);
+  caffe_set_num_threads(saved_num_threads);
+  results[0].CopyFrom(top, false, true);
+  results[1].CopyFrom(*bottom, true, true);
+  results[2].CopyFrom(*layer->blobs()[0], true, true);
+}
+
+template <typename Dtype>
+void ExpectSameResults(Blob<Dtype> expected[3], Blob<Dtype> actual[3],
+    Dtype tolerance = 1e-4) {
+  for (int r = 0; r < 3; ++r) {
+    ASSERT_EQ(expected[r].count(), actual[r].count());
+    // The outputs, then the input and weight gradients
+    const Dtype* e = r ? expected[r].cpu_diff() : expected[r].cpu_data();
+    const Dtype* a = r ? actual[r].cpu_diff() : actual[r].cpu_data();
+    // Relative to the largest magnitude: the sums that cancel down to small
+    // values keep the rounding errors of their large terms
+    Dtype scale = 1;
+    for (int i = 0; i < expected[r].count(); ++i) {
+      scale = std::max(scale, std::fabs(e[i]));
+    }
+    for (int i = 0; i < expected[r].count(); ++i) {
+      EXPECT_NEAR(e[i], a[i], tolerance * scale);
+    }
+  }
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestParallelAgainstSerial) {
+  typedef typename TypeParam::Dtype Dtype;
+  // A single tall image, cut into row tiles, and a batch with groups,
+  // stride and dilation
+  const int shapes[2][4] = {{1, 3, 17, 5}, {3, 6, 11, 8}};
+  for (int k = 0; k < 2; ++k) {
+    LayerParameter layer_param;
+    ConvolutionParameter* convolution_param =
+        layer_param.mutable_convolution_param();
+    convolution_param->add_kernel_size(3);
+    convolution_param->set_num_output(6);
+    if (k == 0) {
+      convolution_param->add_pad(1);
+    } else {
+      convolution_param->add_stride(2);
+      convolution_param->add_dilation(2);
+      convolution_param->set_group(3);
+    }
+    convolution_param->mutable_weight_filler()->set_type("gaussian");
+    convolution_param->mutable_bias_filler()->set_type("gaussian");
+    Blob<Dtype> bottom(vector<int>(shapes[k], shapes[k] + 4));
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(&bottom);
+    Blob<Dtype> top;
+    vector<Blob<Dtype>*> bottom_vec(1, &bottom);
+    vector<Blob<Dtype>*> top_vec(1, &top);
+    ConvolutionLayer<Dtype> layer(layer_param);
+    layer.SetUp(bottom_vec, top_vec);
+    Blob<Dtype> serial[3], parallel[3], again[3];
+    RunConvolution(&layer, &bottom, 1, serial);
+    RunConvolution(&layer, &bottom, 4, parallel);
+    ExpectSameResults(serial, parallel);
+    // Reproducible from run to run
+    RunConvolution(&layer, &bottom, 4, again);
+    ExpectSameResults(parallel, again, Dtype(0));
+  }
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestTiledAgainstCaffe) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Wide enough for several cache-sized tiles per image, and rows too wide
+  // for the cache, cut into column bands
+  const int shapes[2][4] = {{2, 32, 24, 256}, {1, 64, 6, 520}};
+  for (int k = 0; k < 2; ++k) {
+    Blob<Dtype> bottom(vector<int>(shapes[k], shapes[k] + 4));
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(&bottom);
+    LayerParameter layer_param;
+    ConvolutionParameter* convolution_param =
+        layer_param.mutable_convolution_param();
+    convolution_param->add_kernel_size(3);
+    convolution_param->add_pad(1);
+    convolution_param->set_num_output(8);
+    convolution_param->mutable_weight_filler()->set_type("gaussian");
+    convolution_param->mutable_bias_filler()->set_type("gaussian");
+    Blob<Dtype> top;
+    vector<Blob<Dtype>*> bottom_vec(1, &bottom);
+    vector<Blob<Dtype>*> top_vec(1, &top);
+    ConvolutionLayer<Dtype> layer(layer_param);
+    layer.SetUp(bottom_vec, top_vec);
+    convolution_param->set_engine(ConvolutionParameter_Engine_TILED);
+    ConvolutionLayer<Dtype> tiled_layer(layer_param);
+    tiled_layer.SetUp(bottom_vec, top_vec);
+    for (int i = 0; i < layer.blobs().size(); ++i) {
+      tiled_layer.blobs()[i]->CopyFrom(*layer.blobs()[i]);
+    }
+    Blob<Dtype> expected[3], tiled[3];
+    RunConvolution(&layer, &bottom, 1, expected);
+    RunConvolution(&tiled_layer, &bottom, 1, tiled);
+    ExpectSameResults(expected, tiled);
+    RunConvolution(&tiled_layer, &bottom, 4, tiled);
+    ExpectSameResults(expected, tiled);
+  }
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestWinogradAgainstCaffe) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Partial output tiles on both sides, and all the supported paddings
+  vector<int> shape(4);
+  shape[0] = 2;
+  shape[1] = 5;
+  shape[2] = 13;
+  shape[3] = 11;
+  Blob<Dtype> bottom(shape);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(&bottom);
+  for (int tile = 2; tile <= 4; tile += 2) {
+    // F(4 x 4, 3 x 3) rounds more, with larger transform coefficients
+    const Dtype tolerance = tile == 2 ? 1e-3 : 5e-3;
+    for (int pad = 0; pad <= 2; ++pad) {
+      LayerParameter layer_param;
+      ConvolutionParameter* convolution_param =
+          layer_param.mutable_convolution_param();
+      convolution_param->add_kernel_size(3);
+      convolution_param->add_pad(pad);
+      convolution_param->set_num_output(7);
+      convolution_param->mutable_weight_filler()->set_type("gaussian");
+      convolution_param->mutable_bias_filler()->set_type("gaussian");
+      Blob<Dtype> top;
+      vector<Blob<Dtype>*> bottom_vec(1, &bottom);
+      vector<Blob<Dtype>*> top_vec(1, &top);
+      ConvolutionLayer<Dtype> layer(layer_param);
+      layer.SetUp(bottom_vec, top_vec);
+      convolution_param->set_engine(ConvolutionParameter_Engine_WINOGRAD);
+      convolution_param->set_winograd_tile(tile);
+      WinogradConvolutionLayer<Dtype> winograd_layer(layer_param);
+      winograd_layer.SetUp(bottom_vec, top_vec);
+      for (int i = 0; i < layer.blobs().size(); ++i) {
+        winograd_layer.blobs()[i]->CopyFrom(*layer.blobs()[i]);
+      }
+      Blob<Dtype> expected[3], winograd[3];
+      RunConvolution(&layer, &bottom, 1, expected);
+      RunConvolution(&winograd_layer, &bottom, 4, winograd);
+      ExpectSameResults(expected, winograd, tolerance);
+      // The cached transformed weights follow the weights
+      caffe_scal(layer.blobs()[0]->count(), Dtype(2),
+          layer.blobs()[0]->mutable_cpu_data());
+      winograd_layer.blobs()[0]->CopyFrom(*layer.blobs()[0]);
+      RunConvolution(&layer, &bottom, 1, expected);
+      RunConvolution(&winograd_layer, &bottom, 1, winograd);
+      ExpectSameResults(expected, winograd, tolerance);
+    }
+  }
+}
+
 TYPED_TEST(ConvolutionLayerTest, TestGradient) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter layer_param;
@@ -0,0 +1,79 @@
+#include <fstream>  // NOLINT(readability/streams)
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/detection_writer.hpp"
+#include "caffe/util/io.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class DetectionWriterTest : public ::testing::Test {
+ protected:
+  void SetUp() {
+    MakeTempFilename(&filename_);
+    image_names_.push_back("000001");
+    image_names_.push_back("000002");
+    class_names_.push_back("__background__");
+    class_names_.push_back("dog");
+    class_names_.push_back("person");
+  }
+
+  // Writes 2 detections of image 0, none and 1 of image 1
+  void WriteDetections(DetectionWriter::Format format) {
+    DetectionWriter writer(filename_, format, image_names_, class_names_);
+    vector<DetectionRecord> records(2);
+    for (int i = 0; i < 2; ++i) {
+      records[i].image = 0;
+      records[i].label = i + 1;
+      records[i].score = 0.5 + 0.25 * i;
+      for (int c = 0; c < 4; ++c) {
+        records[i].box[c] = 10 * i + c;
+      }
+    }
+    writer.Write(records);
+    writer.Write(vector<DetectionRecord>());
+    records.resize(1);
+    records[0].image = 1;
+    writer.Write(records);
+    writer.Close();
+    EXPECT_EQ(3, writer.num_written());
+  }
+
+  string filename_;
+  vector<string> image_names_;
+  vector<string> class_names_;
+};
+
+TEST_F(DetectionWriterTest, TestBinary) {
+  WriteDetections(DetectionWriter::BINARY);
+  vector<DetectionRecord> records;
+  DetectionWriter::Read(filename_, &records);
+  ASSERT_EQ(3, records.size());
+  EXPECT_EQ(0, records[1].image);
+  EXPECT_EQ(2, records[1].label);
+  EXPECT_FLOAT_EQ(0.75, records[1].score);
+  EXPECT_FLOAT_EQ(13, records[1].box[3]);
+  EXPECT_EQ(1, records[2].image);
+  EXPECT_EQ(1, records[2].label);
+}
+
+TEST_F(DetectionWriterTest, TestJSON) {
+  WriteDetections(DetectionWriter::JSON);
+  std::ifstream file(filename_.c_str());
+  vector<string> lines;
+  string line;
+  while (std::getline(file, line)) {
+    lines.push_back(line);
+  }
+  ASSERT_EQ(3, lines.size());
+  EXPECT_EQ("{\"image\": \"000001\", \"class\": \"person\", \"score\": 0.75, "
+      "\"box\": [10, 11, 12, 13]}", lines[1]);
+  EXPECT_EQ(0, lines[2].find("{\"image\": \"000002\", \"class\": \"dog\""));
+}
+
+}  // namespace caffe
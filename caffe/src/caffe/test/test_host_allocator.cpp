@@ -0,0 +1,169 @@
+#include <cstring>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/syncedmem.hpp"
+#include "caffe/util/host_allocator.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+// An allocator of its own, so that the counters only see the test
+class TestHostAllocator : public HostAllocator {
+ public:
+  TestHostAllocator() {}
+  ~TestHostAllocator() { Trim(); }
+};
+
+class HostAllocatorTest : public ::testing::Test {};
+
+TEST_F(HostAllocatorTest, TestBlockSize) {
+  EXPECT_EQ(256, HostAllocator::BlockSize(0));
+  EXPECT_EQ(256, HostAllocator::BlockSize(256));
+  EXPECT_EQ(320, HostAllocator::BlockSize(257));
+  EXPECT_EQ(512, HostAllocator::BlockSize(512));
+  EXPECT_EQ(3072, HostAllocator::BlockSize(3000));
+  EXPECT_EQ(4096, HostAllocator::BlockSize(4096));
+  EXPECT_EQ(5120, HostAllocator::BlockSize(4097));
+  for (size_t size = 1; size < (1 << 16); size += 97) {
+    const size_t block_size = HostAllocator::BlockSize(size);
+    EXPECT_GE(block_size, size);
+    EXPECT_LE(block_size, size + size / 4 + 256);
+    EXPECT_EQ(0, block_size % HostAllocator::kAlignment);
+  }
+}
+
+TEST_F(HostAllocatorTest, TestReuseIsZeroed) {
+  TestHostAllocator allocator;
+  char* a = static_cast<char*>(allocator.Allocate(3000, true));
+  EXPECT_EQ(0, reinterpret_cast<size_t>(a) % HostAllocator::kAlignment);
+  for (int i = 0; i < 3000; ++i) {
+    EXPECT_EQ(0, a[i]);
+  }
+  memset(a, 1, 3000);
+  allocator.Free(a);
+  // Same class
+  char* b = static_cast<char*>(allocator.Allocate(2900, true));
+  EXPECT_EQ(a, b);
+  for (int i = 0; i < 2900; ++i) {
+    EXPECT_EQ(0, b[i]);
+  }
+  allocator.Free(b);
+  char* c = static_cast<char*>(allocator.Allocate(3072, false));
+  EXPECT_EQ(a, c);
+  allocator.Free(c);
+  const HostAllocator::Stats s = allocator.stats();
+  EXPECT_EQ(3, s.allocations);
+  EXPECT_EQ(2, s.reuses);
+  EXPECT_EQ(3, s.frees);
+  EXPECT_EQ(0, s.releases);
+  EXPECT_EQ(5900, s.zeroed_bytes);
+  EXPECT_EQ(0, s.bytes_in_use);
+  EXPECT_EQ(3072, s.peak_bytes_in_use);
+  EXPECT_EQ(3072, s.cached_bytes);
+}
+
+TEST_F(HostAllocatorTest, TestMappedBlocks) {
+  TestHostAllocator allocator;
+  const size_t size = 3 * HostAllocator::kMapBytes + 1;
+  char* a = static_cast<char*>(allocator.Allocate(size, true));
+  // New mapped blocks are zero already
+  EXPECT_EQ(0, allocator.stats().zeroed_bytes);
+  for (size_t i = 0; i < size; i += 4096) {
+    EXPECT_EQ(0, a[i]);
+  }
+  EXPECT_EQ(0, a[size - 1]);
+  memset(a, 1, size);
+  allocator.Free(a);
+  char* b = static_cast<char*>(allocator.Allocate(size, true));
+  EXPECT_EQ(a, b);
+  EXPECT_EQ(size, allocator.stats().zeroed_bytes);
+  for (size_t i = 0; i < size; i += 4096) {
+    EXPECT_EQ(0, b[i]);
+  }
+  EXPECT_EQ(0, b[size - 1]);
+  allocator.Free(b);
+}
+
+TEST_F(HostAllocatorTest, TestMappedBlockZeroesDirtyPart) {
+  TestHostAllocator allocator;
+  // Both sizes fall in the 3.5 MB class
+  const size_t small = 3 * HostAllocator::kMapBytes + 1;
+  const size_t large = 3 * HostAllocator::kMapBytes +
+      HostAllocator::kMapBytes / 2;
+  char* a = static_cast<char*>(allocator.Allocate(small, true));
+  memset(a, 1, small);
+  allocator.Free(a);
+  // Only what the first owner may have written is cleared
+  char* b = static_cast<char*>(allocator.Allocate(large, true));
+  EXPECT_EQ(a, b);
+  EXPECT_EQ(small, allocator.stats().zeroed_bytes);
+  for (size_t i = 0; i < large; i += 4096) {
+    EXPECT_EQ(0, b[i]);
+  }
+  EXPECT_EQ(0, b[small - 1]);
+  EXPECT_EQ(0, b[small]);
+  EXPECT_EQ(0, b[large - 1]);
+  memset(b, 1, large);
+  allocator.Free(b);
+  // The dirty part stays that of the largest owner so far
+  char* c = static_cast<char*>(allocator.Allocate(small, true));
+  EXPECT_EQ(a, c);
+  EXPECT_EQ(2 * small, allocator.stats().zeroed_bytes);
+  allocator.Free(c);
+  char* d = static_cast<char*>(allocator.Allocate(large, true));
+  EXPECT_EQ(a, d);
+  EXPECT_EQ(2 * small + large, allocator.stats().zeroed_bytes);
+  EXPECT_EQ(0, d[large - 1]);
+  allocator.Free(d);
+}
+
+TEST_F(HostAllocatorTest, TestCacheLimit) {
+  TestHostAllocator allocator;
+  HostAllocator::Options options;
+  options.max_cached_bytes = 1024;
+  allocator.Configure(options);
+  void* a = allocator.Allocate(512, false);
+  void* b = allocator.Allocate(512, false);
+  void* c = allocator.Allocate(512, false);
+  EXPECT_EQ(1536, allocator.stats().peak_bytes_in_use);
+  allocator.Free(a);
+  allocator.Free(b);
+  allocator.Free(c);
+  HostAllocator::Stats s = allocator.stats();
+  EXPECT_EQ(1, s.releases);
+  EXPECT_EQ(1024, s.cached_bytes);
+  // Unpooled, the cache is given back and nothing is kept any more
+  options.pooled = false;
+  allocator.Configure(options);
+  s = allocator.stats();
+  EXPECT_EQ(3, s.releases);
+  EXPECT_EQ(0, s.cached_bytes);
+  allocator.Free(allocator.Allocate(512, false));
+  s = allocator.stats();
+  EXPECT_EQ(0, s.reuses);
+  EXPECT_EQ(4, s.releases);
+  EXPECT_EQ(0, s.cached_bytes);
+}
+
+TEST_F(HostAllocatorTest, TestSyncedMemoryIsZeroed) {
+  Caffe::set_mode(Caffe::CPU);
+  const size_t size = 1000 * sizeof(float);
+  {
+    SyncedMemory mem(size);
+    memset(mem.mutable_cpu_data(), 1, size);
+  }
+  const HostAllocator::Stats before = HostAllocator::Get().stats();
+  SyncedMemory mem(size);
+  const char* data = static_cast<const char*>(mem.cpu_data());
+  for (size_t i = 0; i < size; ++i) {
+    EXPECT_EQ(0, data[i]);
+  }
+  const HostAllocator::Stats after = HostAllocator::Get().stats();
+  EXPECT_EQ(before.allocations + 1, after.allocations);
+  EXPECT_EQ(before.reuses + 1, after.reuses);
+}
+
+}  // namespace caffe
@@ -0,0 +1,107 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/image_preproc.hpp"
+#include "caffe/util/rng.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class ImagePreprocTest : public ::testing::Test {
+ protected:
+  ImagePreprocTest() : src_height_(7), src_width_(9), step_(32) {
+    Caffe::set_random_seed(1701);
+    rng_t* rng = caffe_rng();
+    image_.resize(src_height_ * step_);
+    for (int i = 0; i < image_.size(); ++i) {
+      image_[i] = (*rng)() % 256;
+    }
+    mean_[0] = 102.9801;
+    mean_[1] = 115.9465;
+    mean_[2] = 122.7717;
+  }
+
+  // Bilinear sample of channel c at destination pixel (y, x), following
+  // cv::resize(INTER_LINEAR), of the image mirrored when mirror is set
+  float Reference(const int height, const int width, const int c,
+      const int y, const int x, const bool mirror) {
+    float fy = (y + 0.5) * src_height_ / height - 0.5;
+    float fx = (x + 0.5) * src_width_ / width - 0.5;
+    int sy = std::floor(fy);
+    int sx = std::floor(fx);
+    fy -= sy;
+    fx -= sx;
+    if (sy < 0) { sy = 0; fy = 0; }
+    if (sy >= src_height_ - 1) { sy = src_height_ - 1; fy = 0; }
+    if (sx < 0) { sx = 0; fx = 0; }
+    if (sx >= src_width_ - 1) { sx = src_width_ - 1; fx = 0; }
+    const int sy1 = std::min(sy + 1, src_height_ - 1);
+    const int sx1 = std::min(sx + 1, src_width_ - 1);
+    float v = 0;
+    const int ys[2] = { sy, sy1 };
+    const int xs[2] = { sx, sx1 };
+    const float wy[2] = { 1 - fy, fy };
+    const float wx[2] = { 1 - fx, fx };
+    for (int i = 0; i < 2; ++i) {
+      for (int j = 0; j < 2; ++j) {
+        const int col = mirror ? src_width_ - 1 - xs[j] : xs[j];
+        v += wy[i] * wx[j] * (image_[ys[i] * step_ + 3 * col + c] - mean_[c]);
+      }
+    }
+    return v;
+  }
+
+  void Check(const int height, const int width, const bool mirror) {
+    const int blob_height = height + 2;
+    const int blob_width = width + 3;
+    std::vector<Dtype> blob(3 * blob_height * blob_width, Dtype(-1));
+    caffe_cpu_prep_image(&image_[0], src_height_, src_width_, step_, height,
+        width, mean_, mirror, blob_height, blob_width, &blob[0]);
+    for (int c = 0; c < 3; ++c) {
+      for (int y = 0; y < blob_height; ++y) {
+        for (int x = 0; x < blob_width; ++x) {
+          const Dtype v = blob[(c * blob_height + y) * blob_width + x];
+          if (y >= height || x >= width) {
+            EXPECT_EQ(Dtype(0), v);
+          } else {
+            EXPECT_NEAR(Reference(height, width, c, y, x, mirror), v, 1e-3)
+                << "c " << c << " y " << y << " x " << x;
+          }
+        }
+      }
+    }
+  }
+
+  const int src_height_;
+  const int src_width_;
+  const int step_;
+  std::vector<unsigned char> image_;
+  float mean_[3];
+};
+
+TYPED_TEST_CASE(ImagePreprocTest, TestDtypes);
+
+TYPED_TEST(ImagePreprocTest, TestUpscale) {
+  this->Check(16, 21, false);
+}
+
+TYPED_TEST(ImagePreprocTest, TestDownscale) {
+  this->Check(4, 5, false);
+}
+
+TYPED_TEST(ImagePreprocTest, TestSameSize) {
+  this->Check(7, 9, false);
+}
+
+TYPED_TEST(ImagePreprocTest, TestMirror) {
+  this->Check(16, 21, true);
+  this->Check(4, 5, true);
+}
+
+}  // namespace caffe
@@ -1,3 +1,5 @@
+#include <boost/thread.hpp>
+
 #include "glog/logging.h"
 #include "gtest/gtest.h"
 
@@ -49,5 +51,39 @@ TEST_F(InternalThreadTest, TestRandomSeed) {
   t3.StopInternalThread();
 }
 
-}  // namespace caffe
+class TestThreadCounter : public InternalThread {
+ public:
+  TestThreadCounter() : entered_(0) {}
+  int entered() {
+    boost::mutex::scoped_lock lock(mutex_);
+    return entered_;
+  }
+
+ protected:
+  void InternalThreadEntry() {
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      ++entered_;
+    }
+    while (!must_stop()) {
+      boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+    }
+  }
+
+  boost::mutex mutex_;
+  int entered_;
+};
 
+TEST_F(InternalThreadTest, TestMultipleThreads) {
+  TestThreadCounter thread;
+  thread.StartInternalThread(4);
+  EXPECT_TRUE(thread.is_started());
+  while (thread.entered() < 4) {
+    boost::this_thread::yield();
+  }
+  thread.StopInternalThread();
+  EXPECT_FALSE(thread.is_started());
+  EXPECT_EQ(4, thread.entered());
+}
+
+}  // namespace caffe
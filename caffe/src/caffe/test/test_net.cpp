@@ -2446,6 +2446,134 @@ TYPED_TEST(NetTest, TestReshape) {
   EXPECT_FALSE(same_spatial_shape);
 }
 
+// The memory of a blob's data in the current mode: a planned net binds
+// its buffers to the GPU data in GPU mode, and each blob then keeps its own
+// host copy
+template <typename Dtype>
+const Dtype* ModeData(const Blob<Dtype>& blob) {
+  return Caffe::mode() == Caffe::CPU ? blob.cpu_data() : blob.gpu_data();
+}
+
+TYPED_TEST(NetTest, TestPlanMemory) {
+  typedef typename TypeParam::Dtype Dtype;
+  // conv1 is dead once conv2 is produced, so conv3a can take its memory,
+  // while conv2 lives on through its split until conv3b is produced
+  const string& proto =
+      "name: 'PlannedNetwork' "
+      "state: { phase: TEST } "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'Input' "
+      "  top: 'data' "
+      "  input_param { "
+      "  shape: { dim: 2 dim: 3 dim: 8 dim: 9 } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'conv1' "
+      "  type: 'Convolution' "
+      "  bottom: 'data' "
+      "  top: 'conv1' "
+      "  convolution_param { "
+      "    num_output: 4 "
+      "    kernel_size: 3 "
+      "    pad: 1 "
+      "    weight_filler { "
+      "      type: 'gaussian' "
+      "      std: 0.1 "
+      "    } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'relu1' "
+      "  type: 'ReLU' "
+      "  bottom: 'conv1' "
+      "  top: 'conv1' "
+      "} "
+      "layer { "
+      "  name: 'conv2' "
+      "  type: 'Convolution' "
+      "  bottom: 'conv1' "
+      "  top: 'conv2' "
+      "  convolution_param { "
+      "    num_output: 5 "
+      "    kernel_size: 3 "
+      "    pad: 1 "
+      "    weight_filler { "
+      "      type: 'gaussian' "
+      "      std: 0.1 "
+      "    } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'conv3a' "
+      "  type: 'Convolution' "
+      "  bottom: 'conv2' "
+      "  top: 'conv3a' "
+      "  convolution_param { "
+      "    num_output: 6 "
+      "    kernel_size: 3 "
+      "    pad: 1 "
+      "    weight_filler { "
+      "      type: 'gaussian' "
+      "      std: 0.1 "
+      "    } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'conv3b' "
+      "  type: 'Convolution' "
+      "  bottom: 'conv2' "
+      "  top: 'conv3b' "
+      "  convolution_param { "
+      "    num_output: 6 "
+      "    kernel_size: 3 "
+      "    pad: 1 "
+      "    weight_filler { "
+      "      type: 'gaussian' "
+      "      std: 0.1 "
+      "    } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'sum' "
+      "  type: 'Eltwise' "
+      "  bottom: 'conv3a' "
+      "  bottom: 'conv3b' "
+      "  top: 'sum' "
+      "} ";
+  NetParameter param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+  Caffe::set_random_seed(this->seed_);
+  Net<Dtype> net(param);
+  param.set_plan_memory(true);
+  Caffe::set_random_seed(this->seed_);
+  Net<Dtype> planned_net(param);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  // Growing inputs, which grow the shared buffers
+  for (int k = 0; k < 2; ++k) {
+    Blob<Dtype> input(2, 3, 8 + 4 * k, 9 + 4 * k);
+    filler.Fill(&input);
+    net.input_blobs()[0]->CopyFrom(input, false, true);
+    net.Forward();
+    planned_net.input_blobs()[0]->CopyFrom(input, false, true);
+    planned_net.Forward();
+    const Blob<Dtype>& expected = *net.output_blobs()[0];
+    const Blob<Dtype>& actual = *planned_net.output_blobs()[0];
+    ASSERT_EQ(expected.count(), actual.count());
+    for (int i = 0; i < expected.count(); ++i) {
+      EXPECT_EQ(expected.cpu_data()[i], actual.cpu_data()[i]);
+    }
+    EXPECT_NE(ModeData(*net.blob_by_name("conv1")),
+        ModeData(*net.blob_by_name("conv3a")));
+    EXPECT_EQ(ModeData(*planned_net.blob_by_name("conv1")),
+        ModeData(*planned_net.blob_by_name("conv3a")));
+    EXPECT_NE(ModeData(*planned_net.blob_by_name("conv2")),
+        ModeData(*planned_net.blob_by_name("conv3b")));
+  }
+}
+
 TYPED_TEST(NetTest, TestSkipPropagateDown) {
   // check bottom_need_backward if propagate_down is true
   this->InitSkipPropNet(false);
@@ -0,0 +1,130 @@
+#include <algorithm>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/nms.hpp"
+#include "caffe/util/rng.hpp"
+#include "caffe/util/thread_pool.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class NMSTest : public ::testing::Test {
+ protected:
+  NMSTest() {
+    Caffe::set_random_seed(1701);
+  }
+
+  // Clustered random boxes, so that plenty of them overlap
+  void RandomBoxes(const int n, const int stride, vector<float>* boxes) {
+    rng_t* rng = caffe_rng();
+    boxes->resize(n * stride);
+    for (int i = 0; i < n * stride; i += 4) {
+      const float x1 = (*rng)() % 60;
+      const float y1 = (*rng)() % 60;
+      (*boxes)[i] = x1;
+      (*boxes)[i + 1] = y1;
+      (*boxes)[i + 2] = x1 + 5 + (*rng)() % 30;
+      (*boxes)[i + 3] = y1 + 5 + (*rng)() % 30;
+    }
+  }
+
+  // The quadratic greedy NMS, on boxes sorted by descending score
+  static void ReferenceNMS(const vector<float>& boxes, const float thresh,
+      vector<int>* keep) {
+    const int n = boxes.size() / 4;
+    vector<bool> removed(n, false);
+    for (int i = 0; i < n; ++i) {
+      if (removed[i]) {
+        continue;
+      }
+      keep->push_back(i);
+      for (int j = i + 1; j < n; ++j) {
+        const float* a = &boxes[4 * i];
+        const float* b = &boxes[4 * j];
+        const float w = std::max(0.f,
+            std::min(a[2], b[2]) - std::max(a[0], b[0]) + 1);
+        const float h = std::max(0.f,
+            std::min(a[3], b[3]) - std::max(a[1], b[1]) + 1);
+        const float area_a = (a[2] - a[0] + 1) * (a[3] - a[1] + 1);
+        const float area_b = (b[2] - b[0] + 1) * (b[3] - b[1] + 1);
+        if (w * h / (area_a + area_b - w * h) > thresh) {
+          removed[j] = true;
+        }
+      }
+    }
+  }
+};
+
+TEST_F(NMSTest, TestNMS) {
+  // Sizes around the 64-box blocks of the suppression bitmask
+  const int sizes[] = {1, 2, 63, 64, 65, 200};
+  const float threshs[] = {0, 0.3, 0.7, 1};
+  for (int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+    vector<float> boxes;
+    RandomBoxes(sizes[s], 4, &boxes);
+    for (int t = 0; t < sizeof(threshs) / sizeof(threshs[0]); ++t) {
+      vector<int> keep, keep_ref;
+      caffe_cpu_nms(SoABoxes(&boxes[0], sizes[s]), threshs[t], &keep);
+      ReferenceNMS(boxes, threshs[t], &keep_ref);
+      EXPECT_EQ(keep_ref, keep) << "n = " << sizes[s]
+          << ", thresh = " << threshs[t];
+    }
+  }
+}
+
+TEST_F(NMSTest, TestNMSEmpty) {
+  vector<int> keep;
+  caffe_cpu_nms(SoABoxes(), 0.3, &keep);
+  EXPECT_EQ(0, keep.size());
+}
+
+TEST_F(NMSTest, TestNMSMultiClass) {
+  const int num_rois = 150;
+  const int num_classes = 6;
+  const float conf_thresh = 0.2;
+  const float nms_thresh = 0.3;
+  vector<float> boxes;
+  RandomBoxes(num_rois, 4 * num_classes, &boxes);
+  vector<float> scores(num_rois * num_classes);
+  rng_t* rng = caffe_rng();
+  for (int i = 0; i < scores.size(); ++i) {
+    scores[i] = ((*rng)() % 1000) / 1000.f;
+  }
+  const int num_threads = caffe_get_num_threads();
+  caffe_set_num_threads(3);
+  vector<vector<int> > keep;
+  caffe_cpu_nms_multiclass(&boxes[0], &scores[0], num_rois, num_classes,
+      conf_thresh, nms_thresh, &keep);
+  caffe_set_num_threads(num_threads);
+  ASSERT_EQ(num_classes, keep.size());
+  EXPECT_EQ(0, keep[0].size());
+  for (int c = 1; c < num_classes; ++c) {
+    vector<std::pair<float, int> > candidates;
+    for (int i = 0; i < num_rois; ++i) {
+      if (scores[i * num_classes + c] >= conf_thresh) {
+        candidates.push_back(std::make_pair(scores[i * num_classes + c], i));
+      }
+    }
+    std::sort(candidates.begin(), candidates.end(),
+        std::greater<std::pair<float, int> >());
+    vector<float> sorted_boxes;
+    for (int k = 0; k < candidates.size(); ++k) {
+      const float* box = &boxes[(candidates[k].second * num_classes + c) * 4];
+      sorted_boxes.insert(sorted_boxes.end(), box, box + 4);
+    }
+    vector<int> keep_ref;
+    ReferenceNMS(sorted_boxes, nms_thresh, &keep_ref);
+    ASSERT_EQ(keep_ref.size(), keep[c].size()) << "class " << c;
+    for (int k = 0; k < keep_ref.size(); ++k) {
+      EXPECT_EQ(candidates[keep_ref[k]].second, keep[c][k]);
+    }
+  }
+}
+
+}  // namespace caffe
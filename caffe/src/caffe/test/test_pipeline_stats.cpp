@@ -0,0 +1,104 @@
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <sstream>
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/pipeline_stats.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class PipelineStatsTest : public ::testing::Test {};
+
+TEST_F(PipelineStatsTest, TestHistogram) {
+  TimeHistogram histogram;
+  histogram.Add(0.0005);  // under 1 us
+  histogram.Add(0.003);   // [2, 4) us
+  histogram.Add(0.003);
+  histogram.Add(1.5);     // [1024, 2048) us
+  const TimeHistogram::Snapshot s = histogram.snapshot();
+  EXPECT_EQ(4, s.count);
+  EXPECT_NEAR(1.5065, s.total_ms, 1e-6);
+  EXPECT_FLOAT_EQ(1.5, s.max_ms);
+  EXPECT_EQ(1, s.buckets[0]);
+  EXPECT_EQ(2, s.buckets[1]);
+  EXPECT_EQ(1, s.buckets[10]);
+  EXPECT_NEAR(0.004, s.percentile_ms(0.5), 1e-9);
+  EXPECT_FLOAT_EQ(1.5, s.percentile_ms(0.99));
+}
+
+TEST_F(PipelineStatsTest, TestStageIsShared) {
+  TimeHistogram* a = PipelineStats::Stage("test/stage");
+  EXPECT_EQ(a, PipelineStats::Stage("test/stage"));
+  EXPECT_NE(a, PipelineStats::Stage("test/other"));
+}
+
+TEST_F(PipelineStatsTest, TestRatio) {
+  RatioCounter* ratio = PipelineStats::Ratio("test/ratio");
+  EXPECT_EQ(ratio, PipelineStats::Ratio("test/ratio"));
+  ratio->Add(1, 4);
+  ratio->Add(2, 8);
+  const RatioCounter::Snapshot s = ratio->snapshot();
+  EXPECT_EQ(2, s.count);
+  EXPECT_DOUBLE_EQ(3, s.part);
+  EXPECT_DOUBLE_EQ(12, s.total);
+  EXPECT_DOUBLE_EQ(0.25, s.ratio());
+}
+
+static void push_later(BlockingQueue<Datum*>* queue, Datum* datum) {
+  boost::this_thread::sleep(boost::posix_time::milliseconds(20));
+  queue->push(datum);
+}
+
+TEST_F(PipelineStatsTest, TestQueueCounters) {
+  Datum data[3];
+  BlockingQueue<Datum*> queue;
+  queue.push(&data[0]);
+  queue.push(&data[1]);
+  EXPECT_EQ(&data[0], queue.pop());
+  Datum* datum;
+  EXPECT_TRUE(queue.try_pop(&datum));
+  EXPECT_FALSE(queue.try_pop(&datum));
+  boost::thread producer(&push_later, &queue, &data[2]);
+  EXPECT_EQ(&data[2], queue.pop());
+  producer.join();
+
+  const BlockingQueueStats s = queue.stats();
+  EXPECT_EQ(3, s.pushes);
+  EXPECT_EQ(3, s.pops);
+  EXPECT_EQ(1, s.stalls);
+  EXPECT_GT(s.stall_ms, 0);
+  EXPECT_EQ(2, s.max_depth);
+  // depths 2, 1 and 1 before each pop
+  EXPECT_FLOAT_EQ(4. / 3, s.mean_depth());
+}
+
+TEST_F(PipelineStatsTest, TestJSON) {
+  Datum datum;
+  BlockingQueue<Datum*> queue;
+  queue.push(&datum);
+  const int handle = PipelineStats::RegisterQueue("test/queue",
+      boost::bind(&BlockingQueue<Datum*>::stats, &queue));
+  PipelineStats::Stage("test/json")->Add(2);
+  PipelineStats::Ratio("test/json_ratio")->Add(1, 2);
+  std::ostringstream out;
+  PipelineStats::WriteJSON(out);
+  PipelineStats::UnregisterQueue(handle);
+  const string json = out.str();
+  EXPECT_NE(string::npos, json.find("\"name\": \"test/json\", \"count\": 1"));
+  EXPECT_NE(string::npos, json.find("\"name\": \"test/queue\", \"pushes\": 1"));
+  EXPECT_NE(string::npos, json.find("\"name\": \"test/json_ratio\", "
+      "\"count\": 1, \"part\": 1, \"total\": 2, \"ratio\": 0.5}"));
+
+  std::ostringstream after;
+  PipelineStats::WriteJSON(after);
+  EXPECT_EQ(string::npos, after.str().find("test/queue"));
+}
+
+}  // namespace caffe
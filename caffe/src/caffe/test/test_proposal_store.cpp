@@ -0,0 +1,67 @@
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/proposal_store.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class ProposalStoreTest : public ::testing::Test {
+ protected:
+  void SetUp() {
+    MakeTempFilename(&filename_);
+    // image 0 holds two boxes, image 1 none and image 2 one
+    offsets_.push_back(0);
+    offsets_.push_back(2);
+    offsets_.push_back(2);
+    offsets_.push_back(3);
+    const float boxes[] = {0, 1, 99, 49, 10, 20, 30, 40, 5, 6, 499, 374};
+    boxes_.assign(boxes, boxes + 12);
+  }
+
+  void CheckRoundTrip() {
+    ProposalStore::write(filename_, offsets_, boxes_);
+    EXPECT_TRUE(ProposalStore::is_proposal_file(filename_));
+    ProposalStore store;
+    store.open(filename_);
+    ASSERT_EQ(3, store.num_images());
+    EXPECT_EQ(3, store.total_boxes());
+    for (int i = 0; i < 3; ++i) {
+      ASSERT_EQ(offsets_[i + 1] - offsets_[i], store.num_boxes(i));
+      vector<float> boxes(4 * store.num_boxes(i) + 1, -1);
+      store.get_boxes(i, &boxes[0]);
+      for (int k = 0; k < 4 * store.num_boxes(i); ++k) {
+        EXPECT_EQ(boxes_[4 * offsets_[i] + k], boxes[k]);
+      }
+      // nothing past the boxes of the image is written
+      EXPECT_EQ(-1, boxes.back());
+    }
+  }
+
+  string filename_;
+  vector<int64_t> offsets_;
+  vector<float> boxes_;
+};
+
+TEST_F(ProposalStoreTest, TestInt16RoundTrip) {
+  CheckRoundTrip();
+}
+
+TEST_F(ProposalStoreTest, TestFloatRoundTrip) {
+  boxes_[5] = 20.5;
+  boxes_[11] = 40000;
+  CheckRoundTrip();
+}
+
+TEST_F(ProposalStoreTest, TestNotProposalFile) {
+  WriteProtoToTextFile(Datum(), filename_);
+  EXPECT_FALSE(ProposalStore::is_proposal_file(filename_));
+}
+
+}  // namespace caffe
@@ -0,0 +1,192 @@
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layers/roi_pooling_layer.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+#include "caffe/test/test_gradient_check_util.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class ROIPoolingLayerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  ROIPoolingLayerTest()
+      : blob_bottom_data_(new Blob<Dtype>(2, 3, 12, 20)),
+        blob_bottom_rois_(new Blob<Dtype>(4, 5, 1, 1)),
+        blob_top_data_(new Blob<Dtype>()) {
+    // fill the values
+    Caffe::set_random_seed(1701);
+    FillerParameter filler_param;
+    filler_param.set_std(10);
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_data_);
+    blob_bottom_vec_.push_back(blob_bottom_data_);
+
+    // ROIs in image coordinates: [batch_index x1 y1 x2 y2]
+    const int rois[4][5] = {
+      {0, 0, 0, 19, 11},
+      {1, 2, 1, 9, 8},
+      {0, 12, 4, 17, 10},
+      {1, 5, 5, 5, 5}
+    };
+    Dtype* roi_data = blob_bottom_rois_->mutable_cpu_data();
+    for (int i = 0; i < 4; ++i) {
+      for (int j = 0; j < 5; ++j) {
+        roi_data[i * 5 + j] = rois[i][j];
+      }
+    }
+    blob_bottom_vec_.push_back(blob_bottom_rois_);
+    blob_top_vec_.push_back(blob_top_data_);
+  }
+  virtual ~ROIPoolingLayerTest() {
+    delete blob_bottom_data_;
+    delete blob_bottom_rois_;
+    delete blob_top_data_;
+  }
+  Blob<Dtype>* const blob_bottom_data_;
+  Blob<Dtype>* const blob_bottom_rois_;
+  Blob<Dtype>* const blob_top_data_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(ROIPoolingLayerTest, TestDtypesAndDevices);
+
+TYPED_TEST(ROIPoolingLayerTest, TestSetup) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  ROIPoolingParameter* roi_pooling_param =
+      layer_param.mutable_roi_pooling_param();
+  roi_pooling_param->set_pooled_h(3);
+  roi_pooling_param->set_pooled_w(4);
+  ROIPoolingLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(this->blob_top_data_->num(), 4);
+  EXPECT_EQ(this->blob_top_data_->channels(), 3);
+  EXPECT_EQ(this->blob_top_data_->height(), 3);
+  EXPECT_EQ(this->blob_top_data_->width(), 4);
+}
+
+TYPED_TEST(ROIPoolingLayerTest, TestForward) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  ROIPoolingParameter* roi_pooling_param =
+      layer_param.mutable_roi_pooling_param();
+  roi_pooling_param->set_pooled_h(1);
+  roi_pooling_param->set_pooled_w(1);
+  ROIPoolingLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  // A 1x1 output is the plain max over the whole ROI.
+  const Dtype* roi_data = this->blob_bottom_rois_->cpu_data();
+  for (int n = 0; n < 4; ++n) {
+    const int batch_ind = roi_data[n * 5];
+    for (int c = 0; c < 3; ++c) {
+      Dtype maxval = -FLT_MAX;
+      for (int h = roi_data[n * 5 + 2]; h <= roi_data[n * 5 + 4]; ++h) {
+        for (int w = roi_data[n * 5 + 1]; w <= roi_data[n * 5 + 3]; ++w) {
+          maxval = std::max(maxval,
+              this->blob_bottom_data_->data_at(batch_ind, c, h, w));
+        }
+      }
+      EXPECT_EQ(maxval, this->blob_top_data_->data_at(n, c, 0, 0));
+    }
+  }
+}
+
+TYPED_TEST(ROIPoolingLayerTest, TestForwardChannelBlocks) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Enough channels for full SIMD blocks and a remainder, and ROIs partly
+  // outside the map, so that some bins are empty
+  Blob<Dtype> bottom_data(2, 19, 12, 20);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(&bottom_data);
+  const int rois[3][5] = {
+    {0, 3, 2, 18, 9},
+    {1, -10, -6, 4, 3},
+    {1, 15, 9, 40, 30}
+  };
+  Blob<Dtype> bottom_rois(3, 5, 1, 1);
+  for (int i = 0; i < 15; ++i) {
+    bottom_rois.mutable_cpu_data()[i] = rois[i / 5][i % 5];
+  }
+  vector<Blob<Dtype>*> bottom_vec;
+  bottom_vec.push_back(&bottom_data);
+  bottom_vec.push_back(&bottom_rois);
+  LayerParameter layer_param;
+  ROIPoolingParameter* roi_pooling_param =
+      layer_param.mutable_roi_pooling_param();
+  roi_pooling_param->set_pooled_h(3);
+  roi_pooling_param->set_pooled_w(4);
+  ROIPoolingLayer<Dtype> layer(layer_param);
+  layer.SetUp(bottom_vec, this->blob_top_vec_);
+  layer.Forward(bottom_vec, this->blob_top_vec_);
+  // Reference: the bins computed for every output unit
+  for (int n = 0; n < 3; ++n) {
+    const int roi_height = std::max(rois[n][4] - rois[n][2] + 1, 1);
+    const int roi_width = std::max(rois[n][3] - rois[n][1] + 1, 1);
+    for (int c = 0; c < 19; ++c) {
+      for (int ph = 0; ph < 3; ++ph) {
+        for (int pw = 0; pw < 4; ++pw) {
+          const int hstart = std::min(std::max(rois[n][2] + static_cast<int>(
+              floor(ph * Dtype(roi_height) / 3)), 0), 12);
+          const int hend = std::min(std::max(rois[n][2] + static_cast<int>(
+              ceil((ph + 1) * Dtype(roi_height) / 3)), 0), 12);
+          const int wstart = std::min(std::max(rois[n][1] + static_cast<int>(
+              floor(pw * Dtype(roi_width) / 4)), 0), 20);
+          const int wend = std::min(std::max(rois[n][1] + static_cast<int>(
+              ceil((pw + 1) * Dtype(roi_width) / 4)), 0), 20);
+          Dtype maxval = (hend <= hstart || wend <= wstart) ? 0 : -FLT_MAX;
+          for (int h = hstart; h < hend; ++h) {
+            for (int w = wstart; w < wend; ++w) {
+              maxval = std::max(maxval, bottom_data.data_at(rois[n][0], c,
+                  h, w));
+            }
+          }
+          EXPECT_EQ(maxval, this->blob_top_data_->data_at(n, c, ph, pw));
+        }
+      }
+    }
+  }
+}
+
+TYPED_TEST(ROIPoolingLayerTest, TestGradient) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  ROIPoolingParameter* roi_pooling_param =
+      layer_param.mutable_roi_pooling_param();
+  roi_pooling_param->set_pooled_h(3);
+  roi_pooling_param->set_pooled_w(4);
+  ROIPoolingLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-4, 1e-2);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_, 0);
+}
+
+// Testing skips the argmax in the forward, so the backward recomputes it
+TYPED_TEST(ROIPoolingLayerTest, TestGradientTestPhase) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.set_phase(TEST);
+  ROIPoolingParameter* roi_pooling_param =
+      layer_param.mutable_roi_pooling_param();
+  roi_pooling_param->set_pooled_h(3);
+  roi_pooling_param->set_pooled_w(4);
+  ROIPoolingLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-4, 1e-2);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_, 0);
+}
+
+}  // namespace caffe
@@ -0,0 +1,91 @@
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/roi_projection.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class ROIProjectionTest : public ::testing::Test {};
+
+TEST_F(ROIProjectionTest, TestSingleScale) {
+  const float boxes[] = {0, 0, 99, 49, 10, 20, 30, 40};
+  vector<float> scales_factor(1, 0.5);
+  float rois[10];
+  caffe_cpu_project_rois(boxes, 2, scales_factor, 3, rois);
+  const float expected[] = {3, 0, 0, 49.5, 24.5, 3, 5, 10, 15, 20};
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_FLOAT_EQ(expected[i], rois[i]);
+  }
+}
+
+TEST_F(ROIProjectionTest, TestNearestLevel) {
+  // Areas 112^2, 224^2 and 448^2, at scales 0.5, 1 and 2
+  const float boxes[] = {0, 0, 111, 111, 0, 0, 223, 223, 0, 0, 447, 447};
+  vector<float> scales_factor;
+  scales_factor.push_back(0.5);
+  scales_factor.push_back(1);
+  scales_factor.push_back(2);
+  float rois[15];
+  caffe_cpu_project_rois(boxes, 3, scales_factor, 6, rois);
+  // Each box reaches 224^2 at the scale that undoes its size
+  EXPECT_EQ(6 + 2, rois[0]);
+  EXPECT_FLOAT_EQ(222, rois[3]);
+  EXPECT_EQ(6 + 1, rois[5]);
+  EXPECT_FLOAT_EQ(223, rois[8]);
+  EXPECT_EQ(6 + 0, rois[10]);
+  EXPECT_FLOAT_EQ(223.5, rois[13]);
+}
+
+TEST_F(ROIProjectionTest, TestDedupSharesRows) {
+  float rois[] = {
+    0, 0, 0, 160, 160,
+    0, 1, 2, 161, 158,   // same cells at 1/16 as roi 0
+    0, 32, 0, 160, 160,
+    1, 0, 0, 160, 160,   // same box as roi 0 on another level
+    0, 0, 0, 160, 160,
+  };
+  int rows[5];
+  const int num_unique = caffe_cpu_dedup_rois(rois, 5, 1. / 16, rows);
+  EXPECT_EQ(3, num_unique);
+  EXPECT_EQ(0, rows[0]);
+  EXPECT_EQ(0, rows[1]);
+  EXPECT_EQ(1, rows[2]);
+  EXPECT_EQ(2, rows[3]);
+  EXPECT_EQ(0, rows[4]);
+  // The first of each is kept, in order
+  EXPECT_EQ(0, rois[5 * 0]);
+  EXPECT_EQ(0, rois[5 * 0 + 1]);
+  EXPECT_EQ(32, rois[5 * 1 + 1]);
+  EXPECT_EQ(1, rois[5 * 2]);
+}
+
+TEST_F(ROIProjectionTest, TestNoDedup) {
+  float rois[] = {
+    0, 0, 0, 160, 160,
+    0, 0, 0, 160, 160,
+    0, 1, 2, 161, 158,
+  };
+  int rows[3];
+  EXPECT_EQ(3, caffe_cpu_dedup_rois(rois, 3, 0, rows));
+  for (int i = 0; i < 3; ++i) {
+    EXPECT_EQ(i, rows[i]);
+  }
+  EXPECT_EQ(1, rois[11]);
+}
+
+TEST_F(ROIProjectionTest, TestGatherRows) {
+  const float data[] = {0, 1, 10, 11, 20, 21};
+  const int rows[] = {2, 0, 2, 1};
+  float out[8];
+  caffe_cpu_gather_rows(data, 2, rows, 4, out);
+  const float expected[] = {20, 21, 0, 1, 20, 21, 10, 11};
+  for (int i = 0; i < 8; ++i) {
+    EXPECT_EQ(expected[i], out[i]);
+  }
+}
+
+}  // namespace caffe
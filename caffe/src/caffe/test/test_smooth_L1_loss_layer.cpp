@@ -0,0 +1,111 @@
+#include <cmath>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layers/smooth_L1_loss_layer.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+#include "caffe/test/test_gradient_check_util.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class SmoothL1LossLayerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  SmoothL1LossLayerTest()
+      : blob_bottom_data_(new Blob<Dtype>(10, 21, 1, 1)),
+        blob_bottom_label_(new Blob<Dtype>(10, 21, 1, 1)),
+        blob_bottom_weights_(new Blob<Dtype>(10, 21, 1, 1)),
+        blob_top_loss_(new Blob<Dtype>()) {
+    // fill the values; a std of 2 puts elements on both sides of |x| = 1
+    Caffe::set_random_seed(1701);
+    FillerParameter filler_param;
+    filler_param.set_std(2);
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_data_);
+    blob_bottom_vec_.push_back(blob_bottom_data_);
+    filler.Fill(this->blob_bottom_label_);
+    blob_bottom_vec_.push_back(blob_bottom_label_);
+    // Binary weights, as produced by ROIDataLayer for bbox targets
+    Dtype* weights = blob_bottom_weights_->mutable_cpu_data();
+    for (int i = 0; i < blob_bottom_weights_->count(); ++i) {
+      weights[i] = (i % 3 == 0) ? 0 : 1;
+    }
+    blob_top_vec_.push_back(blob_top_loss_);
+  }
+  virtual ~SmoothL1LossLayerTest() {
+    delete blob_bottom_data_;
+    delete blob_bottom_label_;
+    delete blob_bottom_weights_;
+    delete blob_top_loss_;
+  }
+
+  Dtype ReferenceLoss(bool use_weights) {
+    const Dtype* data = blob_bottom_data_->cpu_data();
+    const Dtype* label = blob_bottom_label_->cpu_data();
+    const Dtype* weights = blob_bottom_weights_->cpu_data();
+    Dtype loss = 0;
+    for (int i = 0; i < blob_bottom_data_->count(); ++i) {
+      Dtype val = data[i] - label[i];
+      if (use_weights) {
+        val *= weights[i];
+      }
+      loss += (fabs(val) < 1) ? 0.5 * val * val : fabs(val) - 0.5;
+    }
+    return loss / blob_bottom_data_->num();
+  }
+
+  Blob<Dtype>* const blob_bottom_data_;
+  Blob<Dtype>* const blob_bottom_label_;
+  Blob<Dtype>* const blob_bottom_weights_;
+  Blob<Dtype>* const blob_top_loss_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(SmoothL1LossLayerTest, TestDtypesAndDevices);
+
+TYPED_TEST(SmoothL1LossLayerTest, TestForward) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  SmoothL1LossLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  const Dtype loss = layer.Forward(this->blob_bottom_vec_,
+      this->blob_top_vec_);
+  EXPECT_NEAR(this->ReferenceLoss(false), loss, 1e-4);
+}
+
+TYPED_TEST(SmoothL1LossLayerTest, TestForwardWeights) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->blob_bottom_vec_.push_back(this->blob_bottom_weights_);
+  LayerParameter layer_param;
+  SmoothL1LossLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  const Dtype loss = layer.Forward(this->blob_bottom_vec_,
+      this->blob_top_vec_);
+  EXPECT_NEAR(this->ReferenceLoss(true), loss, 1e-4);
+}
+
+TYPED_TEST(SmoothL1LossLayerTest, TestGradient) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->blob_bottom_vec_.push_back(this->blob_bottom_weights_);
+  LayerParameter layer_param;
+  const Dtype kLossWeight = 3.7;
+  layer_param.add_loss_weight(kLossWeight);
+  SmoothL1LossLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  GradientChecker<Dtype> checker(1e-3, 1e-2, 1701);
+  // No gradient is propagated to the weights
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_, 0);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_, 1);
+}
+
+}  // namespace caffe
@@ -0,0 +1,115 @@
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <set>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/thread_pool.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class ThreadPoolTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    num_threads_ = caffe_get_num_threads();
+    caffe_set_num_threads(4);
+  }
+  virtual void TearDown() {
+    caffe_set_num_threads(num_threads_);
+  }
+  int num_threads_;
+};
+
+static void MarkRange(vector<int>* hits, int offset, int begin, int end) {
+  for (int i = begin; i < end; ++i) {
+    ++(*hits)[offset + i];
+  }
+}
+
+static void NestedMarkRange(vector<int>* hits, int inner, int begin,
+    int end) {
+  for (int i = begin; i < end; ++i) {
+    caffe_parallel_for(inner,
+        boost::bind(&MarkRange, hits, i * inner, _1, _2));
+  }
+}
+
+// Marks the range and records the threads that ran it, slowly enough for
+// concurrent regions to overlap
+static void MarkRangeSlowly(vector<int>* hits, boost::mutex* mutex,
+    std::set<boost::thread::id>* threads, int begin, int end) {
+  for (int i = begin; i < end; ++i) {
+    ++(*hits)[i];
+    boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+  }
+  boost::mutex::scoped_lock lock(*mutex);
+  threads->insert(boost::this_thread::get_id());
+}
+
+static void RunRegion(boost::barrier* start, vector<int>* hits,
+    std::set<boost::thread::id>* threads) {
+  boost::mutex mutex;
+  start->wait();
+  caffe_parallel_for(hits->size(),
+      boost::bind(&MarkRangeSlowly, hits, &mutex, threads, _1, _2));
+}
+
+TEST_F(ThreadPoolTest, TestNumThreads) {
+  EXPECT_EQ(4, caffe_get_num_threads());
+}
+
+TEST_F(ThreadPoolTest, TestCoversRangeOnce) {
+  const int sizes[] = {0, 1, 3, 4, 17, 1000};
+  for (int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+    vector<int> hits(sizes[s], 0);
+    caffe_parallel_for(sizes[s], boost::bind(&MarkRange, &hits, 0, _1, _2));
+    for (int i = 0; i < sizes[s]; ++i) {
+      EXPECT_EQ(1, hits[i]) << "n = " << sizes[s] << ", i = " << i;
+    }
+  }
+}
+
+TEST_F(ThreadPoolTest, TestNested) {
+  const int outer = 16;
+  const int inner = 8;
+  // Inner calls run serially on whichever thread owns the outer chunk.
+  vector<int> hits(outer * inner, 0);
+  caffe_parallel_for(outer,
+      boost::bind(&NestedMarkRange, &hits, inner, _1, _2));
+  for (int i = 0; i < hits.size(); ++i) {
+    EXPECT_EQ(1, hits[i]);
+  }
+}
+
+TEST_F(ThreadPoolTest, TestConcurrentCallers) {
+  // Neither caller waits for the other, and both get workers
+  boost::barrier start(2);
+  vector<int> hits_a(64, 0), hits_b(64, 0);
+  std::set<boost::thread::id> threads_a, threads_b;
+  boost::thread a(boost::bind(&RunRegion, &start, &hits_a, &threads_a));
+  boost::thread b(boost::bind(&RunRegion, &start, &hits_b, &threads_b));
+  a.join();
+  b.join();
+  for (int i = 0; i < hits_a.size(); ++i) {
+    EXPECT_EQ(1, hits_a[i]);
+    EXPECT_EQ(1, hits_b[i]);
+  }
+  EXPECT_GT(threads_a.size(), 1);
+  EXPECT_GT(threads_b.size(), 1);
+}
+
+TEST_F(ThreadPoolTest, TestSingleThread) {
+  caffe_set_num_threads(1);
+  EXPECT_EQ(1, caffe_get_num_threads());
+  vector<int> hits(10, 0);
+  caffe_parallel_for(10, boost::bind(&MarkRange, &hits, 0, _1, _2));
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_EQ(1, hits[i]);
+  }
+}
+
+}  // namespace caffe
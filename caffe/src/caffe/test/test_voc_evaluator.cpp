@@ -0,0 +1,114 @@
+#include <fstream>  // NOLINT(readability/streams)
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/voc_evaluator.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class VOCEvaluatorTest : public ::testing::Test {
+ protected:
+  void SetUp() {
+    class_names_.push_back("__background__");
+    class_names_.push_back("dog");
+    class_names_.push_back("cat");
+  }
+
+  static DetectionRecord Record(int image, int label, float score, float x1,
+      float y1, float x2, float y2) {
+    DetectionRecord record;
+    record.image = image;
+    record.label = label;
+    record.score = score;
+    record.box[0] = x1;
+    record.box[1] = y1;
+    record.box[2] = x2;
+    record.box[3] = y2;
+    return record;
+  }
+
+  vector<string> class_names_;
+};
+
+TEST_F(VOCEvaluatorTest, TestAveragePrecision) {
+  const float recall[] = {0.5, 0.5, 1};
+  const float precision[] = {1, 0.5, 2. / 3};
+  vector<float> r(recall, recall + 3), p(precision, precision + 3);
+  // 6 recall points at precision 1, 5 at 2/3
+  EXPECT_NEAR((6 + 5 * 2. / 3) / 11,
+      VOCEvaluator::AveragePrecision(r, p, VOCEvaluator::VOC07), 1e-6);
+  EXPECT_NEAR(0.5 + 0.5 * 2. / 3,
+      VOCEvaluator::AveragePrecision(r, p, VOCEvaluator::VOC12), 1e-6);
+  EXPECT_EQ(0, VOCEvaluator::AveragePrecision(vector<float>(),
+      vector<float>(), VOCEvaluator::VOC12));
+}
+
+TEST_F(VOCEvaluatorTest, TestMatching) {
+  VOCEvaluator evaluator(class_names_, VOCEvaluator::VOC12);
+  // image 0: a dog, a difficult dog and a cat; image 1: a dog
+  const float boxes0[] = {0, 0, 9, 9, 20, 20, 29, 29, 40, 40, 49, 49};
+  const int labels0[] = {1, 1, 2};
+  const int difficult0[] = {0, 1, 0};
+  evaluator.SetGroundTruth(0, vector<float>(boxes0, boxes0 + 12),
+      vector<int>(labels0, labels0 + 3),
+      vector<int>(difficult0, difficult0 + 3));
+  evaluator.SetGroundTruth(1, vector<float>(boxes0, boxes0 + 4),
+      vector<int>(1, 1), vector<int>(1, 0));
+
+  vector<DetectionRecord> records;
+  // a false positive on the cat, a duplicate and a difficult match
+  records.push_back(Record(0, 2, 0.6, 0, 0, 9, 9));
+  records.push_back(Record(0, 1, 0.8, 0, 0, 9, 9));
+  records.push_back(Record(0, 1, 0.9, 0, 0, 9, 9));
+  records.push_back(Record(0, 1, 0.7, 20, 20, 29, 29));
+  evaluator.AddDetections(0, records);
+  records.clear();
+  // IoU 81 / 119 with the dog, and a false positive
+  records.push_back(Record(1, 1, 0.95, 1, 1, 10, 10));
+  records.push_back(Record(1, 1, 0.99, 50, 50, 59, 59));
+  evaluator.AddDetections(1, records);
+
+  // dog: FP, TP, TP, FP against 2 positives; recall 0, 1/2, 1, 1 at
+  // precision 0, 1/2, 2/3, 1/2
+  vector<float> aps;
+  const float mean_ap = evaluator.Evaluate(&aps);
+  ASSERT_EQ(3, aps.size());
+  EXPECT_NEAR(2. / 3, aps[1], 1e-6);
+  EXPECT_EQ(0, aps[2]);
+  EXPECT_NEAR(1. / 3, mean_ap, 1e-6);
+}
+
+TEST_F(VOCEvaluatorTest, TestLoadAnnotations) {
+  string dir;
+  MakeTempDir(&dir);
+  std::ofstream xml((dir + "/000001.xml").c_str());
+  xml << "<annotation><object><name>cat</name><difficult>0</difficult>"
+      "<bndbox><xmin>11</xmin><ymin>21</ymin><xmax>30</xmax><ymax>40</ymax>"
+      "</bndbox></object><object><name>cat</name><difficult>1</difficult>"
+      "<bndbox><xmin>1</xmin><ymin>1</ymin><xmax>5</xmax><ymax>5</ymax>"
+      "</bndbox></object><object><name>horse</name><difficult>0</difficult>"
+      "<bndbox><xmin>1</xmin><ymin>1</ymin><xmax>5</xmax><ymax>5</ymax>"
+      "</bndbox></object></annotation>";
+  xml.close();
+  VOCEvaluator evaluator(class_names_, VOCEvaluator::VOC07);
+  evaluator.LoadAnnotations(dir, vector<string>(1, "000001"));
+  EXPECT_EQ(1, evaluator.num_images());
+
+  // Annotations are 1-based; detections match the 0-based box, while the
+  // difficult cat and the unknown class count as no positive
+  vector<DetectionRecord> records;
+  records.push_back(Record(0, 2, 0.5, 10, 20, 29, 39));
+  evaluator.AddDetections(0, records);
+  vector<float> aps;
+  evaluator.Evaluate(&aps);
+  EXPECT_FLOAT_EQ(1, aps[2]);
+  EXPECT_EQ(0, aps[1]);
+}
+
+}  // namespace caffe
@@ -0,0 +1,112 @@
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include <algorithm>
+
+#include "caffe/util/bbox_geometry.hpp"
+
+namespace caffe {
+
+void SoABoxes::Reset(const float* boxes, const int n, const int stride) {
+  n_ = n;
+  plane_ = (n + 7) / 8 * 8;
+  data_.assign(5 * plane_, 0.f);
+  float* x1 = data_.empty() ? NULL : &data_[0];
+  float* y1 = x1 + plane_;
+  float* x2 = y1 + plane_;
+  float* y2 = x2 + plane_;
+  float* area = y2 + plane_;
+  for (int i = 0; i < n; ++i) {
+    const float* box = boxes + i * stride;
+    x1[i] = box[0];
+    y1[i] = box[1];
+    x2[i] = box[2];
+    y2[i] = box[3];
+    area[i] = (box[2] - box[0] + 1) * (box[3] - box[1] + 1);
+  }
+}
+
+// IoU of the box (ax1, ay1, ax2, ay2) of area a_area with boxes
+// [begin, end) of b. The vector paths perform the same operations in the
+// same order as the scalar tail.
+static void iou_row(const float ax1, const float ay1, const float ax2,
+    const float ay2, const float a_area, const SoABoxes& b, int begin,
+    const int end, float* iou) {
+  const float* bx1 = b.x1();
+  const float* by1 = b.y1();
+  const float* bx2 = b.x2();
+  const float* by2 = b.y2();
+  const float* b_area = b.area();
+#ifdef __AVX__
+  const __m256 vx1 = _mm256_set1_ps(ax1);
+  const __m256 vy1 = _mm256_set1_ps(ay1);
+  const __m256 vx2 = _mm256_set1_ps(ax2);
+  const __m256 vy2 = _mm256_set1_ps(ay2);
+  const __m256 varea = _mm256_set1_ps(a_area);
+  const __m256 one = _mm256_set1_ps(1.f);
+  const __m256 zero = _mm256_setzero_ps();
+  for (; begin + 8 <= end; begin += 8, iou += 8) {
+    const __m256 w = _mm256_max_ps(zero, _mm256_add_ps(_mm256_sub_ps(
+        _mm256_min_ps(vx2, _mm256_loadu_ps(bx2 + begin)),
+        _mm256_max_ps(vx1, _mm256_loadu_ps(bx1 + begin))), one));
+    const __m256 h = _mm256_max_ps(zero, _mm256_add_ps(_mm256_sub_ps(
+        _mm256_min_ps(vy2, _mm256_loadu_ps(by2 + begin)),
+        _mm256_max_ps(vy1, _mm256_loadu_ps(by1 + begin))), one));
+    const __m256 inter = _mm256_mul_ps(w, h);
+    const __m256 uni = _mm256_sub_ps(
+        _mm256_add_ps(varea, _mm256_loadu_ps(b_area + begin)), inter);
+    _mm256_storeu_ps(iou, _mm256_div_ps(inter, uni));
+  }
+#elif defined(__SSE2__)
+  const __m128 vx1 = _mm_set1_ps(ax1);
+  const __m128 vy1 = _mm_set1_ps(ay1);
+  const __m128 vx2 = _mm_set1_ps(ax2);
+  const __m128 vy2 = _mm_set1_ps(ay2);
+  const __m128 varea = _mm_set1_ps(a_area);
+  const __m128 one = _mm_set1_ps(1.f);
+  const __m128 zero = _mm_setzero_ps();
+  for (; begin + 4 <= end; begin += 4, iou += 4) {
+    const __m128 w = _mm_max_ps(zero, _mm_add_ps(_mm_sub_ps(
+        _mm_min_ps(vx2, _mm_loadu_ps(bx2 + begin)),
+        _mm_max_ps(vx1, _mm_loadu_ps(bx1 + begin))), one));
+    const __m128 h = _mm_max_ps(zero, _mm_add_ps(_mm_sub_ps(
+        _mm_min_ps(vy2, _mm_loadu_ps(by2 + begin)),
+        _mm_max_ps(vy1, _mm_loadu_ps(by1 + begin))), one));
+    const __m128 inter = _mm_mul_ps(w, h);
+    const __m128 uni = _mm_sub_ps(
+        _mm_add_ps(varea, _mm_loadu_ps(b_area + begin)), inter);
+    _mm_storeu_ps(iou, _mm_div_ps(inter, uni));
+  }
+#endif
+  for (; begin < end; ++begin, ++iou) {
+    const float w = std::max(0.f,
+        std::min(ax2, bx2[begin]) - std::max(ax1, bx1[begin]) + 1);
+    const float h = std::max(0.f,
+        std::min(ay2, by2[begin]) - std::max(ay1, by1[begin]) + 1);
+    const float inter = w * h;
+    *iou = inter / (a_area + b_area[begin] - inter);
+  }
+}
+
+void caffe_cpu_iou(const SoABoxes& a, const int i, const SoABoxes& b,
+    const int begin, const int end, float* iou) {
+  iou_row(a.x1()[i], a.y1()[i], a.x2()[i], a.y2()[i], a.area()[i], b,
+      begin, end, iou);
+}
+
+void caffe_cpu_iou(const SoABoxes& a, const SoABoxes& b, float* iou) {
+  // 1024 boxes of b take 20KB
+  const int kBlock = 1024;
+  const int n = a.size();
+  const int m = b.size();
+  for (int begin = 0; begin < m; begin += kBlock) {
+    const int end = std::min(m, begin + kBlock);
+    for (int i = 0; i < n; ++i) {
+      caffe_cpu_iou(a, i, b, begin, end, iou + static_cast<size_t>(i) * m
+          + begin);
+    }
+  }
+}
+
+}  // namespace caffe
@@ -1,10 +1,14 @@
 #include <boost/thread.hpp>
+#include <algorithm>
 #include <string>
 
 #include "caffe/data_reader.hpp"
+#include "caffe/detector.hpp"
 #include "caffe/layers/base_data_layer.hpp"
 #include "caffe/parallel.hpp"
+#include "caffe/util/benchmark.hpp"
 #include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/detection_writer.hpp"
 
 namespace caffe {
 
@@ -24,6 +28,8 @@ template<typename T>
 void BlockingQueue<T>::push(const T& t) {
   boost::mutex::scoped_lock lock(sync_->mutex_);
   queue_.push(t);
+  ++stats_.pushes;
+  stats_.max_depth = std::max(stats_.max_depth, queue_.size());
   lock.unlock();
   sync_->condition_.notify_one();
 }
@@ -36,6 +42,8 @@ bool BlockingQueue<T>::try_pop(T* t) {
     return false;
   }
 
+  stats_.depth_sum += queue_.size();
+  ++stats_.pops;
   *t = queue_.front();
   queue_.pop();
   return true;
@@ -45,13 +53,21 @@ template<typename T>
 T BlockingQueue<T>::pop(const string& log_on_wait) {
   boost::mutex::scoped_lock lock(sync_->mutex_);
 
-  while (queue_.empty()) {
-    if (!log_on_wait.empty()) {
-      LOG_EVERY_N(INFO, 1000)<< log_on_wait;
+  if (queue_.empty()) {
+    CPUTimer timer;
+    timer.Start();
+    while (queue_.empty()) {
+      if (!log_on_wait.empty()) {
+        LOG_EVERY_N(INFO, 1000)<< log_on_wait;
+      }
+      sync_->condition_.wait(lock);
     }
-    sync_->condition_.wait(lock);
+    ++stats_.stalls;
+    stats_.stall_ms += timer.MicroSeconds() / 1000;
   }
 
+  stats_.depth_sum += queue_.size();
+  ++stats_.pops;
   T t = queue_.front();
   queue_.pop();
   return t;
@@ -86,13 +102,24 @@ size_t BlockingQueue<T>::size() const {
   return queue_.size();
 }
 
+template<typename T>
+BlockingQueueStats BlockingQueue<T>::stats() const {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  return stats_;
+}
+
 template class BlockingQueue<Batch<float>*>;
 template class BlockingQueue<Batch<double>*>;
 template class BlockingQueue<BatchROI<float>*>;
 template class BlockingQueue<BatchROI<double>*>;
 template class BlockingQueue<Datum*>;
+template class BlockingQueue<int>;
 template class BlockingQueue<shared_ptr<DataReader::QueuePair> >;
 template class BlockingQueue<P2PSync<float>*>;
 template class BlockingQueue<P2PSync<double>*>;
+template class BlockingQueue<vector<DetectionRecord>*>;
+#ifdef USE_OPENCV
+template class BlockingQueue<Detector::Batch*>;
+#endif  // USE_OPENCV
 
 }  // namespace caffe
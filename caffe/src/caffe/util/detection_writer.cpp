@@ -0,0 +1,135 @@
+#include <string.h>
+
+#include <boost/thread.hpp>
+#include <string>
+#include <vector>
+
+#include "caffe/util/detection_writer.hpp"
+
+namespace caffe {
+
+namespace {
+
+const char kMagic[8] = {'D', 'E', 'T', 'S', 0, 0, 0, 0};
+
+struct DetectionHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+};
+
+// Writes s as a JSON string literal
+void WriteJSONString(FILE* file, const string& s) {
+  fputc('"', file);
+  for (int i = 0; i < s.size(); ++i) {
+    if (s[i] == '"' || s[i] == '\\') {
+      fputc('\\', file);
+    }
+    fputc(s[i], file);
+  }
+  fputc('"', file);
+}
+
+}  // namespace
+
+DetectionWriter::DetectionWriter(const string& filename, Format format,
+    const vector<string>& image_names, const vector<string>& class_names)
+    : file_(NULL), format_(format), image_names_(image_names),
+      class_names_(class_names), num_written_(0) {
+  file_ = fopen(filename.c_str(), format == BINARY ? "wb" : "w");
+  CHECK(file_) << "Cannot create " << filename;
+  // Large buffered writes; the writer thread is the only user of the file
+  setvbuf(file_, NULL, _IOFBF, 1 << 20);
+  if (format_ == BINARY) {
+    DetectionHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    CHECK_EQ(fwrite(&header, sizeof(header), 1, file_), 1)
+        << "Error writing " << filename;
+  }
+  StartInternalThread();
+}
+
+DetectionWriter::~DetectionWriter() {
+  Close();
+}
+
+void DetectionWriter::Write(const vector<DetectionRecord>& records) {
+  CHECK(file_) << "Writing to a closed DetectionWriter";
+  queue_.push(new vector<DetectionRecord>(records));
+}
+
+void DetectionWriter::Close() {
+  if (!file_) {
+    return;
+  }
+  queue_.push(NULL);
+  StopInternalThread();
+  CHECK_EQ(fclose(file_), 0) << "Error writing detections";
+  file_ = NULL;
+  LOG(INFO) << "Wrote " << num_written_ << " detections";
+}
+
+void DetectionWriter::InternalThreadEntry() {
+  // The queue is drained up to the NULL pushed by Close rather than
+  // stopping on must_stop, so that no detection is lost. The interruption
+  // by StopInternalThread would otherwise throw out of a pop that has
+  // records left to return.
+  boost::this_thread::disable_interruption no_interruption;
+  for (vector<DetectionRecord>* records = queue_.pop(); records;
+       records = queue_.pop()) {
+    WriteRecords(*records);
+    delete records;
+  }
+}
+
+void DetectionWriter::WriteRecords(const vector<DetectionRecord>& records) {
+  if (format_ == BINARY) {
+    if (records.size()) {
+      CHECK_EQ(fwrite(&records[0], sizeof(DetectionRecord), records.size(),
+          file_), records.size()) << "Error writing detections";
+    }
+  } else {
+    for (int i = 0; i < records.size(); ++i) {
+      const DetectionRecord& r = records[i];
+      CHECK_LT(r.image, image_names_.size());
+      CHECK_LT(r.label, class_names_.size());
+      fputs("{\"image\": ", file_);
+      WriteJSONString(file_, image_names_[r.image]);
+      fputs(", \"class\": ", file_);
+      WriteJSONString(file_, class_names_[r.label]);
+      fprintf(file_, ", \"score\": %.6g, \"box\": [%.6g, %.6g, %.6g, %.6g]}\n",
+          r.score, r.box[0], r.box[1], r.box[2], r.box[3]);
+    }
+    CHECK(!ferror(file_)) << "Error writing detections";
+  }
+  num_written_ += records.size();
+}
+
+void DetectionWriter::Read(const string& filename,
+    vector<DetectionRecord>* records) {
+  FILE* file = fopen(filename.c_str(), "rb");
+  CHECK(file) << "Cannot open " << filename;
+  DetectionHeader header;
+  CHECK(fread(&header, sizeof(header), 1, file) == 1 &&
+        memcmp(header.magic, kMagic, sizeof(kMagic)) == 0 &&
+        header.version == kVersion)
+      << filename << " is not a binary detection file";
+  records->clear();
+  DetectionRecord record;
+  while (fread(&record, sizeof(record), 1, file) == 1) {
+    records->push_back(record);
+  }
+  fclose(file);
+}
+
+DetectionWriter::Format DetectionWriter::ParseFormat(const string& name) {
+  if (name == "binary") {
+    return BINARY;
+  }
+  CHECK_EQ(name, "json") << "Unknown detection output format " << name;
+  return JSON;
+}
+
+}  // namespace caffe
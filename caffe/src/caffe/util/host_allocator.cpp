@@ -0,0 +1,188 @@
+#include <sys/mman.h>
+
+#include <boost/thread.hpp>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include "caffe/util/host_allocator.hpp"
+
+DEFINE_int32(host_cache_mb, 1024,
+    "Optional; megabytes of freed host memory kept for reuse; 0 gives "
+    "every block back to the system when freed.");
+DEFINE_bool(huge_pages, true,
+    "Optional; advise large host blocks to use transparent huge pages.");
+
+namespace caffe {
+
+const size_t HostAllocator::kAlignment;
+const size_t HostAllocator::kMapBytes;
+
+class HostAllocator::sync {
+ public:
+  mutable boost::mutex mutex_;
+};
+
+HostAllocator& HostAllocator::Get() {
+  // Never freed, as static blobs may be freed after it would be
+  static HostAllocator* allocator = new HostAllocator();
+  return *allocator;
+}
+
+HostAllocator::HostAllocator()
+    : sync_(new sync()) {
+  memset(&stats_, 0, sizeof(stats_));
+}
+
+size_t HostAllocator::BlockSize(size_t size) {
+  if (size <= 4 * kAlignment) {
+    return 4 * kAlignment;
+  }
+  // size is in (power / 2, power], cut in 4 classes
+  size_t power = 8 * kAlignment;
+  while (power < size) {
+    power <<= 1;
+  }
+  const size_t step = power / 8;
+  return (size + step - 1) / step * step;
+}
+
+void* HostAllocator::Allocate(size_t size, bool zero) {
+  const size_t block_size = BlockSize(size);
+  Block block = {block_size, 0};
+  void* ptr = NULL;
+  bool huge_pages;
+  {
+    boost::mutex::scoped_lock lock(sync_->mutex_);
+    ++stats_.allocations;
+    std::map<size_t, vector<std::pair<void*, size_t> > >::iterator it =
+        cached_.find(block_size);
+    if (it != cached_.end() && !it->second.empty()) {
+      ptr = it->second.back().first;
+      block.dirty_bytes = it->second.back().second;
+      it->second.pop_back();
+      stats_.cached_bytes -= block_size;
+      ++stats_.reuses;
+    }
+    huge_pages = options_.huge_pages;
+  }
+  if (!ptr) {
+    ptr = SystemAllocate(block_size, huge_pages);
+    // Only new mapped blocks are known to be zero
+    block.dirty_bytes = block_size >= kMapBytes ? 0 : block_size;
+  }
+  const size_t zeroed_bytes = zero ? std::min(size, block.dirty_bytes) : 0;
+  if (zeroed_bytes) {
+    memset(ptr, 0, zeroed_bytes);
+  }
+  block.dirty_bytes = std::max(block.dirty_bytes, size);
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  blocks_[ptr] = block;
+  stats_.bytes_in_use += block_size;
+  stats_.peak_bytes_in_use = std::max(stats_.peak_bytes_in_use,
+      stats_.bytes_in_use);
+  stats_.zeroed_bytes += zeroed_bytes;
+  return ptr;
+}
+
+void HostAllocator::Free(void* ptr) {
+  Block block;
+  {
+    boost::mutex::scoped_lock lock(sync_->mutex_);
+    std::map<void*, Block>::iterator it = blocks_.find(ptr);
+    CHECK(it != blocks_.end()) << "Freeing an unknown host block";
+    block = it->second;
+    blocks_.erase(it);
+    ++stats_.frees;
+    stats_.bytes_in_use -= block.size;
+    if (options_.pooled &&
+        stats_.cached_bytes + block.size <= options_.max_cached_bytes) {
+      cached_[block.size].push_back(
+          std::make_pair(ptr, block.dirty_bytes));
+      stats_.cached_bytes += block.size;
+      return;
+    }
+    ++stats_.releases;
+  }
+  SystemFree(ptr, block.size);
+}
+
+void HostAllocator::Configure(const Options& options) {
+  {
+    boost::mutex::scoped_lock lock(sync_->mutex_);
+    options_ = options;
+    if (options_.pooled &&
+        stats_.cached_bytes <= options_.max_cached_bytes) {
+      return;
+    }
+  }
+  Trim();
+}
+
+HostAllocator::Options HostAllocator::options() const {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  return options_;
+}
+
+HostAllocator::Options HostAllocator::FlagOptions() {
+  Options options;
+  options.pooled = FLAGS_host_cache_mb > 0;
+  options.max_cached_bytes = size_t(FLAGS_host_cache_mb) << 20;
+  options.huge_pages = FLAGS_huge_pages;
+  return options;
+}
+
+void HostAllocator::Trim() {
+  std::map<size_t, vector<std::pair<void*, size_t> > > cached;
+  {
+    boost::mutex::scoped_lock lock(sync_->mutex_);
+    cached.swap(cached_);
+    stats_.cached_bytes = 0;
+    for (std::map<size_t, vector<std::pair<void*, size_t> > >::iterator it =
+         cached.begin(); it != cached.end(); ++it) {
+      stats_.releases += it->second.size();
+    }
+  }
+  for (std::map<size_t, vector<std::pair<void*, size_t> > >::iterator it =
+       cached.begin(); it != cached.end(); ++it) {
+    for (int i = 0; i < it->second.size(); ++i) {
+      SystemFree(it->second[i].first, it->first);
+    }
+  }
+}
+
+HostAllocator::Stats HostAllocator::stats() const {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  return stats_;
+}
+
+void* HostAllocator::SystemAllocate(size_t block_size, bool huge_pages) {
+  void* ptr = NULL;
+  if (block_size >= kMapBytes) {
+    ptr = mmap(NULL, block_size, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    CHECK(ptr != MAP_FAILED) << "host allocation of size " << block_size
+        << " failed";
+#ifdef MADV_HUGEPAGE
+    if (huge_pages) {
+      madvise(ptr, block_size, MADV_HUGEPAGE);
+    }
+#endif
+    return ptr;
+  }
+  CHECK_EQ(posix_memalign(&ptr, kAlignment, block_size), 0)
+      << "host allocation of size " << block_size << " failed";
+  return ptr;
+}
+
+void HostAllocator::SystemFree(void* ptr, size_t block_size) {
+  if (block_size >= kMapBytes) {
+    munmap(ptr, block_size);
+  } else {
+    free(ptr);
+  }
+}
+
+}  // namespace caffe
@@ -0,0 +1,160 @@
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "glog/logging.h"
+
+#include "caffe/util/image_preproc.hpp"
+
+namespace caffe {
+
+namespace {
+
+// Source indices and weight of the bilinear sampling of cv::resize
+// (INTER_LINEAR): destination pixel d reads source pixels s0 and s1 with
+// weights 1 - alpha and alpha.
+void linear_coeffs(const int src_size, const int dst_size, const bool mirror,
+    std::vector<int>* s0, std::vector<int>* s1, std::vector<float>* alpha) {
+  s0->resize(dst_size);
+  s1->resize(dst_size);
+  alpha->resize(dst_size);
+  const double scale = static_cast<double>(src_size) / dst_size;
+  for (int d = 0; d < dst_size; ++d) {
+    float f = (d + 0.5) * scale - 0.5;
+    int s = static_cast<int>(std::floor(f));
+    f -= s;
+    if (s < 0) {
+      s = 0;
+      f = 0;
+    }
+    if (s >= src_size - 1) {
+      s = src_size - 1;
+      f = 0;
+    }
+    // Resizing commutes with mirroring when the scale is src / dst, so a
+    // mirrored image just fills the row from the right
+    const int k = mirror ? dst_size - 1 - d : d;
+    (*s0)[k] = s;
+    (*s1)[k] = std::min(s + 1, src_size - 1);
+    (*alpha)[k] = f;
+  }
+}
+
+// Interpolates a BGR source row horizontally into three planes of width
+// floats.
+void resize_row(const unsigned char* src, const int* x0, const int* x1,
+    const float* alpha, const int width, float* planes) {
+  float* b = planes;
+  float* g = planes + width;
+  float* r = planes + 2 * width;
+  for (int x = 0; x < width; ++x) {
+    const unsigned char* p = src + 3 * x0[x];
+    const unsigned char* q = src + 3 * x1[x];
+    const float a = alpha[x];
+    b[x] = p[0] + a * (q[0] - p[0]);
+    g[x] = p[1] + a * (q[1] - p[1]);
+    r[x] = p[2] + a * (q[2] - p[2]);
+  }
+}
+
+// out[i] = top[i] + beta * (bottom[i] - top[i]) - mean
+template <typename Dtype>
+void blend_rows(const float* top, const float* bottom, const float beta,
+    const float mean, const int n, Dtype* out) {
+  for (int i = 0; i < n; ++i) {
+    out[i] = top[i] + beta * (bottom[i] - top[i]) - mean;
+  }
+}
+
+template <>
+void blend_rows<float>(const float* top, const float* bottom,
+    const float beta, const float mean, const int n, float* out) {
+  int i = 0;
+#if defined(__AVX__)
+  const __m256 vbeta = _mm256_set1_ps(beta);
+  const __m256 vmean = _mm256_set1_ps(mean);
+  for (; i + 8 <= n; i += 8) {
+    const __m256 t = _mm256_loadu_ps(top + i);
+    const __m256 d = _mm256_sub_ps(_mm256_loadu_ps(bottom + i), t);
+    _mm256_storeu_ps(out + i, _mm256_sub_ps(
+        _mm256_add_ps(t, _mm256_mul_ps(vbeta, d)), vmean));
+  }
+#elif defined(__SSE2__)
+  const __m128 vbeta = _mm_set1_ps(beta);
+  const __m128 vmean = _mm_set1_ps(mean);
+  for (; i + 4 <= n; i += 4) {
+    const __m128 t = _mm_loadu_ps(top + i);
+    const __m128 d = _mm_sub_ps(_mm_loadu_ps(bottom + i), t);
+    _mm_storeu_ps(out + i, _mm_sub_ps(
+        _mm_add_ps(t, _mm_mul_ps(vbeta, d)), vmean));
+  }
+#endif
+  for (; i < n; ++i) {
+    out[i] = top[i] + beta * (bottom[i] - top[i]) - mean;
+  }
+}
+
+}  // namespace
+
+template <typename Dtype>
+void caffe_cpu_prep_image(const unsigned char* src, const int src_height,
+    const int src_width, const size_t src_step, const int height,
+    const int width, const float* mean, const bool mirror,
+    const int blob_height, const int blob_width, Dtype* dst) {
+  CHECK_GT(src_height, 0);
+  CHECK_GT(src_width, 0);
+  CHECK_GT(height, 0);
+  CHECK_GT(width, 0);
+  CHECK_LE(height, blob_height);
+  CHECK_LE(width, blob_width);
+  std::vector<int> x0, x1, y0, y1;
+  std::vector<float> alpha, beta;
+  linear_coeffs(src_width, width, mirror, &x0, &x1, &alpha);
+  linear_coeffs(src_height, height, false, &y0, &y1, &beta);
+
+  // Two horizontally resized source rows; consecutive output rows mostly
+  // share them, so each source row is resized about once
+  std::vector<float> buffer(6 * width);
+  float* rows[2] = { &buffer[0], &buffer[3 * width] };
+  int row_ids[2] = { -1, -1 };
+  const int plane = blob_height * blob_width;
+  for (int y = 0; y < height; ++y) {
+    const int wanted[2] = { y0[y], y1[y] };
+    if (row_ids[0] != wanted[0] && row_ids[1] == wanted[0]) {
+      std::swap(rows[0], rows[1]);
+      std::swap(row_ids[0], row_ids[1]);
+    }
+    for (int k = 0; k < 2; ++k) {
+      if (row_ids[k] != wanted[k]) {
+        resize_row(src + wanted[k] * src_step, &x0[0], &x1[0], &alpha[0],
+            width, rows[k]);
+        row_ids[k] = wanted[k];
+      }
+    }
+    for (int c = 0; c < 3; ++c) {
+      Dtype* out = dst + c * plane + y * blob_width;
+      blend_rows(rows[0] + c * width, rows[1] + c * width, beta[y], mean[c],
+          width, out);
+      std::fill(out + width, out + blob_width, Dtype(0));
+    }
+  }
+  for (int c = 0; c < 3; ++c) {
+    std::fill(dst + c * plane + height * blob_width, dst + (c + 1) * plane,
+        Dtype(0));
+  }
+}
+
+template void caffe_cpu_prep_image<float>(const unsigned char* src,
+    const int src_height, const int src_width, const size_t src_step,
+    const int height, const int width, const float* mean, const bool mirror,
+    const int blob_height, const int blob_width, float* dst);
+template void caffe_cpu_prep_image<double>(const unsigned char* src,
+    const int src_height, const int src_width, const size_t src_step,
+    const int height, const int width, const float* mean, const bool mirror,
+    const int blob_height, const int blob_width, double* dst);
+
+}  // namespace caffe
@@ -0,0 +1,105 @@
+#include <stdint.h>
+#include <algorithm>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include <boost/bind.hpp>
+
+#include "caffe/util/nms.hpp"
+#include "caffe/util/thread_pool.hpp"
+
+namespace caffe {
+
+void caffe_cpu_nms(const SoABoxes& boxes, const float thresh,
+    std::vector<int>* keep) {
+  const int n = boxes.size();
+  const int num_words = (n + 63) / 64;
+  std::vector<uint64_t> removed(num_words, 0);
+  float iou[64];
+  for (int i = 0; i < n; ++i) {
+    if ((removed[i / 64] >> (i % 64)) & 1) {
+      continue;
+    }
+    keep->push_back(i);
+    // Only the boxes after i are left to suppress
+    for (int word = i / 64; word < num_words; ++word) {
+      int begin = word * 64;
+      const int end = std::min(n, begin + 64);
+      uint64_t live = ~removed[word];
+      if (word == i / 64) {
+        live &= ~uint64_t(0) << (i % 64) << 1;
+        begin = i + 1;
+      }
+      if (!live || begin >= end) {
+        continue;
+      }
+      caffe_cpu_iou(boxes, i, boxes, begin, end, iou);
+      uint64_t suppressed = 0;
+      for (int j = begin; j < end; ++j) {
+        suppressed |= uint64_t(iou[j - begin] > thresh) << (j - word * 64);
+      }
+      removed[word] |= suppressed;
+    }
+  }
+}
+
+namespace {
+
+struct MultiClassNMS {
+  const float* boxes;
+  const float* scores;
+  int num_rois;
+  int num_classes;
+  float conf_thresh;
+  float nms_thresh;
+  std::vector<std::vector<int> >* keep;
+};
+
+void nms_classes(const MultiClassNMS* args, const int begin, const int end) {
+  const int num_classes = args->num_classes;
+  std::vector<std::pair<float, int> > candidates;
+  std::vector<float> sorted_boxes;
+  SoABoxes soa_boxes;
+  std::vector<int> kept;
+  for (int c = begin + 1; c < end + 1; ++c) {
+    candidates.clear();
+    for (int i = 0; i < args->num_rois; ++i) {
+      const float score = args->scores[i * num_classes + c];
+      if (score >= args->conf_thresh) {
+        candidates.push_back(std::make_pair(score, i));
+      }
+    }
+    std::sort(candidates.begin(), candidates.end(),
+        std::greater<std::pair<float, int> >());
+    sorted_boxes.resize(4 * candidates.size());
+    for (int k = 0; k < candidates.size(); ++k) {
+      const float* box = args->boxes
+          + (candidates[k].second * num_classes + c) * 4;
+      std::copy(box, box + 4, &sorted_boxes[4 * k]);
+    }
+    soa_boxes.Reset(sorted_boxes.empty() ? NULL : &sorted_boxes[0],
+        candidates.size());
+    kept.clear();
+    caffe_cpu_nms(soa_boxes, args->nms_thresh, &kept);
+    std::vector<int>& keep = (*args->keep)[c];
+    keep.resize(kept.size());
+    for (int k = 0; k < kept.size(); ++k) {
+      keep[k] = candidates[kept[k]].second;
+    }
+  }
+}
+
+}  // namespace
+
+void caffe_cpu_nms_multiclass(const float* boxes, const float* scores,
+    const int num_rois, const int num_classes, const float conf_thresh,
+    const float nms_thresh, std::vector<std::vector<int> >* keep) {
+  keep->assign(num_classes, std::vector<int>());
+  MultiClassNMS args = {boxes, scores, num_rois, num_classes, conf_thresh,
+      nms_thresh, keep};
+  caffe_parallel_for(num_classes - 1,
+      boost::bind(&nms_classes, &args, _1, _2));
+}
+
+}  // namespace caffe
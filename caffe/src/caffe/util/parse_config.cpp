@@ -30,6 +30,7 @@ void ParseConfig::InitializeTrainConfig()
 	TRAIN_CFG.SNAPSHOT_ITERS = 10000;
 	TRAIN_CFG.SNAPSHOT_INFIX = "";
 	TRAIN_CFG.USE_PREFETCH = false;
+	TRAIN_CFG.ASPECT_GROUPING = true;
 }
 
 void ParseConfig::InitializeTestConfig()
@@ -79,6 +80,9 @@ void ParseConfig::ParseTrainConfig()
 	CHECK(cfg.getValue("TRAIN", "SNAPSHOT_ITERS", &TRAIN_CFG.SNAPSHOT_ITERS));
 	CHECK(cfg.getValue("TRAIN", "SNAPSHOT_INFIX", &TRAIN_CFG.SNAPSHOT_INFIX));
 	CHECK(cfg.getValue("TRAIN", "USE_PREFETCH", &TRAIN_CFG.USE_PREFETCH));
+	// Optional, for the config files written before it
+	if (!cfg.getValue("TRAIN", "ASPECT_GROUPING", &TRAIN_CFG.ASPECT_GROUPING))
+		TRAIN_CFG.ASPECT_GROUPING = true;
 }
 
 
@@ -0,0 +1,246 @@
+#include <boost/thread.hpp>
+#include <algorithm>
+#include <fstream>  // NOLINT(readability/streams)
+#include <iomanip>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "caffe/util/host_allocator.hpp"
+#include "caffe/util/pipeline_stats.hpp"
+
+namespace caffe {
+
+class TimeHistogram::sync {
+ public:
+  mutable boost::mutex mutex_;
+};
+
+TimeHistogram::TimeHistogram()
+    : sync_(new sync()) {
+  data_.count = 0;
+  data_.total_ms = 0;
+  data_.max_ms = 0;
+  data_.buckets.assign(kNumBuckets, 0);
+}
+
+void TimeHistogram::Add(float ms) {
+  int bucket = 0;
+  for (uint64_t us = static_cast<uint64_t>(ms * 1000); us > 1 &&
+       bucket < kNumBuckets - 1; us >>= 1) {
+    ++bucket;
+  }
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  ++data_.count;
+  data_.total_ms += ms;
+  data_.max_ms = std::max<double>(data_.max_ms, ms);
+  ++data_.buckets[bucket];
+}
+
+TimeHistogram::Snapshot TimeHistogram::snapshot() const {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  return data_;
+}
+
+double TimeHistogram::Snapshot::percentile_ms(double p) const {
+  const double rank = p * count;
+  uint64_t seen = 0;
+  for (int k = 0; k < buckets.size(); ++k) {
+    seen += buckets[k];
+    if (seen > 0 && seen >= rank) {
+      return std::min<double>(max_ms, (uint64_t(2) << k) / 1000.);
+    }
+  }
+  return max_ms;
+}
+
+class RatioCounter::sync {
+ public:
+  mutable boost::mutex mutex_;
+};
+
+RatioCounter::RatioCounter()
+    : sync_(new sync()) {
+  data_.count = 0;
+  data_.part = 0;
+  data_.total = 0;
+}
+
+void RatioCounter::Add(double part, double total) {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  ++data_.count;
+  data_.part += part;
+  data_.total += total;
+}
+
+RatioCounter::Snapshot RatioCounter::snapshot() const {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  return data_;
+}
+
+namespace {
+
+struct QueueEntry {
+  string name;
+  boost::function<BlockingQueueStats()> stats;
+};
+
+// Never destroyed, so that layers may unregister during static destruction
+boost::mutex* registry_mutex = new boost::mutex();
+std::map<string, TimeHistogram*>* stages =
+    new std::map<string, TimeHistogram*>();
+std::map<string, RatioCounter*>* ratios =
+    new std::map<string, RatioCounter*>();
+std::map<int, QueueEntry>* queues = new std::map<int, QueueEntry>();
+int next_queue_handle = 0;
+
+// Copies the registry so that the stats are read without holding its lock
+void snapshot(vector<std::pair<string, TimeHistogram::Snapshot> >* stage_stats,
+    vector<std::pair<string, RatioCounter::Snapshot> >* ratio_stats,
+    vector<std::pair<string, BlockingQueueStats> >* queue_stats) {
+  vector<std::pair<string, TimeHistogram*> > stage_list;
+  vector<std::pair<string, RatioCounter*> > ratio_list;
+  vector<QueueEntry> queue_list;
+  {
+    boost::mutex::scoped_lock lock(*registry_mutex);
+    stage_list.assign(stages->begin(), stages->end());
+    ratio_list.assign(ratios->begin(), ratios->end());
+    for (std::map<int, QueueEntry>::const_iterator it = queues->begin();
+         it != queues->end(); ++it) {
+      queue_list.push_back(it->second);
+    }
+  }
+  for (int i = 0; i < stage_list.size(); ++i) {
+    stage_stats->push_back(std::make_pair(stage_list[i].first,
+        stage_list[i].second->snapshot()));
+  }
+  for (int i = 0; i < ratio_list.size(); ++i) {
+    ratio_stats->push_back(std::make_pair(ratio_list[i].first,
+        ratio_list[i].second->snapshot()));
+  }
+  for (int i = 0; i < queue_list.size(); ++i) {
+    queue_stats->push_back(std::make_pair(queue_list[i].name,
+        queue_list[i].stats()));
+  }
+}
+
+}  // namespace
+
+TimeHistogram* PipelineStats::Stage(const string& name) {
+  boost::mutex::scoped_lock lock(*registry_mutex);
+  TimeHistogram*& histogram = (*stages)[name];
+  if (!histogram) {
+    histogram = new TimeHistogram();
+  }
+  return histogram;
+}
+
+RatioCounter* PipelineStats::Ratio(const string& name) {
+  boost::mutex::scoped_lock lock(*registry_mutex);
+  RatioCounter*& counter = (*ratios)[name];
+  if (!counter) {
+    counter = new RatioCounter();
+  }
+  return counter;
+}
+
+int PipelineStats::RegisterQueue(const string& name,
+    const boost::function<BlockingQueueStats()>& stats) {
+  boost::mutex::scoped_lock lock(*registry_mutex);
+  QueueEntry& entry = (*queues)[next_queue_handle];
+  entry.name = name;
+  entry.stats = stats;
+  return next_queue_handle++;
+}
+
+void PipelineStats::UnregisterQueue(int handle) {
+  boost::mutex::scoped_lock lock(*registry_mutex);
+  queues->erase(handle);
+}
+
+void PipelineStats::Log() {
+  vector<std::pair<string, TimeHistogram::Snapshot> > stage_stats;
+  vector<std::pair<string, RatioCounter::Snapshot> > ratio_stats;
+  vector<std::pair<string, BlockingQueueStats> > queue_stats;
+  snapshot(&stage_stats, &ratio_stats, &queue_stats);
+  for (int i = 0; i < stage_stats.size(); ++i) {
+    const TimeHistogram::Snapshot& s = stage_stats[i].second;
+    LOG(INFO) << "Stage " << stage_stats[i].first << ": " << s.count
+        << " calls, mean " << s.mean_ms() << " ms, p50 "
+        << s.percentile_ms(0.5) << " ms, p90 " << s.percentile_ms(0.9)
+        << " ms, p99 " << s.percentile_ms(0.99) << " ms, max " << s.max_ms
+        << " ms";
+  }
+  for (int i = 0; i < ratio_stats.size(); ++i) {
+    const RatioCounter::Snapshot& s = ratio_stats[i].second;
+    LOG(INFO) << "Ratio " << ratio_stats[i].first << ": " << s.part << " of "
+        << s.total << " (" << 100 * s.ratio() << "%) over " << s.count
+        << " samples";
+  }
+  for (int i = 0; i < queue_stats.size(); ++i) {
+    const BlockingQueueStats& s = queue_stats[i].second;
+    LOG(INFO) << "Queue " << queue_stats[i].first << ": mean depth "
+        << s.mean_depth() << ", max depth " << s.max_depth << ", "
+        << s.stalls << " of " << s.pops << " pops stalled for "
+        << s.stall_ms << " ms";
+  }
+  const HostAllocator::Stats m = HostAllocator::Get().stats();
+  LOG(INFO) << "Host memory: " << m.allocations << " allocations, "
+      << m.reuses << " reused, " << m.zeroed_bytes << " bytes zeroed, "
+      << m.bytes_in_use << " bytes in use, peak " << m.peak_bytes_in_use
+      << ", " << m.cached_bytes << " bytes cached";
+}
+
+void PipelineStats::WriteJSON(std::ostream& out) {
+  vector<std::pair<string, TimeHistogram::Snapshot> > stage_stats;
+  vector<std::pair<string, RatioCounter::Snapshot> > ratio_stats;
+  vector<std::pair<string, BlockingQueueStats> > queue_stats;
+  snapshot(&stage_stats, &ratio_stats, &queue_stats);
+  // Names are layer names and fixed suffixes, which need no escaping
+  out << std::setprecision(6) << "{\n  \"stages\": [";
+  for (int i = 0; i < stage_stats.size(); ++i) {
+    const TimeHistogram::Snapshot& s = stage_stats[i].second;
+    out << (i ? "," : "") << "\n    {\"name\": \"" << stage_stats[i].first
+        << "\", \"count\": " << s.count << ", \"total_ms\": " << s.total_ms
+        << ", \"mean_ms\": " << s.mean_ms() << ", \"p50_ms\": "
+        << s.percentile_ms(0.5) << ", \"p90_ms\": " << s.percentile_ms(0.9)
+        << ", \"p99_ms\": " << s.percentile_ms(0.99) << ", \"max_ms\": "
+        << s.max_ms << ", \"buckets_us_log2\": [";
+    for (int k = 0; k < s.buckets.size(); ++k) {
+      out << (k ? ", " : "") << s.buckets[k];
+    }
+    out << "]}";
+  }
+  out << "\n  ],\n  \"ratios\": [";
+  for (int i = 0; i < ratio_stats.size(); ++i) {
+    const RatioCounter::Snapshot& s = ratio_stats[i].second;
+    out << (i ? "," : "") << "\n    {\"name\": \"" << ratio_stats[i].first
+        << "\", \"count\": " << s.count << ", \"part\": " << s.part
+        << ", \"total\": " << s.total << ", \"ratio\": " << s.ratio() << "}";
+  }
+  out << "\n  ],\n  \"queues\": [";
+  for (int i = 0; i < queue_stats.size(); ++i) {
+    const BlockingQueueStats& s = queue_stats[i].second;
+    out << (i ? "," : "") << "\n    {\"name\": \"" << queue_stats[i].first
+        << "\", \"pushes\": " << s.pushes << ", \"pops\": " << s.pops
+        << ", \"stalls\": " << s.stalls << ", \"stall_ms\": " << s.stall_ms
+        << ", \"mean_depth\": " << s.mean_depth() << ", \"max_depth\": "
+        << s.max_depth << "}";
+  }
+  const HostAllocator::Stats m = HostAllocator::Get().stats();
+  out << "\n  ],\n  \"host_memory\": {\"allocations\": " << m.allocations
+      << ", \"reuses\": " << m.reuses << ", \"frees\": " << m.frees
+      << ", \"releases\": " << m.releases << ", \"zeroed_bytes\": "
+      << m.zeroed_bytes << ", \"bytes_in_use\": " << m.bytes_in_use
+      << ", \"peak_bytes_in_use\": " << m.peak_bytes_in_use
+      << ", \"cached_bytes\": " << m.cached_bytes << "}\n}\n";
+}
+
+void PipelineStats::WriteJSON(const string& filename) {
+  std::ofstream out(filename.c_str());
+  CHECK(out) << "Cannot write pipeline statistics to " << filename;
+  WriteJSON(out);
+}
+
+}  // namespace caffe
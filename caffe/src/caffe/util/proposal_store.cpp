@@ -0,0 +1,282 @@
+#include "caffe/util/proposal_store.hpp"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <glog/logging.h>
+
+#include "caffe/3rdparty/matio.h"
+
+namespace caffe
+{
+    namespace
+    {
+        const char kMagic[8] = {'P', 'R', 'O', 'P', 'S', 0, 0, 0};
+        const size_t kAlign = 64;
+
+        enum BoxType {kFloat32 = 0, kInt16 = 1};
+
+        struct ProposalHeader
+        {
+            char magic[8];
+            uint32_t version;
+            uint32_t header_size;
+            int64_t num_images;
+            int64_t num_boxes;
+            uint32_t box_type;
+            uint32_t reserved;
+            uint64_t file_size;
+        };
+
+        // Byte offsets of the sections following the header
+        struct ProposalLayout
+        {
+            size_t offsets;  // int64[num_images + 1]
+            size_t boxes;    // float or int16 [num_boxes][4]
+            size_t total;
+        };
+
+        size_t align_up(size_t offset)
+        {
+            return (offset + kAlign - 1) / kAlign * kAlign;
+        }
+
+        size_t box_size(uint32_t box_type)
+        {
+            return box_type == kInt16 ? sizeof(int16_t) : sizeof(float);
+        }
+
+        ProposalLayout compute_layout(const ProposalHeader& header)
+        {
+            ProposalLayout layout;
+            size_t offset = align_up(sizeof(ProposalHeader));
+            layout.offsets = offset;
+            offset = align_up(offset + (header.num_images + 1) * sizeof(int64_t));
+            layout.boxes = offset;
+            offset = align_up(offset + header.num_boxes * 4 * box_size(header.box_type));
+            layout.total = offset;
+            return layout;
+        }
+
+        void write_padding(FILE* fid, size_t& offset)
+        {
+            static const char zeros[kAlign] = {0};
+            size_t aligned = align_up(offset);
+            if (aligned > offset)
+                CHECK_EQ(fwrite(zeros, 1, aligned - offset, fid), aligned - offset);
+            offset = aligned;
+        }
+
+        void write_bytes(FILE* fid, const void* data, size_t size, size_t& offset)
+        {
+            if (size > 0)
+                CHECK_EQ(fwrite(data, 1, size, fid), size) << "Error writing proposals";
+            offset += size;
+        }
+
+        struct Unmapper
+        {
+            explicit Unmapper(size_t size) : size(size) {}
+            void operator()(void* addr) const {munmap(addr, size);}
+            size_t size;
+        };
+
+        // Where the conversion of a .mat file is kept; the size and
+        // modification time of the .mat select a new file when it changes
+        std::string converted_path(const std::string& mat_path)
+        {
+            struct stat sb;
+            CHECK(stat(mat_path.c_str(), &sb) == 0) << "Cannot open " << mat_path;
+            std::string name = mat_path.substr(mat_path.find_last_of('/') + 1);
+            if (name.size() > 4 && name.compare(name.size() - 4, 4, ".mat") == 0)
+                name.resize(name.size() - 4);
+            char suffix[64];
+            snprintf(suffix, sizeof(suffix), "_%llx_%llx.proposals",
+                    (unsigned long long)sb.st_size, (unsigned long long)sb.st_mtime);
+            return "data/cache/" + name + suffix;
+        }
+    }
+
+    ProposalStore::ProposalStore()
+        : num_images_(0), box_type_(kFloat32), offsets_(NULL), boxes_(NULL)
+    {
+    }
+
+    ProposalStore::~ProposalStore()
+    {
+    }
+
+    bool ProposalStore::is_proposal_file(const std::string& path)
+    {
+        std::ifstream infile(path.c_str(), std::ios::binary);
+        char magic[sizeof(kMagic)];
+        return infile.read(magic, sizeof(magic)) &&
+            memcmp(magic, kMagic, sizeof(kMagic)) == 0;
+    }
+
+    void ProposalStore::open(const std::string& path)
+    {
+        std::string store_path = path;
+        if (!is_proposal_file(path))
+        {
+            store_path = converted_path(path);
+            if (!is_proposal_file(store_path))
+            {
+                struct stat sb;
+                if (!(stat("data/cache", &sb) == 0 && S_ISDIR(sb.st_mode)))
+                {
+                    int mkflag = mkdir("data/cache", S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
+                    CHECK(mkflag != -1) << "Error creating directory";
+                }
+                LOG(INFO) << "Converting object proposals " << path << " to " << store_path;
+                convert_mat(path, store_path);
+            }
+        }
+
+        int fd = ::open(store_path.c_str(), O_RDONLY);
+        CHECK_GE(fd, 0) << "Cannot open " << store_path;
+        struct stat sb;
+        CHECK(fstat(fd, &sb) == 0 && sb.st_size >= sizeof(ProposalHeader))
+            << "Corrupt proposal file " << store_path;
+        void* addr = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        CHECK(addr != MAP_FAILED) << "Cannot map " << store_path;
+        storage_.reset(addr, Unmapper(sb.st_size));
+        const char* base = static_cast<const char*>(addr);
+        const ProposalHeader* header = reinterpret_cast<const ProposalHeader*>(base);
+        CHECK(memcmp(header->magic, kMagic, sizeof(kMagic)) == 0 &&
+              header->version == kVersion &&
+              header->header_size == sizeof(ProposalHeader) &&
+              (header->box_type == kFloat32 || header->box_type == kInt16) &&
+              header->file_size == sb.st_size &&
+              compute_layout(*header).total == sb.st_size)
+            << "Corrupt or outdated proposal file " << store_path;
+        ProposalLayout layout = compute_layout(*header);
+        num_images_ = header->num_images;
+        box_type_ = header->box_type;
+        offsets_ = reinterpret_cast<const int64_t*>(base + layout.offsets);
+        boxes_ = base + layout.boxes;
+        CHECK_EQ(offsets_[num_images_], header->num_boxes)
+            << "Corrupt proposal file " << store_path;
+        LOG(INFO) << "Mapped " << header->num_boxes << " proposals of "
+            << num_images_ << " images from " << store_path;
+    }
+
+    void ProposalStore::get_boxes(int i, float* boxes) const
+    {
+        CHECK_GE(i, 0);
+        CHECK_LT(i, num_images_);
+        const int64_t begin = 4 * offsets_[i];
+        const int64_t end = 4 * offsets_[i + 1];
+        if (box_type_ == kInt16)
+        {
+            const int16_t* src = static_cast<const int16_t*>(boxes_);
+            for (int64_t k = begin; k < end; k ++)
+                *boxes ++ = src[k];
+        }
+        else
+        {
+            const float* src = static_cast<const float*>(boxes_);
+            std::copy(src + begin, src + end, boxes);
+        }
+    }
+
+    void ProposalStore::write(const std::string& path,
+            const std::vector<int64_t>& offsets,
+            const std::vector<float>& boxes)
+    {
+        CHECK_GT(offsets.size(), 0);
+        CHECK_EQ(4 * offsets.back(), boxes.size());
+        // Selective search boxes are integers, which int16 holds in half
+        // the space
+        bool fits_int16 = true;
+        for (size_t k = 0; k < boxes.size() && fits_int16; k ++)
+            fits_int16 = boxes[k] == std::floor(boxes[k]) &&
+                boxes[k] >= -32768 && boxes[k] <= 32767;
+
+        ProposalHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, kMagic, sizeof(kMagic));
+        header.version = kVersion;
+        header.header_size = sizeof(ProposalHeader);
+        header.num_images = offsets.size() - 1;
+        header.num_boxes = offsets.back();
+        header.box_type = fits_int16 ? kInt16 : kFloat32;
+        header.file_size = compute_layout(header).total;
+
+        std::string tmp_path = path + ".tmp";
+        FILE* fid = fopen(tmp_path.c_str(), "wb");
+        CHECK(fid) << "Cannot create " << tmp_path;
+        size_t offset = 0;
+        write_bytes(fid, &header, sizeof(header), offset);
+        write_padding(fid, offset);
+        write_bytes(fid, offsets.data(), offsets.size() * sizeof(int64_t), offset);
+        write_padding(fid, offset);
+        if (fits_int16)
+        {
+            std::vector<int16_t> packed(boxes.begin(), boxes.end());
+            write_bytes(fid, packed.data(), packed.size() * sizeof(int16_t), offset);
+        }
+        else
+        {
+            write_bytes(fid, boxes.data(), boxes.size() * sizeof(float), offset);
+        }
+        write_padding(fid, offset);
+        // A write error may only show when the buffer is flushed
+        if (fclose(fid) != 0)
+        {
+            unlink(tmp_path.c_str());
+            LOG(FATAL) << "Cannot write " << tmp_path;
+        }
+        CHECK_EQ(offset, header.file_size) << "Proposal file layout mismatch";
+        CHECK(rename(tmp_path.c_str(), path.c_str()) == 0)
+            << "Cannot move proposals into place at " << path;
+    }
+
+    void ProposalStore::convert_mat(const std::string& mat_path,
+            const std::string& path)
+    {
+        mat_t* matfp = Mat_Open(mat_path.c_str(), MAT_ACC_RDONLY);
+        CHECK(matfp) << "Error opening the mat file " << mat_path;
+        matvar_t* mat_boxes = Mat_VarRead(matfp, (char*)"boxes");
+        CHECK(mat_boxes) << "Error reading boxes";
+
+        unsigned num_cell = 1;
+        for (int i = 0; i < mat_boxes->rank; i ++)
+            num_cell *= mat_boxes->dims[i];
+        std::vector<int64_t> offsets(num_cell + 1, 0);
+        for (int i = 0; i < num_cell; i ++)
+        {
+            matvar_t* cell = Mat_VarGetCell(mat_boxes, i);
+            offsets[i + 1] = offsets[i] + (cell->rank > 0 ? cell->dims[0] : 0);
+        }
+        std::vector<float> boxes(4 * offsets[num_cell]);
+        for (int i = 0; i < num_cell; i ++)
+        {
+            matvar_t* cell = Mat_VarGetCell(mat_boxes, i);
+            const int num_ss = offsets[i + 1] - offsets[i];
+            CHECK(num_ss == 0 || (cell->rank == 2 && cell->dims[1] == 4 &&
+                                  cell->class_type == MAT_C_DOUBLE))
+                << "Proposals of image " << i << " should be [n][4] doubles";
+            const double* cell_data = static_cast<const double*>(cell->data);
+            float* ss_boxes = &boxes[4 * offsets[i]];
+            for (int j = 0; j < num_ss; j ++)
+            {
+                ss_boxes[4 * j] = cell_data[j + num_ss] - 1;
+                ss_boxes[4 * j + 1] = cell_data[j] - 1;
+                ss_boxes[4 * j + 2] = cell_data[j + 3 * num_ss] - 1;
+                ss_boxes[4 * j + 3] = cell_data[j + 2 * num_ss] - 1;
+            }
+        }
+        Mat_VarFree(mat_boxes);
+        Mat_Close(matfp);
+        write(path, offsets, boxes);
+    }
+}
@@ -4,20 +4,316 @@
 #include <fstream>
 #include <stdio.h>
 #include <map>
-#include "caffe/3rdparty/matio.h"
+#include "caffe/util/proposal_store.hpp"
 #include <math.h>
 
 #include <sys/stat.h>
 #include <limits>
 #include <algorithm>
+#include <boost/bind.hpp>
 #include <glog/logging.h>
 #include <opencv2/core/core.hpp>
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/highgui/highgui_c.h>
 #include <opencv2/imgproc/imgproc.hpp>
 
+#include "caffe/util/bbox_geometry.hpp"
+#include "caffe/util/thread_pool.hpp"
+
 namespace caffe
 {
+    namespace
+    {
+        // Storage of a roidb built in memory
+        struct ROIDBArrays
+        {
+            std::vector<int64_t> image_offsets;
+            std::vector<int> num_gt;
+            std::vector<unsigned char> flipped;
+            std::vector<int> sizes;
+            std::vector<float> boxes;
+            std::vector<int> gt_index;
+            std::vector<int> label;
+            std::vector<float> max_overlap;
+            std::vector<float> targets;
+            std::vector<double> means;
+            std::vector<double> stds;
+        };
+
+        // Reads the frame size from the SOF marker of a JPEG file without
+        // decoding the image
+        bool read_jpeg_size(const std::string& path, int& width, int& height)
+        {
+            FILE* fid = fopen(path.c_str(), "rb");
+            if (!fid)
+                return false;
+            bool found = false;
+            if (fgetc(fid) == 0xFF && fgetc(fid) == 0xD8)
+            {
+                while (!found)
+                {
+                    int marker = fgetc(fid);
+                    if (marker != 0xFF)
+                        break;
+                    while (marker == 0xFF)
+                        marker = fgetc(fid);
+                    // End of image or start of scan: no frame header before
+                    if (marker == EOF || marker == 0xD9 || marker == 0xDA)
+                        break;
+                    // Markers without a payload
+                    if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7))
+                        continue;
+                    unsigned char buf[7];
+                    if (fread(buf, 1, 2, fid) != 2)
+                        break;
+                    int length = (buf[0] << 8) | buf[1];
+                    if (length < 2)
+                        break;
+                    // SOF0..SOF15, except DHT, JPG and DAC which share the range
+                    if (marker >= 0xC0 && marker <= 0xCF &&
+                        marker != 0xC4 && marker != 0xC8 && marker != 0xCC)
+                    {
+                        if (length < 7 || fread(buf, 1, 5, fid) != 5)
+                            break;
+                        height = (buf[1] << 8) | buf[2];
+                        width = (buf[3] << 8) | buf[4];
+                        found = width > 0 && height > 0;
+                        break;
+                    }
+                    if (fseek(fid, length - 2, SEEK_CUR) != 0)
+                        break;
+                }
+            }
+            fclose(fid);
+            return found;
+        }
+
+        // State shared by the per-image stages of roi_data_extract, each of
+        // which runs on the thread pool and only writes the slices of the
+        // images it is given
+        struct ExtractContext
+        {
+            ROIDataExtractor* extractor;
+            std::string dir_imgs;
+            std::string path_annotation;
+            std::vector<std::string> list_imgs;
+            std::map<std::string, int> class_to_ind;
+            int num_imgs;
+            int num_images;
+            int num_classes;
+            ProposalStore proposals;
+            // per original image
+            std::vector<std::vector<float> > gt_boxes;
+            std::vector<std::vector<int> > gt_classes;
+            std::vector<int> widths;
+            std::vector<int> heights;
+            ROIDBArrays* arrays;
+            // per-block partial sums of the regression targets, reduced in
+            // block order so the statistics do not depend on the thread count
+            int num_blocks;
+            std::vector<std::vector<int> > class_counts;
+            std::vector<std::vector<double> > sums;
+            std::vector<std::vector<double> > squared_sums;
+        };
+
+        void parse_annotations(ExtractContext* ctx, int begin, int end)
+        {
+            for (int i = begin; i < end; i ++)
+            {
+                const std::string path = ctx->path_annotation + "/" + ctx->list_imgs[i] + ".xml";
+                pugi::xml_document doc;
+                pugi::xml_parse_result result = doc.load_file(path.c_str());
+                CHECK(result.status == 0) << path;
+                pugi::xml_node size = doc.first_child().child("size");
+                int width = atoi(size.child_value("width"));
+                int height = atoi(size.child_value("height"));
+                if (width <= 0 || height <= 0)
+                {
+                    const std::string img_path = ctx->dir_imgs + "/" + ctx->list_imgs[i] + ".jpg";
+                    if (!read_jpeg_size(img_path, width, height))
+                    {
+                        cv::Mat img = cv::imread(img_path);
+                        CHECK(img.data) << "Cannot open " << img_path;
+                        width = img.cols;
+                        height = img.rows;
+                    }
+                }
+                ctx->widths[i] = width;
+                ctx->heights[i] = height;
+                std::vector<std::string> labels;
+                std::vector<std::vector<double> > bndboxes;
+                ctx->extractor->getAttribute(doc.first_child(), "object", labels, bndboxes);
+                if (labels.size() != bndboxes.size())
+                    continue;
+                for (int j = 0; j < labels.size(); j ++)
+                {
+                    std::map<std::string, int>::const_iterator it = ctx->class_to_ind.find(labels[j]);
+                    ctx->gt_classes[i].push_back(it == ctx->class_to_ind.end() ? 0 : it->second);
+                    ctx->gt_boxes[i].insert(ctx->gt_boxes[i].end(), bndboxes[j].begin(), bndboxes[j].end());
+                }
+            }
+        }
+
+        // Decodes the proposals of each image behind its ground-truth boxes
+        // and matches them to the ground truth
+        void parse_proposals(ExtractContext* ctx, int begin, int end)
+        {
+            ROIDBArrays* arrays = ctx->arrays;
+            std::vector<float> overlaps;
+            for (int i = begin; i < end; i ++)
+            {
+                const int64_t offset = arrays->image_offsets[i];
+                const int num_gt = arrays->num_gt[i];
+                float* boxes = &arrays->boxes[4 * offset];
+                int* gt_index = &arrays->gt_index[offset];
+                int* label = &arrays->label[offset];
+                float* max_overlap = &arrays->max_overlap[offset];
+                for (int j = 0; j < num_gt; j ++)
+                {
+                    std::copy(&ctx->gt_boxes[i][4 * j], &ctx->gt_boxes[i][4 * j] + 4, boxes + 4 * j);
+                    gt_index[j] = j;
+                    label[j] = ctx->gt_classes[i][j];
+                    max_overlap[j] = 1;
+                }
+
+                const int num_ss = ctx->proposals.num_boxes(i);
+                float *ss_boxes = boxes + 4 * num_gt;
+                ctx->proposals.get_boxes(i, ss_boxes);
+
+                ctx->extractor->bbox_overlaps(ss_boxes, num_ss, boxes, num_gt, overlaps);
+                // Running argmax over the rows of the num_gt x num_ss matrix
+                std::fill(gt_index + num_gt, gt_index + num_gt + num_ss, 0);
+                std::fill(max_overlap + num_gt, max_overlap + num_gt + num_ss, 0.f);
+                if (num_gt > 0)
+                    std::copy(overlaps.begin(), overlaps.begin() + num_ss, max_overlap + num_gt);
+                for (int k = 1; k < num_gt; k ++)
+                {
+                    const float* row = &overlaps[k * num_ss];
+                    for (int j = 0; j < num_ss; j ++)
+                    {
+                        if (row[j] > max_overlap[num_gt + j])
+                        {
+                            gt_index[num_gt + j] = k;
+                            max_overlap[num_gt + j] = row[j];
+                        }
+                    }
+                }
+                for (int j = 0; j < num_ss; j ++)
+                    label[num_gt + j] = max_overlap[num_gt + j] > 0 ?
+                        ctx->gt_classes[i][gt_index[num_gt + j]] : 0;
+            }
+        }
+
+        // Fills in the horizontally-flipped copy of each image
+        void flip_images(ExtractContext* ctx, int begin, int end)
+        {
+            ROIDBArrays* arrays = ctx->arrays;
+            for (int i = begin; i < end; i ++)
+            {
+                const int width = ctx->widths[i];
+                const int64_t src = arrays->image_offsets[i];
+                const int64_t dst = arrays->image_offsets[i + ctx->num_imgs];
+                const int size = arrays->image_offsets[i + 1] - src;
+                std::copy(&arrays->gt_index[src], &arrays->gt_index[src] + size, &arrays->gt_index[dst]);
+                std::copy(&arrays->label[src], &arrays->label[src] + size, &arrays->label[dst]);
+                std::copy(&arrays->max_overlap[src], &arrays->max_overlap[src] + size, &arrays->max_overlap[dst]);
+                // The image is mirrored around its vertical axis only, so
+                // x1 and x2 swap and the y coordinates are unchanged
+                const float* box = &arrays->boxes[4 * src];
+                float* flipped_box = &arrays->boxes[4 * dst];
+                for (int k = 0; k < size; k ++, box += 4, flipped_box += 4)
+                {
+                    flipped_box[0] = width - box[2] - 1;
+                    flipped_box[1] = box[1];
+                    flipped_box[2] = width - box[0] - 1;
+                    flipped_box[3] = box[3];
+                }
+            }
+        }
+
+        // Computes the regression targets of the images in the given blocks
+        // and accumulates their per-class sums
+        void compute_targets(ExtractContext* ctx, int block_begin, int block_end)
+        {
+            const double EPS = std::numeric_limits<double>::epsilon();
+            ROIDBArrays* arrays = ctx->arrays;
+            for (int b = block_begin; b < block_end; b ++)
+            {
+                std::vector<int>& class_counts = ctx->class_counts[b];
+                std::vector<double>& sums = ctx->sums[b];
+                std::vector<double>& squared_sums = ctx->squared_sums[b];
+                class_counts.assign(ctx->num_classes, 0);
+                sums.assign(4 * ctx->num_classes, 0);
+                squared_sums.assign(4 * ctx->num_classes, 0);
+                const int image_begin = int64_t(ctx->num_images) * b / ctx->num_blocks;
+                const int image_end = int64_t(ctx->num_images) * (b + 1) / ctx->num_blocks;
+                for (int i = image_begin; i < image_end; i ++)
+                {
+                    const int64_t begin = arrays->image_offsets[i];
+                    const int64_t end = arrays->image_offsets[i + 1];
+                    for (int64_t ind = begin; ind < end; ind ++)
+                    {
+                        // Examples for which we try to make predictions
+                        if (arrays->max_overlap[ind] < 0.5)
+                            continue;
+                        const float* ex_box = &arrays->boxes[4 * ind];
+                        double ex_width = ex_box[2] - ex_box[0] + EPS;
+                        double ex_height = ex_box[3] - ex_box[1] + EPS;
+                        double ex_ctr_x = ex_box[0] + 0.5 * ex_width;
+                        double ex_ctr_y = ex_box[1] + 0.5 * ex_height;
+
+                        const float* gt_box = &arrays->boxes[4 * (begin + arrays->gt_index[ind])];
+                        double gt_width = gt_box[2] - gt_box[0] + EPS;
+                        double gt_height = gt_box[3] - gt_box[1] + EPS;
+                        double gt_ctr_x = gt_box[0] + 0.5 * gt_width;
+                        double gt_ctr_y = gt_box[1] + 0.5 * gt_height;
+
+                        double target[4];
+                        target[0] = (gt_ctr_x - ex_ctr_x) / ex_width;
+                        target[1] = (gt_ctr_y - ex_ctr_y) / ex_height;
+                        target[2] = log(gt_width / ex_width);
+                        target[3] = log(gt_height / ex_height);
+                        const int cls = arrays->label[ind];
+                        for (int k = 0; k < 4; k ++)
+                        {
+                            arrays->targets[4 * ind + k] = target[k];
+                            if (cls > 0)
+                            {
+                                sums[4 * cls + k] += target[k];
+                                squared_sums[4 * cls + k] += target[k] * target[k];
+                            }
+                        }
+                        if (cls > 0)
+                            class_counts[cls] += 1;
+                    }
+                }
+            }
+        }
+
+        void normalize_targets(ExtractContext* ctx, int begin, int end)
+        {
+            ROIDBArrays* arrays = ctx->arrays;
+            for (int64_t ind = arrays->image_offsets[begin]; ind < arrays->image_offsets[end]; ind ++)
+            {
+                const int cls = arrays->label[ind];
+                if (arrays->max_overlap[ind] < 0.5 || cls <= 0)
+                    continue;
+                for (int k = 0; k < 4; k ++)
+                {
+                    float& target = arrays->targets[4 * ind + k];
+                    target = (target - arrays->means[4 * cls + k]) / arrays->stds[4 * cls + k];
+                }
+            }
+        }
+    }
+
+    ROIDB::ROIDB()
+        : num_images(0), num_classes(0), num_boxes(0),
+          image_offsets(NULL), num_gt(NULL), flipped(NULL), sizes(NULL),
+          boxes(NULL), gt_index(NULL), label(NULL), max_overlap(NULL),
+          targets(NULL), means(NULL), stds(NULL)
+    {
+    }
     
     ROIDataExtractor::ROIDataExtractor(std::string dir_imgs,
                          std::string path_img_list,
@@ -37,16 +333,41 @@ namespace caffe
     {
 
     }
+
+    void ROIDataExtractor::write_bbox_mean_std(const ROIDB& roidb)
+    {
+        struct stat sb;
+        if(stat("data/cache", &sb) == 0 && S_ISDIR(sb.st_mode))
+            DLOG(INFO) << "Directory of data/cache exists";
+        else
+        {
+            int mkflag = mkdir("data/cache", S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
+            CHECK(mkflag != -1) << "Error creating directory";
+        }
+        int num_classes = roidb.num_classes;
+        FILE* fid = fopen("data/cache/mean_std.txt", "wb");
+        CHECK(fid) << "Cannot create data/cache/mean_std.txt";
+        fwrite(&num_classes, sizeof(int), 1, fid);
+        for(int i = 0; i < num_classes; i ++)
+        {
+            fwrite(roidb.means + 4 * i, sizeof(double), 4, fid);
+            fwrite(roidb.stds + 4 * i, sizeof(double), 4, fid);
+        }
+        fclose(fid);
+    }
     
     void ROIDataExtractor::getAttribute(pugi::xml_node node,
 		std::string name,
 		std::vector<std::string> &labels,
-		std::vector<std::vector<double> > &bndboxes)
+		std::vector<std::vector<double> > &bndboxes,
+		std::vector<int>* difficult)
      {
 	for(pugi::xml_node subnode = node.first_child(); subnode; subnode = subnode.next_sibling())
 	{
 		if(strcmp(subnode.name(), name.c_str()) == 0)
 		{
+			if(difficult)
+				difficult->push_back(atoi(subnode.child_value("difficult")));
 			for(pugi::xml_node _node = subnode.first_child(); _node; _node = _node.next_sibling())
 			{
 				if(strcmp(_node.name(), "name") == 0)
@@ -75,357 +396,145 @@ namespace caffe
 				}
 			}
 		}
-		getAttribute(subnode, name, labels, bndboxes);
+		getAttribute(subnode, name, labels, bndboxes, difficult);
 	}
     }
     
-    void ROIDataExtractor::bbox_overlaps(const std::vector<std::vector<double> > &boxes,
-	const std::vector<std::vector<double> > &gt_boxes,
-	std::vector<std::vector<double> > &overlaps)
+    void ROIDataExtractor::bbox_overlaps(const float* boxes, int num_boxes,
+	const float* gt_boxes, int num_gt,
+	std::vector<float> &overlaps)
     {
-	if (boxes.size() == 0 || gt_boxes.size() == 0)
-		return;
-	overlaps.resize(boxes.size());
-	for (int i = 0; i < boxes.size(); i++)
-	{
-		double box_area = (boxes[i][2] - boxes[i][0] + 1) * (boxes[i][3] - boxes[i][1] + 1);
-		for (int j = 0; j < gt_boxes.size(); j ++)
-		{
-			double gt_box_area = (gt_boxes[j][2] - gt_boxes[j][0] + 1) * (gt_boxes[j][3] - gt_boxes[j][1] + 1);
-			double left = std::max(boxes[i][0], gt_boxes[j][0]), right = std::min(boxes[i][2], gt_boxes[j][2]);
-			double top = std::max(boxes[i][1], gt_boxes[j][1]), bottom = std::min(boxes[i][3], gt_boxes[j][3]);
-			double dx = std::max(right - left + 1, 0.0);
-			double dy = std::max(bottom - top + 1, 0.0);
-
-			double overlap_area = dx * dy;
-			double ratio = overlap_area / (box_area + gt_box_area - overlap_area);
-			overlaps[i].push_back(ratio);
-		}
-	}
+	overlaps.resize(num_gt * num_boxes);
+	caffe_cpu_iou(SoABoxes(gt_boxes, num_gt), SoABoxes(boxes, num_boxes), overlaps.data());
     }
-    
-    
-    bool ROIDataExtractor::roi_data_extract(std::vector<ROI>& roidb)
+
+
+    bool ROIDataExtractor::roi_data_extract(ROIDB& roidb)
     {
-        std::vector<std::string> list_imgs;
+        ExtractContext ctx;
+        ctx.extractor = this;
+        ctx.dir_imgs = dir_imgs_;
+        ctx.path_annotation = path_annotation_;
 	std::ifstream infile(path_img_list_.c_str());
 	std::string name;
 	while(infile >> name)
-		list_imgs.push_back(name);
+		ctx.list_imgs.push_back(name);
 
         double EPS = std::numeric_limits<double>::epsilon();
 	//map class of images to index
-	std::map<std::string, int> class_to_ind;
-	std::map<int, std::string> ind_to_class;
 	std::ifstream inclasses(path_classes_list_.c_str());
 	std::string class_name;
 	int ind = 0;
 	while(inclasses >> class_name)
-	{
-		class_to_ind[class_name] = ind;
-		ind_to_class[ind] = class_name;
-		ind ++;
-	}
+		ctx.class_to_ind[class_name] = ind ++;
+	const int num_classes = ind;
+	const int num_imgs = ctx.list_imgs.size();
+	const int num_images = use_flipped_ ? 2 * num_imgs : num_imgs;
+	ctx.num_imgs = num_imgs;
+	ctx.num_images = num_images;
+	ctx.num_classes = num_classes;
 
-	
         LOG(INFO) << "Parse xml files";
-	std::vector<ROI> gt_roidb(list_imgs.size());
-	for(int i = 0; i < list_imgs.size(); i ++)
-	{
-		pugi::xml_document doc;
-		pugi::xml_parse_result result = doc.load_file((path_annotation_ + "/" + list_imgs[i] + ".xml").c_str());
-                CHECK(result.status == 0) << std::string(path_annotation_ + "/" + list_imgs[i] + ".xml");
-		std::vector<std::string> labels;
-		std::vector<std::vector<double> > bndboxes;
-		getAttribute(doc.first_child(), "object", labels, bndboxes);
-		if (labels.size() != bndboxes.size())
-			continue;
-		ROI roi;
-		roi.boxes = bndboxes;
-		std::vector<int> gt_classes;
-		for(int j =0 ;j < labels.size(); j ++)
-		{
-			gt_classes.push_back(class_to_ind[labels[j]]);
-		}
-		roi.gt_classes = gt_classes;
-		for(int j = 0; j < labels.size(); j ++)
-		{
-			double temp[3];
-			temp[0] = (double)j;
-			temp[1] = (double)class_to_ind[labels[j]];
-			temp[2] = (double)1;
-			//roi.gt_overlaps.push_back(std::vector<double>((double)j, (double)class_to_ind[labels[j]], 1));
-			roi.gt_overlaps.push_back(std::vector<double>(temp, temp+3));
-		}
-		roi.flipped = false;
-
-		gt_roidb[i] = roi;
-	}
+	ctx.gt_boxes.resize(num_imgs);
+	ctx.gt_classes.resize(num_imgs);
+	ctx.widths.assign(num_imgs, 0);
+	ctx.heights.assign(num_imgs, 0);
+	caffe_parallel_for(num_imgs, boost::bind(&parse_annotations, &ctx, _1, _2));
 
-	//read region proposals saved as a mat format file
-	mat_t *matfp = Mat_Open(path_selective_search_mat_.c_str(), MAT_ACC_RDONLY);
-        CHECK(matfp) << "Error opening the mat file";
-        
-	matvar_t *mat_boxes = Mat_VarRead(matfp, (char*)"boxes");
-        CHECK(mat_boxes) << "Error reading boxes";
-        
-	unsigned num_cell = 1;
-	for (int i = 0; i < mat_boxes->rank; i++)
-		num_cell *= mat_boxes->dims[i];
+	//map the region proposals, converting them on first use if they are
+	//a mat format file
+	ctx.proposals.open(path_selective_search_mat_);
+        CHECK(num_imgs == ctx.proposals.num_images()) << "Dimensions do not match between ground truth and object proposal";
 
-        LOG(INFO) << "Parse object proposals";
-	std::vector<ROI> ss_roidb(num_cell);
-	for (int i = 0; i < num_cell; i++)
+	// Every image holds its ground-truth boxes followed by its proposals;
+	// the flipped copies repeat the layout of the originals
+	boost::shared_ptr<ROIDBArrays> arrays(new ROIDBArrays);
+	ctx.arrays = arrays.get();
+	arrays->image_offsets.resize(num_images + 1);
+	arrays->num_gt.resize(num_images);
+	arrays->flipped.resize(num_images);
+	arrays->sizes.resize(2 * num_images);
+	arrays->image_offsets[0] = 0;
+	for (int i = 0; i < num_images; i ++)
 	{
-		matvar_t *cell = Mat_VarGetCell(mat_boxes, i);
-		unsigned cell_shape[2] = { 0, 0 };
-		for (int j = 0; j < cell->rank; j++)
-			cell_shape[j] = cell->dims[j];
-		const double *cell_data = static_cast<const double*>(cell->data);
-		ROI roidb;
-		roidb.boxes.resize(cell_shape[0]);
-		roidb.gt_classes.resize(cell_shape[0]);
-		roidb.flipped = false;
-		for (int j = 0; j < cell_shape[0]; j++)
-		{
-			double temp[4];
-			temp[0] = cell_data[j + cell_shape[0]] - 1;
-			temp[1] = cell_data[j] - 1;
-			temp[2] = cell_data[j + 3 * cell_shape[0]] - 1;
-			temp[3] = cell_data[j + 2 * cell_shape[0]] - 1;
-			roidb.boxes[j] = std::vector<double>(std::vector<double>(temp, temp+4));
-		}
-		ss_roidb[i] = roidb;
-	}
-        CHECK(gt_roidb.size() == ss_roidb.size()) << "Dimensions do not match between ground truth and object proposal";
-	
-        LOG(INFO) << "Compute overlaps";
-        for (int i = 0; i < ss_roidb.size(); i ++)
-	{
-		std::vector<std::vector<double> > overlaps;
-		bbox_overlaps(ss_roidb[i].boxes, gt_roidb[i].boxes, overlaps);
-		int num_gt = gt_roidb[i].boxes.size();
-		ss_roidb[i].gt_overlaps.resize(overlaps.size());
-		for (int j = 0; j < overlaps.size(); j ++)
-		{
-			int ind = 0;
-			double val = overlaps[j][ind];
-			for (int k = 1; k < num_gt; k ++)
-			{
-				if (overlaps[j][k] > val)
-				{
-					ind = k;
-					val = overlaps[j][ind];
-				}
-			}
-			if (val > 0)
-			{
-				double temp[3];
-				temp[0] = (double)ind;
-				temp[1] = (double)gt_roidb[i].gt_classes[ind];
-				temp[2] = val;
-				ss_roidb[i].gt_overlaps[j] = std::vector<double>(temp, temp+3);
-			}
-			else
-			{
-				double temp[3];
-				temp[0] = (double)ind;
-				temp[1] = 0;
-				temp[2] = val;
-				ss_roidb[i].gt_overlaps[j] = std::vector<double>(temp, temp+3);
-			}
-			
-		}
+		const int k = i % num_imgs;
+		arrays->num_gt[i] = ctx.gt_classes[k].size();
+		arrays->flipped[i] = i >= num_imgs;
+		arrays->sizes[2 * i] = ctx.widths[k];
+		arrays->sizes[2 * i + 1] = ctx.heights[k];
+		arrays->image_offsets[i + 1] = arrays->image_offsets[i] + arrays->num_gt[i] + ctx.proposals.num_boxes(k);
 	}
+	const int64_t num_boxes = arrays->image_offsets[num_images];
+	arrays->boxes.resize(4 * num_boxes);
+	arrays->gt_index.resize(num_boxes);
+	arrays->label.resize(num_boxes);
+	arrays->max_overlap.resize(num_boxes);
+	arrays->targets.assign(4 * num_boxes, 0.f);
 
-	for (int i = 0; i < ss_roidb.size(); i ++)
-	{
-		ss_roidb[i].image = list_imgs[i];
-		for (int j = gt_roidb[i].gt_classes.size() - 1; j >= 0;  j--)
-		{
-			ss_roidb[i].boxes.insert(ss_roidb[i].boxes.begin(), gt_roidb[i].boxes[j]);
-			ss_roidb[i].gt_classes.insert(ss_roidb[i].gt_classes.begin(), gt_roidb[i].gt_classes[j]);
-			ss_roidb[i].gt_overlaps.insert(ss_roidb[i].gt_overlaps.begin(), gt_roidb[i].gt_overlaps[j]);
-		}
-	}
+        LOG(INFO) << "Parse object proposals and compute overlaps";
+	caffe_parallel_for(num_imgs, boost::bind(&parse_proposals, &ctx, _1, _2));
 
         if(use_flipped_)
         {
         	LOG(INFO) << "Appending horizontally-flipped training examples";
-            int num_roidb = ss_roidb.size();
-            ss_roidb.resize(2*num_roidb);
-            for(int i = 0; i < num_roidb; i ++)
-            {
-            	ss_roidb[i+num_roidb]= ss_roidb[i];
-            	ss_roidb[i+num_roidb].flipped = true;
-            	cv::Mat img = cv::imread(dir_imgs_ + "/" + ss_roidb[i].image + ".jpg");
-                CHECK(img.data) << "Cannot open " << std::string(dir_imgs_ + "/" + ss_roidb[i].image + ".jpg");
-            	int height = img.rows;
-            	int width = img.cols;
-                for(int k = 0; k < ss_roidb[i].boxes.size(); k ++)
-                {
-                    ss_roidb[i+num_roidb].boxes[k][0] = width - ss_roidb[i+num_roidb].boxes[k][0] - 1;
-                    ss_roidb[i+num_roidb].boxes[k][2] = width - ss_roidb[i+num_roidb].boxes[k][2] - 1;
-                    ss_roidb[i+num_roidb].boxes[k][1] = height - ss_roidb[i+num_roidb].boxes[k][1] - 1;
-                    ss_roidb[i+num_roidb].boxes[k][3] = height - ss_roidb[i+num_roidb].boxes[k][3] - 1;
-                }
-            }
+        	caffe_parallel_for(num_imgs, boost::bind(&flip_images, &ctx, _1, _2));
         }
 
-	//compute regression values of rois for each image
+	//compute regression values of rois for each image, and the mean and
+	//std of the regression for each category
         LOG(INFO) << "Compute regression target";
-	for (int i = 0; i < ss_roidb.size(); i ++)
-	{
-		ss_roidb[i].targets.resize(ss_roidb[i].boxes.size());
-		// Indices of ground-truth ROIs
-		std::vector<int> gt_inds;
-		int ind = 0;
-		do 
-		{
-			gt_inds.push_back(ind++);
-		} while ((int)ss_roidb[i].gt_overlaps[ind][2] == 1);
-
-		// Indices of example for which we try to make predictions
-		std::vector<int> ex_inds;
-                std::vector<int> no_ex_inds;
-		for (int ind = 0; ind < ss_roidb[i].gt_overlaps.size(); ind ++)
-		{
-			if (ss_roidb[i].gt_overlaps[ind][2] >= 0.5)
-				ex_inds.push_back(ind);
-                        else
-                            no_ex_inds.push_back(ind);
-		}
-		for (int j = 0; j < ex_inds.size(); j ++)
-		{
-			int ind = ex_inds[j];
-			std::vector<double> *ex_box = &(ss_roidb[i].boxes[ind]);
-			double ex_width = (*ex_box)[2] - (*ex_box)[0] + EPS;
-			double ex_height = (*ex_box)[3] - (*ex_box)[1] + EPS;
-			double ex_ctr_x = (*ex_box)[0] + 0.5 * ex_width;
-			double ex_ctr_y = (*ex_box)[1] + 0.5 * ex_height;
-
-			int target_ind = ss_roidb[i].gt_overlaps[ind][0];
-			std::vector<double> *gt_box = &(ss_roidb[i].boxes[target_ind]);
-			double gt_width = (*gt_box)[2] - (*gt_box)[0] + EPS;
-			double gt_height = (*gt_box)[3] - (*gt_box)[1] + EPS;
-			double gt_ctr_x = (*gt_box)[0] + 0.5 * gt_width;
-			double gt_ctr_y = (*gt_box)[1] + 0.5 * gt_height;
-
-			double target_dx = (gt_ctr_x - ex_ctr_x) / ex_width;
-			double target_dy = (gt_ctr_y - ex_ctr_y) / ex_height;
-			double target_dw = log(gt_width / ex_width);
-			double target_dh = log(gt_height / ex_height);
-			double temp[5];
-			temp[0] = (double)ss_roidb[i].gt_overlaps[ind][1];
-			temp[1] = target_dx;
-			temp[2] = target_dy;
-			temp[3] = target_dw;
-			temp[4] = target_dh;
-			ss_roidb[i].targets[ind] = std::vector<double>(temp, temp+5);
-		}
-                for(int j = 0; j < no_ex_inds.size(); j ++)
-                {   
-                    int ind  = no_ex_inds[j];
-                    ss_roidb[i].targets[ind].resize(5);
-                }
-	}
-	//compute mean and std of regression for each categories
-	int num_classes = ind_to_class.size();
+	ctx.num_blocks = std::min(num_images, 256);
+	ctx.class_counts.resize(ctx.num_blocks);
+	ctx.sums.resize(ctx.num_blocks);
+	ctx.squared_sums.resize(ctx.num_blocks);
+	caffe_parallel_for(ctx.num_blocks, boost::bind(&compute_targets, &ctx, _1, _2));
 	std::vector<int> class_counts(num_classes);
-	std::vector<std::vector<double> > sums(num_classes), squared_sums(num_classes), means(num_classes), stds(num_classes);
-	for (int i = 0; i < num_classes; i ++)
-	{
-		sums[i].resize(4);
-		squared_sums[i].resize(4);
-		means[i].resize(4);
-		stds[i].resize(4);
-	}
-        
-        LOG(INFO) << "Compute mean and stdev";
-	for (int i = 0; i < ss_roidb.size(); i ++)
+	std::vector<double> sums(4 * num_classes), squared_sums(4 * num_classes);
+	for (int b = 0; b < ctx.num_blocks; b ++)
 	{
-		for (int j = 0; j < ss_roidb[i].targets.size(); j ++)
+		for (int i = 0; i < num_classes; i ++)
+			class_counts[i] += ctx.class_counts[b][i];
+		for (int i = 0; i < 4 * num_classes; i ++)
 		{
-			if (ss_roidb[i].targets[j].size() == 0)
-				continue;
-			std::vector<double> *target_ptr = &(ss_roidb[i].targets[j]);
-			int target_cls_ind = (*target_ptr)[0];
-			if (target_cls_ind > 0)
-			{
-				class_counts[target_cls_ind] += 1;
-				sums[target_cls_ind][0] += (*target_ptr)[1];
-				sums[target_cls_ind][1] += (*target_ptr)[2];
-				sums[target_cls_ind][2] += (*target_ptr)[3];
-				sums[target_cls_ind][3] += (*target_ptr)[4];
-
-				squared_sums[target_cls_ind][0] += (*target_ptr)[1] * (*target_ptr)[1];
-				squared_sums[target_cls_ind][1] += (*target_ptr)[2] * (*target_ptr)[2];
-				squared_sums[target_cls_ind][2] += (*target_ptr)[3] * (*target_ptr)[3];
-				squared_sums[target_cls_ind][3] += (*target_ptr)[4] * (*target_ptr)[4];
-			}
+			sums[i] += ctx.sums[b][i];
+			squared_sums[i] += ctx.squared_sums[b][i];
 		}
 	}
-	for (int i = 1; i < num_classes; i ++)
-	{
-		means[i][0] = sums[i][0] / class_counts[i];
-		means[i][1] = sums[i][1] / class_counts[i];
-		means[i][2] = sums[i][2] / class_counts[i];
-		means[i][3] = sums[i][3] / class_counts[i];
 
-		squared_sums[i][0] /= class_counts[i];
-		squared_sums[i][1] /= class_counts[i];
-		squared_sums[i][2] /= class_counts[i];
-		squared_sums[i][3] /= class_counts[i];
-	}
-
-        
+        LOG(INFO) << "Compute mean and stdev";
+	arrays->means.assign(4 * num_classes, 0);
+	arrays->stds.assign(4 * num_classes, 0);
 	for (int i = 1; i < num_classes; i ++)
 	{
-		stds[i][0] = sqrt(squared_sums[i][0] - means[i][0] * means[i][0] + EPS);
-		stds[i][1] = sqrt(squared_sums[i][1] - means[i][1] * means[i][1] + EPS);
-		stds[i][2] = sqrt(squared_sums[i][2] - means[i][2] * means[i][2] + EPS);
-		stds[i][3] = sqrt(squared_sums[i][3] - means[i][3] * means[i][3] + EPS);
-	}
-        struct stat sb;
-        if(stat("data/cache", &sb) == 0 && S_ISDIR(sb.st_mode))
-            DLOG(INFO) << "Directory of data/cache exists";
-        else
-        {
-            int mkflag = mkdir("data/cache", S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
-            CHECK(mkflag != -1) << "Error creating directory";
-        }
-        FILE* fid = fopen("data/cache/mean_std.txt", "wb");
-        fwrite(&num_classes, sizeof(int), 1, fid);
-        for(int i = 0; i < num_classes; i ++)
-        {
-            fwrite(means[i].data(), sizeof(double), 4, fid);
-            fwrite(stds[i].data(), sizeof(double), 4, fid);
-        }
-        fclose(fid);
-	for (int i = 0; i < ss_roidb.size(); i ++)
-	{
-		std::vector<std::vector<double> > *target = &(ss_roidb[i].targets);
-		int num_target = (*target).size();
-		for (int j = 0; j < num_target; j ++)
+		for (int k = 0; k < 4; k ++)
 		{
-			if ((*target)[j].size() == 0)
-				continue;
-			int ind_cls_target = int((*target)[j][0]);
-			if (ind_cls_target > 0)
-			{
-				(*target)[j][1] -= means[ind_cls_target][0];
-				(*target)[j][1] /= stds[ind_cls_target][0];
-				(*target)[j][2] -= means[ind_cls_target][1];
-				(*target)[j][2] /= stds[ind_cls_target][1];
-				(*target)[j][3] -= means[ind_cls_target][2];
-				(*target)[j][3] /= stds[ind_cls_target][2];
-				(*target)[j][4] -= means[ind_cls_target][3];
-				(*target)[j][4] /= stds[ind_cls_target][3];
-			}
+			double mean = sums[4 * i + k] / class_counts[i];
+			arrays->means[4 * i + k] = mean;
+			arrays->stds[4 * i + k] = sqrt(squared_sums[4 * i + k] / class_counts[i] - mean * mean + EPS);
 		}
 	}
-    LOG(INFO) << "Number of training examples: " << ss_roidb.size();
-        roidb = ss_roidb;
+	caffe_parallel_for(num_images, boost::bind(&normalize_targets, &ctx, _1, _2));
+
+        roidb.num_images = num_images;
+        roidb.num_classes = num_classes;
+        roidb.num_boxes = num_boxes;
+        roidb.images.resize(num_images);
+        for (int i = 0; i < num_images; i ++)
+            roidb.images[i] = ctx.list_imgs[i % num_imgs];
+        roidb.image_offsets = &arrays->image_offsets[0];
+        roidb.num_gt = &arrays->num_gt[0];
+        roidb.flipped = &arrays->flipped[0];
+        roidb.sizes = &arrays->sizes[0];
+        roidb.boxes = arrays->boxes.data();
+        roidb.gt_index = arrays->gt_index.data();
+        roidb.label = arrays->label.data();
+        roidb.max_overlap = arrays->max_overlap.data();
+        roidb.targets = arrays->targets.data();
+        roidb.means = &arrays->means[0];
+        roidb.stds = &arrays->stds[0];
+        roidb.storage = arrays;
+        write_bbox_mean_std(roidb);
+    LOG(INFO) << "Number of training examples: " << num_images;
         return true;
     }
 }
@@ -0,0 +1,95 @@
+#include <boost/functional/hash.hpp>
+#include <boost/unordered_map.hpp>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+#include "caffe/util/roi_projection.hpp"
+
+namespace caffe {
+
+namespace {
+
+// A roi rounded to the grid it is pooled on
+struct ROIKey {
+  int v[5];
+
+  bool operator==(const ROIKey& other) const {
+    return std::equal(v, v + 5, other.v);
+  }
+};
+
+struct ROIKeyHash {
+  size_t operator()(const ROIKey& key) const {
+    return boost::hash_range(key.v, key.v + 5);
+  }
+};
+
+}  // namespace
+
+void caffe_cpu_project_rois(const float* boxes, const int num_boxes,
+    const std::vector<float>& scales_factor, const int level_offset,
+    float* rois) {
+  const int num_scales = scales_factor.size();
+  const float area_ref = 224 * 224;
+  for (int i = 0; i < num_boxes; ++i) {
+    const float* box = boxes + 4 * i;
+    int level_id = 0;
+    if (num_scales > 1) {
+      const float area = (box[2] - box[0] + 1.0) * (box[3] - box[1] + 1.0);
+      float min_diff = FLT_MAX;
+      for (int j = 0; j < num_scales; ++j) {
+        const float diff = std::fabs(
+            area * scales_factor[j] * scales_factor[j] - area_ref);
+        if (diff < min_diff) {
+          level_id = j;
+          min_diff = diff;
+        }
+      }
+    }
+    rois[5 * i] = level_offset + level_id;
+    for (int k = 0; k < 4; ++k) {
+      rois[5 * i + k + 1] = box[k] * scales_factor[level_id];
+    }
+  }
+}
+
+int caffe_cpu_dedup_rois(float* rois, const int num_rois, const float scale,
+    int* rows) {
+  if (scale <= 0) {
+    for (int i = 0; i < num_rois; ++i) {
+      rows[i] = i;
+    }
+    return num_rois;
+  }
+  boost::unordered_map<ROIKey, int, ROIKeyHash> unique_rows(2 * num_rois);
+  int num_unique = 0;
+  for (int i = 0; i < num_rois; ++i) {
+    const float* roi = rois + 5 * i;
+    ROIKey key;
+    key.v[0] = roi[0];
+    for (int k = 1; k < 5; ++k) {
+      key.v[k] = round(roi[k] * scale);
+    }
+    std::pair<boost::unordered_map<ROIKey, int, ROIKeyHash>::iterator, bool>
+        inserted = unique_rows.insert(std::make_pair(key, num_unique));
+    rows[i] = inserted.first->second;
+    if (inserted.second) {
+      std::copy(roi, roi + 5, rois + 5 * num_unique);
+      ++num_unique;
+    }
+  }
+  return num_unique;
+}
+
+void caffe_cpu_gather_rows(const float* data, const int dim,
+    const int* rows, const int num, float* out) {
+  for (int i = 0; i < num; ++i) {
+    std::copy(data + dim * rows[i], data + dim * (rows[i] + 1),
+        out + dim * i);
+  }
+}
+
+}  // namespace caffe
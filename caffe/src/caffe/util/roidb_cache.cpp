@@ -0,0 +1,319 @@
+#include "caffe/util/roidb_cache.hpp"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <sstream>
+#include <glog/logging.h>
+
+namespace caffe
+{
+    namespace
+    {
+        const char kMagic[8] = {'R', 'O', 'I', 'D', 'B', 'C', 0, 0};
+        // Sections start on cache line boundaries so they can be used in place
+        const size_t kAlign = 64;
+
+        struct CacheHeader
+        {
+            char magic[8];
+            uint32_t version;
+            uint32_t header_size;
+            uint64_t key;
+            int64_t num_images;
+            int64_t num_classes;
+            int64_t num_boxes;
+            int64_t names_bytes;
+            uint64_t file_size;
+        };
+
+        // Byte offsets of the sections following the header. Per-box arrays
+        // are indexed through image_offsets[i] .. image_offsets[i+1].
+        struct CacheLayout
+        {
+            size_t means;          // double[num_classes][4]
+            size_t stds;           // double[num_classes][4]
+            size_t image_offsets;  // int64[num_images + 1]
+            size_t num_gt;         // int32[num_images], leading ground-truth boxes
+            size_t flipped;        // uint8[num_images]
+            size_t sizes;          // int32[num_images][2], width and height
+            size_t name_offsets;   // int64[num_images + 1]
+            size_t names;          // char[names_bytes]
+            size_t boxes;          // float[num_boxes][4]
+            size_t gt_index;       // int32[num_boxes]
+            size_t label;          // int32[num_boxes]
+            size_t max_overlap;    // float[num_boxes]
+            size_t targets;        // float[num_boxes][4], normalized
+            size_t total;
+        };
+
+        size_t align_up(size_t offset)
+        {
+            return (offset + kAlign - 1) / kAlign * kAlign;
+        }
+
+        CacheLayout compute_layout(const CacheHeader& header)
+        {
+            CacheLayout layout;
+            size_t offset = align_up(sizeof(CacheHeader));
+            const size_t num_images = header.num_images;
+            const size_t num_classes = header.num_classes;
+            const size_t num_boxes = header.num_boxes;
+            layout.means = offset;
+            offset = align_up(offset + num_classes * 4 * sizeof(double));
+            layout.stds = offset;
+            offset = align_up(offset + num_classes * 4 * sizeof(double));
+            layout.image_offsets = offset;
+            offset = align_up(offset + (num_images + 1) * sizeof(int64_t));
+            layout.num_gt = offset;
+            offset = align_up(offset + num_images * sizeof(int32_t));
+            layout.flipped = offset;
+            offset = align_up(offset + num_images * sizeof(uint8_t));
+            layout.sizes = offset;
+            offset = align_up(offset + num_images * 2 * sizeof(int32_t));
+            layout.name_offsets = offset;
+            offset = align_up(offset + (num_images + 1) * sizeof(int64_t));
+            layout.names = offset;
+            offset = align_up(offset + header.names_bytes);
+            layout.boxes = offset;
+            offset = align_up(offset + num_boxes * 4 * sizeof(float));
+            layout.gt_index = offset;
+            offset = align_up(offset + num_boxes * sizeof(int32_t));
+            layout.label = offset;
+            offset = align_up(offset + num_boxes * sizeof(int32_t));
+            layout.max_overlap = offset;
+            offset = align_up(offset + num_boxes * sizeof(float));
+            layout.targets = offset;
+            offset = align_up(offset + num_boxes * 4 * sizeof(float));
+            layout.total = offset;
+            return layout;
+        }
+
+        // 64-bit FNV-1a
+        uint64_t hash_bytes(uint64_t hash, const void* data, size_t size)
+        {
+            const unsigned char* bytes = static_cast<const unsigned char*>(data);
+            for (size_t i = 0; i < size; i ++)
+            {
+                hash ^= bytes[i];
+                hash *= 1099511628211ULL;
+            }
+            return hash;
+        }
+
+        uint64_t hash_string(uint64_t hash, const std::string& str)
+        {
+            // Include the terminator so that consecutive strings cannot alias
+            return hash_bytes(hash, str.c_str(), str.size() + 1);
+        }
+
+        uint64_t hash_file_contents(uint64_t hash, const std::string& path)
+        {
+            std::ifstream infile(path.c_str(), std::ios::binary);
+            CHECK(infile) << "Cannot open " << path;
+            std::stringstream buffer;
+            buffer << infile.rdbuf();
+            return hash_string(hash, buffer.str());
+        }
+
+        // Identifies a large file by path, size and modification time rather
+        // than hashing its contents
+        uint64_t hash_file_stat(uint64_t hash, const std::string& path)
+        {
+            hash = hash_string(hash, path);
+            struct stat sb;
+            if (stat(path.c_str(), &sb) != 0)
+                return hash_bytes(hash, "missing", 7);
+            int64_t values[3] = {sb.st_size, sb.st_mtim.tv_sec, sb.st_mtim.tv_nsec};
+            return hash_bytes(hash, values, sizeof(values));
+        }
+
+        bool write_padding(FILE* fid, size_t& offset)
+        {
+            static const char zeros[kAlign] = {0};
+            size_t aligned = align_up(offset);
+            if (aligned > offset && fwrite(zeros, 1, aligned - offset, fid) != aligned - offset)
+                return false;
+            offset = aligned;
+            return true;
+        }
+
+        bool write_bytes(FILE* fid, const void* data, size_t size, size_t& offset)
+        {
+            if (size > 0 && fwrite(data, 1, size, fid) != size)
+                return false;
+            offset += size;
+            return true;
+        }
+
+        // Writes an array and pads it to the next section
+        bool write_section(FILE* fid, const void* data, size_t size, size_t& offset)
+        {
+            return write_bytes(fid, data, size, offset) && write_padding(fid, offset);
+        }
+
+        // Unmaps the cache file once the last roidb using it is gone
+        struct Unmapper
+        {
+            explicit Unmapper(size_t size) : size(size) {}
+            void operator()(void* addr) const {munmap(addr, size);}
+            size_t size;
+        };
+    }
+
+    ROIDBCache::ROIDBCache(const struct COMMON& common_cfg, bool use_flipped)
+    {
+        uint64_t hash = 14695981039346656037ULL;
+        uint32_t version = kVersion;
+        hash = hash_bytes(hash, &version, sizeof(version));
+        hash = hash_file_contents(hash, common_cfg.IMGS_LIST);
+        hash = hash_file_contents(hash, common_cfg.CLASSES_LIST);
+        hash = hash_file_stat(hash, common_cfg.SS_MAT);
+        hash = hash_string(hash, common_cfg.DIR_IMGS);
+        hash = hash_string(hash, common_cfg.DIR_ANNOTATIONS);
+        std::ifstream infile(common_cfg.IMGS_LIST.c_str());
+        std::string name;
+        while (infile >> name)
+            hash = hash_file_stat(hash, common_cfg.DIR_ANNOTATIONS + "/" + name + ".xml");
+        unsigned char flipped = use_flipped;
+        key_ = hash_bytes(hash, &flipped, 1);
+
+        char key_str[17];
+        snprintf(key_str, sizeof(key_str), "%016llx", (unsigned long long)key_);
+        path_ = std::string("data/cache/roidb_") + key_str + ".bin";
+    }
+
+    ROIDBCache::~ROIDBCache()
+    {
+    }
+
+    bool ROIDBCache::load(ROIDB& roidb)
+    {
+        int fd = open(path_.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat sb;
+        if (fstat(fd, &sb) != 0 || sb.st_size < sizeof(CacheHeader))
+        {
+            close(fd);
+            return false;
+        }
+        void* addr = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (addr == MAP_FAILED)
+            return false;
+        const char* base = static_cast<const char*>(addr);
+        const CacheHeader* header = reinterpret_cast<const CacheHeader*>(base);
+        if (memcmp(header->magic, kMagic, sizeof(kMagic)) != 0 ||
+            header->version != kVersion ||
+            header->header_size != sizeof(CacheHeader) ||
+            header->key != key_ ||
+            header->file_size != sb.st_size ||
+            compute_layout(*header).total != sb.st_size)
+        {
+            LOG(WARNING) << "Ignoring stale or corrupt roidb cache " << path_;
+            munmap(addr, sb.st_size);
+            return false;
+        }
+        CacheLayout layout = compute_layout(*header);
+        roidb.storage.reset(addr, Unmapper(sb.st_size));
+        roidb.num_images = header->num_images;
+        roidb.num_classes = header->num_classes;
+        roidb.num_boxes = header->num_boxes;
+        roidb.means = reinterpret_cast<const double*>(base + layout.means);
+        roidb.stds = reinterpret_cast<const double*>(base + layout.stds);
+        roidb.image_offsets = reinterpret_cast<const int64_t*>(base + layout.image_offsets);
+        roidb.num_gt = reinterpret_cast<const int32_t*>(base + layout.num_gt);
+        roidb.flipped = reinterpret_cast<const uint8_t*>(base + layout.flipped);
+        roidb.sizes = reinterpret_cast<const int32_t*>(base + layout.sizes);
+        roidb.boxes = reinterpret_cast<const float*>(base + layout.boxes);
+        roidb.gt_index = reinterpret_cast<const int32_t*>(base + layout.gt_index);
+        roidb.label = reinterpret_cast<const int32_t*>(base + layout.label);
+        roidb.max_overlap = reinterpret_cast<const float*>(base + layout.max_overlap);
+        roidb.targets = reinterpret_cast<const float*>(base + layout.targets);
+
+        const int64_t* name_offsets = reinterpret_cast<const int64_t*>(base + layout.name_offsets);
+        const char* names = base + layout.names;
+        roidb.images.resize(roidb.num_images);
+        for (int i = 0; i < roidb.num_images; i ++)
+            roidb.images[i].assign(names + name_offsets[i], names + name_offsets[i + 1]);
+        LOG(INFO) << "Loaded " << roidb.num_images << " roidb entries from " << path_;
+        return true;
+    }
+
+    bool ROIDBCache::save(const ROIDB& roidb)
+    {
+        struct stat sb;
+        if (!(stat("data/cache", &sb) == 0 && S_ISDIR(sb.st_mode)))
+        {
+            int mkflag = mkdir("data/cache", S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
+            CHECK(mkflag != -1) << "Error creating directory";
+        }
+
+        const int num_images = roidb.num_images;
+        const int num_classes = roidb.num_classes;
+        const int64_t num_boxes = roidb.num_boxes;
+        std::vector<int64_t> name_offsets(num_images + 1, 0);
+        for (int i = 0; i < num_images; i ++)
+            name_offsets[i + 1] = name_offsets[i] + roidb.images[i].size();
+
+        CacheHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, kMagic, sizeof(kMagic));
+        header.version = kVersion;
+        header.header_size = sizeof(CacheHeader);
+        header.key = key_;
+        header.num_images = num_images;
+        header.num_classes = num_classes;
+        header.num_boxes = num_boxes;
+        header.names_bytes = name_offsets[num_images];
+        header.file_size = compute_layout(header).total;
+
+        std::string tmp_path = path_ + ".tmp";
+        FILE* fid = fopen(tmp_path.c_str(), "wb");
+        if (!fid)
+        {
+            LOG(WARNING) << "Cannot create roidb cache " << tmp_path;
+            return false;
+        }
+        size_t offset = 0;
+        bool written = write_section(fid, &header, sizeof(header), offset)
+            && write_section(fid, roidb.means, num_classes * 4 * sizeof(double), offset)
+            && write_section(fid, roidb.stds, num_classes * 4 * sizeof(double), offset)
+            && write_section(fid, roidb.image_offsets, (num_images + 1) * sizeof(int64_t), offset)
+            && write_section(fid, roidb.num_gt, num_images * sizeof(int32_t), offset)
+            && write_section(fid, roidb.flipped, num_images, offset)
+            && write_section(fid, roidb.sizes, num_images * 2 * sizeof(int32_t), offset)
+            && write_section(fid, name_offsets.data(), name_offsets.size() * sizeof(int64_t), offset);
+        for (int i = 0; written && i < num_images; i ++)
+            written = write_bytes(fid, roidb.images[i].data(), roidb.images[i].size(), offset);
+        written = written && write_padding(fid, offset)
+            && write_section(fid, roidb.boxes, num_boxes * 4 * sizeof(float), offset)
+            && write_section(fid, roidb.gt_index, num_boxes * sizeof(int32_t), offset)
+            && write_section(fid, roidb.label, num_boxes * sizeof(int32_t), offset)
+            && write_section(fid, roidb.max_overlap, num_boxes * sizeof(float), offset)
+            && write_section(fid, roidb.targets, num_boxes * 4 * sizeof(float), offset);
+        // A write error may only show when the buffer is flushed
+        if (fclose(fid) != 0 || !written)
+        {
+            LOG(WARNING) << "Cannot write roidb cache " << tmp_path;
+            unlink(tmp_path.c_str());
+            return false;
+        }
+        CHECK_EQ(offset, header.file_size) << "Roidb cache layout mismatch";
+
+        if (rename(tmp_path.c_str(), path_.c_str()) != 0)
+        {
+            LOG(WARNING) << "Cannot move roidb cache into place at " << path_;
+            unlink(tmp_path.c_str());
+            return false;
+        }
+        LOG(INFO) << "Wrote roidb cache " << path_;
+        return true;
+    }
+}
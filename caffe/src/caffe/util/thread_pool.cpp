@@ -0,0 +1,191 @@
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <algorithm>
+#include <vector>
+
+#include "caffe/util/thread_pool.hpp"
+
+namespace caffe {
+
+namespace {
+
+class ThreadPool {
+ public:
+  ThreadPool()
+      : num_threads_(1), num_running_(0), resizing_(false), stop_(false) {
+    Start(std::max<int>(boost::thread::hardware_concurrency(), 1));
+  }
+
+  int num_threads() const { return num_threads_; }
+
+  void Resize(const int num_threads) {
+    CHECK_GE(num_threads, 1);
+    boost::mutex::scoped_lock resize_lock(resize_mutex_);
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      resizing_ = true;
+      while (num_running_ > 0) {
+        done_.wait(lock);
+      }
+    }
+    Stop();
+    Start(num_threads);
+    boost::mutex::scoped_lock lock(mutex_);
+    resizing_ = false;
+  }
+
+  void Run(const int n, const boost::function<void(int, int)>& body) {
+    if (n <= 0) {
+      return;
+    }
+    if (n == 1 || in_region_.get()) {
+      body(0, n);
+      return;
+    }
+    Region region;
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      if (workers_.empty() || resizing_) {
+        lock.unlock();
+        body(0, n);
+        return;
+      }
+      region.body = &body;
+      region.n = n;
+      region.num_chunks = std::min(n, kChunksPerThread * num_threads_);
+      region.next_chunk = 0;
+      region.pending = region.num_chunks;
+      regions_.push_back(&region);
+      ++num_running_;
+    }
+    work_.notify_all();
+    // The caller only runs chunks of its own region, so that it returns as
+    // soon as its region is done
+    in_region_.reset(new bool(true));
+    boost::mutex::scoped_lock lock(mutex_);
+    while (region.next_chunk < region.num_chunks) {
+      RunChunk(&region, &lock);
+    }
+    while (region.pending > 0) {
+      done_.wait(lock);
+    }
+    --num_running_;
+    lock.unlock();
+    done_.notify_all();
+    in_region_.reset();
+  }
+
+ private:
+  // Splitting each region into a few chunks per thread keeps the threads
+  // busy when chunks are uneven (e.g. ROIs of very different sizes).
+  static const int kChunksPerThread = 4;
+
+  // A caffe_parallel_for call; lives on the stack of its caller
+  struct Region {
+    const boost::function<void(int, int)>* body;
+    int n;
+    int num_chunks;
+    int next_chunk;
+    int pending;
+  };
+
+  void Start(const int num_threads) {
+    num_threads_ = num_threads;
+    for (int i = 1; i < num_threads; ++i) {
+      workers_.push_back(shared_ptr<boost::thread>(new boost::thread(
+          boost::bind(&ThreadPool::WorkerEntry, this))));
+    }
+  }
+
+  void Stop() {
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      stop_ = true;
+    }
+    work_.notify_all();
+    for (int i = 0; i < workers_.size(); ++i) {
+      workers_[i]->join();
+    }
+    workers_.clear();
+    stop_ = false;
+  }
+
+  // Claims and runs the next chunk of region, with the lock held on entry
+  // and on return. A region leaves regions_ once all its chunks are
+  // claimed, and its caller returns once they have all completed.
+  void RunChunk(Region* region, boost::mutex::scoped_lock* lock) {
+    const int chunk = region->next_chunk++;
+    if (region->next_chunk == region->num_chunks) {
+      regions_.erase(std::find(regions_.begin(), regions_.end(), region));
+    }
+    const int begin = static_cast<int64_t>(region->n) * chunk /
+        region->num_chunks;
+    const int end = static_cast<int64_t>(region->n) * (chunk + 1) /
+        region->num_chunks;
+    const boost::function<void(int, int)>* body = region->body;
+    lock->unlock();
+    (*body)(begin, end);
+    lock->lock();
+    if (--region->pending == 0) {
+      done_.notify_all();
+    }
+  }
+
+  // Runs chunks of the regions in the order they were started, so that
+  // concurrent callers, e.g. the stages of a pipeline, share the workers.
+  void WorkerEntry() {
+    in_region_.reset(new bool(true));
+    boost::mutex::scoped_lock lock(mutex_);
+    while (true) {
+      while (!stop_ && regions_.empty()) {
+        work_.wait(lock);
+      }
+      if (stop_) {
+        return;
+      }
+      RunChunk(regions_.front(), &lock);
+    }
+  }
+
+  int num_threads_;
+  std::vector<shared_ptr<boost::thread> > workers_;
+  // Serializes Resize calls.
+  boost::mutex resize_mutex_;
+  // Protects the state below.
+  boost::mutex mutex_;
+  boost::condition_variable work_;
+  boost::condition_variable done_;
+  // The regions with chunks left to claim, oldest first
+  std::vector<Region*> regions_;
+  // The calls in progress, which Resize waits for
+  int num_running_;
+  bool resizing_;
+  bool stop_;
+  // Set on the threads running a region, whose nested calls run inline
+  boost::thread_specific_ptr<bool> in_region_;
+
+  DISABLE_COPY_AND_ASSIGN(ThreadPool);
+};
+
+ThreadPool& GetThreadPool() {
+  // Never destroyed: workers may still be parked when static destructors run.
+  static ThreadPool* pool = new ThreadPool();
+  return *pool;
+}
+
+}  // namespace
+
+void caffe_parallel_for(const int n,
+    const boost::function<void(int, int)>& body) {
+  GetThreadPool().Run(n, body);
+}
+
+int caffe_get_num_threads() {
+  return GetThreadPool().num_threads();
+}
+
+void caffe_set_num_threads(const int num_threads) {
+  GetThreadPool().Resize(num_threads);
+}
+
+}  // namespace caffe
@@ -0,0 +1,218 @@
+#include <boost/bind.hpp>
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "caffe/util/bbox_geometry.hpp"
+#include "caffe/util/roi_data_extractor.hpp"
+#include "caffe/util/thread_pool.hpp"
+#include "caffe/util/voc_evaluator.hpp"
+
+namespace caffe {
+
+VOCEvaluator::VOCEvaluator(const vector<string>& class_names, Metric metric)
+    : class_names_(class_names), metric_(metric),
+      detections_(class_names.size()) {
+  CHECK_GT(class_names.size(), 1) << "Need classes besides the background";
+}
+
+void VOCEvaluator::LoadAnnotations(const string& annotation_dir,
+    const vector<string>& image_names) {
+  ground_truth_.clear();
+  ground_truth_.resize(image_names.size());
+  added_.assign(image_names.size(), false);
+  caffe_parallel_for(image_names.size(), boost::bind(
+      &VOCEvaluator::LoadImages, this, annotation_dir, image_names, _1, _2));
+}
+
+void VOCEvaluator::LoadImages(const string& annotation_dir,
+    const vector<string>& image_names, int begin, int end) {
+  for (int i = begin; i < end; ++i) {
+    const string path = annotation_dir + "/" + image_names[i] + ".xml";
+    pugi::xml_document doc;
+    pugi::xml_parse_result result = doc.load_file(path.c_str());
+    CHECK(result.status == 0) << "Cannot parse " << path;
+    vector<string> labels;
+    vector<vector<double> > bndboxes;
+    vector<int> difficult;
+    ROIDataExtractor::getAttribute(doc.first_child(), "object", labels,
+        bndboxes, &difficult);
+    CHECK_EQ(labels.size(), bndboxes.size()) << "Malformed objects in " << path;
+    GroundTruth& gt = ground_truth_[i];
+    for (int j = 0; j < labels.size(); ++j) {
+      const int label = std::find(class_names_.begin(), class_names_.end(),
+          labels[j]) - class_names_.begin();
+      if (label == 0 || label == class_names_.size()) {
+        continue;
+      }
+      gt.boxes.insert(gt.boxes.end(), bndboxes[j].begin(), bndboxes[j].end());
+      gt.labels.push_back(label);
+      gt.difficult.push_back(difficult[j]);
+    }
+  }
+}
+
+void VOCEvaluator::SetGroundTruth(int image, const vector<float>& boxes,
+    const vector<int>& labels, const vector<int>& difficult) {
+  CHECK_EQ(boxes.size(), 4 * labels.size());
+  CHECK_EQ(difficult.size(), labels.size());
+  if (image >= ground_truth_.size()) {
+    ground_truth_.resize(image + 1);
+    added_.resize(image + 1, false);
+  }
+  GroundTruth& gt = ground_truth_[image];
+  gt.boxes = boxes;
+  gt.labels = labels;
+  gt.difficult = difficult;
+}
+
+void VOCEvaluator::AddDetections(int image,
+    const vector<DetectionRecord>& records) {
+  CHECK_LT(image, ground_truth_.size()) << "No ground truth for image "
+      << image;
+  CHECK(!added_[image]) << "Detections of image " << image << " added twice";
+  added_[image] = true;
+  const GroundTruth& gt = ground_truth_[image];
+  // Group the detections by class, by decreasing score
+  vector<std::pair<std::pair<int, float>, int> > order(records.size());
+  for (int i = 0; i < records.size(); ++i) {
+    CHECK_EQ(records[i].image, image);
+    CHECK_GT(records[i].label, 0);
+    CHECK_LT(records[i].label, class_names_.size());
+    order[i] = std::make_pair(
+        std::make_pair(records[i].label, -records[i].score), i);
+  }
+  std::sort(order.begin(), order.end());
+
+  vector<float> det_boxes, gt_boxes, iou;
+  vector<int> gt_index;
+  for (int begin = 0, end = 0; begin < order.size(); begin = end) {
+    const int label = order[begin].first.first;
+    for (end = begin; end < order.size() && order[end].first.first == label;
+         ++end) {}
+    gt_boxes.clear();
+    gt_index.clear();
+    for (int j = 0; j < gt.labels.size(); ++j) {
+      if (gt.labels[j] == label) {
+        gt_boxes.insert(gt_boxes.end(), &gt.boxes[4 * j],
+            &gt.boxes[4 * j] + 4);
+        gt_index.push_back(j);
+      }
+    }
+    det_boxes.resize(4 * (end - begin));
+    for (int i = begin; i < end; ++i) {
+      const float* box = records[order[i].second].box;
+      std::copy(box, box + 4, &det_boxes[4 * (i - begin)]);
+    }
+    const int num_gt = gt_index.size();
+    iou.resize((end - begin) * num_gt);
+    if (num_gt) {
+      caffe_cpu_iou(SoABoxes(&det_boxes[0], end - begin),
+          SoABoxes(&gt_boxes[0], num_gt), &iou[0]);
+    }
+
+    ClassDetections& dets = detections_[label];
+    vector<bool> claimed(num_gt, false);
+    for (int i = begin; i < end; ++i) {
+      const float* overlaps = &iou[0] + (i - begin) * num_gt;
+      const int best = num_gt ?
+          std::max_element(overlaps, overlaps + num_gt) - overlaps : -1;
+      bool true_positive = false;
+      if (best >= 0 && overlaps[best] > 0.5) {
+        if (gt.difficult[gt_index[best]]) {
+          continue;
+        }
+        true_positive = !claimed[best];
+        claimed[best] = true;
+      }
+      dets.scores.push_back(-order[i].first.second);
+      dets.true_positive.push_back(true_positive);
+    }
+  }
+}
+
+float VOCEvaluator::Evaluate(vector<float>* aps) const {
+  aps->assign(class_names_.size(), 0);
+  caffe_parallel_for(class_names_.size() - 1, boost::bind(
+      &VOCEvaluator::EvaluateClasses, this, aps, _1, _2));
+  float mean_ap = 0;
+  for (int c = 1; c < class_names_.size(); ++c) {
+    mean_ap += (*aps)[c];
+  }
+  return mean_ap / (class_names_.size() - 1);
+}
+
+void VOCEvaluator::EvaluateClasses(vector<float>* aps, int begin,
+    int end) const {
+  for (int c = begin + 1; c < end + 1; ++c) {
+    int num_positives = 0;
+    for (int i = 0; i < ground_truth_.size(); ++i) {
+      const GroundTruth& gt = ground_truth_[i];
+      for (int j = 0; j < gt.labels.size(); ++j) {
+        num_positives += gt.labels[j] == c && !gt.difficult[j];
+      }
+    }
+    const ClassDetections& dets = detections_[c];
+    const int num_dets = dets.scores.size();
+    vector<std::pair<float, int> > order(num_dets);
+    for (int i = 0; i < num_dets; ++i) {
+      order[i] = std::make_pair(dets.scores[i], i);
+    }
+    std::stable_sort(order.begin(), order.end(),
+        std::greater<std::pair<float, int> >());
+    vector<float> recall(num_dets), precision(num_dets);
+    int tp = 0;
+    for (int i = 0; i < num_dets; ++i) {
+      tp += dets.true_positive[order[i].second];
+      recall[i] = num_positives ? float(tp) / num_positives : 0;
+      precision[i] = float(tp) / (i + 1);
+    }
+    (*aps)[c] = AveragePrecision(recall, precision, metric_);
+  }
+}
+
+float VOCEvaluator::AveragePrecision(const vector<float>& recall,
+    const vector<float>& precision, Metric metric) {
+  CHECK_EQ(recall.size(), precision.size());
+  const int n = recall.size();
+  if (metric == VOC07) {
+    // The maximum precision at recall of at least t, for t = 0, 0.1, .., 1
+    float ap = 0;
+    for (int k = 0; k <= 10; ++k) {
+      const float t = k / 10.;
+      float p = 0;
+      for (int i = 0; i < n; ++i) {
+        if (recall[i] >= t) {
+          p = std::max(p, precision[i]);
+        }
+      }
+      ap += p / 11;
+    }
+    return ap;
+  }
+  // The area under the precision envelope, the maximum precision at any
+  // higher recall, with precision 0 past the last detection
+  vector<float> envelope(n + 1, 0);
+  for (int i = n - 1; i >= 0; --i) {
+    envelope[i] = std::max(precision[i], envelope[i + 1]);
+  }
+  float ap = 0;
+  float prev_recall = 0;
+  for (int i = 0; i < n; ++i) {
+    ap += (recall[i] - prev_recall) * envelope[i];
+    prev_recall = recall[i];
+  }
+  return ap;
+}
+
+VOCEvaluator::Metric VOCEvaluator::ParseMetric(const string& name) {
+  if (name == "voc07") {
+    return VOC07;
+  }
+  CHECK_EQ(name, "voc12") << "Unknown VOC metric " << name;
+  return VOC12;
+}
+
+}  // namespace caffe
@@ -0,0 +1,155 @@
+// Micro-benchmark of the box geometry kernels used by roidb building and
+// detection post-processing.
+// Usage:
+//    bbox_benchmark [--num_boxes=2000] [--num_gt=4] [--num_classes=21]
+//        [--iterations=20]
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/bbox_geometry.hpp"
+#include "caffe/util/bboxproc.hpp"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/nms.hpp"
+#include "caffe/util/rng.hpp"
+#include "caffe/util/thread_pool.hpp"
+
+using caffe::CPUTimer;
+using caffe::SoABoxes;
+using std::vector;
+
+DEFINE_int32(num_boxes, 2000, "Number of proposal boxes per image.");
+DEFINE_int32(num_gt, 4, "Number of ground-truth boxes per image.");
+DEFINE_int32(iterations, 20, "Number of timed iterations.");
+DEFINE_double(nms_thresh, 0.3, "IoU threshold of the NMS benchmark.");
+DEFINE_int32(num_classes, 21, "Number of classes of the multi-class NMS "
+    "benchmark, including the background.");
+DEFINE_double(conf_thresh, 0.05, "Score threshold of the multi-class NMS "
+    "benchmark.");
+
+// Random boxes inside a 500x500 image, the size of a PASCAL VOC image
+static void random_boxes(const int n, caffe::rng_t* rng, vector<float>* boxes) {
+  boxes->resize(4 * n);
+  for (int i = 0; i < n; ++i) {
+    const float x1 = (*rng)() % 400;
+    const float y1 = (*rng)() % 400;
+    (*boxes)[4 * i] = x1;
+    (*boxes)[4 * i + 1] = y1;
+    (*boxes)[4 * i + 2] = x1 + 10 + (*rng)() % 90;
+    (*boxes)[4 * i + 3] = y1 + 10 + (*rng)() % 90;
+  }
+}
+
+// The scalar IoU matrix the kernels replace
+static void reference_iou(const vector<float>& a, const vector<float>& b,
+    vector<float>* iou) {
+  const int n = a.size() / 4;
+  const int m = b.size() / 4;
+  iou->resize(n * m);
+  for (int i = 0; i < n; ++i) {
+    const float* p = &a[4 * i];
+    const float area_p = (p[2] - p[0] + 1) * (p[3] - p[1] + 1);
+    for (int j = 0; j < m; ++j) {
+      const float* q = &b[4 * j];
+      const float area_q = (q[2] - q[0] + 1) * (q[3] - q[1] + 1);
+      const float w = std::max(0.f,
+          std::min(p[2], q[2]) - std::max(p[0], q[0]) + 1);
+      const float h = std::max(0.f,
+          std::min(p[3], q[3]) - std::max(p[1], q[1]) + 1);
+      (*iou)[i * m + j] = w * h / (area_p + area_q - w * h);
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  FLAGS_alsologtostderr = 1;
+  gflags::SetUsageMessage("Benchmarks the IoU kernels and NMS.\n"
+      "Usage:\n"
+      "    bbox_benchmark [FLAGS]\n");
+  caffe::GlobalInit(&argc, &argv);
+
+  caffe::Caffe::set_random_seed(1701);
+  caffe::rng_t* rng = caffe::caffe_rng();
+  vector<float> boxes, gt_boxes;
+  random_boxes(FLAGS_num_boxes, rng, &boxes);
+  random_boxes(FLAGS_num_gt, rng, &gt_boxes);
+  vector<float> iou, iou_ref;
+  CPUTimer timer;
+
+  // Overlaps of proposals with ground truth, as in roidb building
+  timer.Start();
+  for (int it = 0; it < FLAGS_iterations; ++it) {
+    reference_iou(gt_boxes, boxes, &iou_ref);
+  }
+  const float ref_gt_ms = timer.MicroSeconds() / 1000 / FLAGS_iterations;
+  timer.Start();
+  for (int it = 0; it < FLAGS_iterations; ++it) {
+    iou.resize(FLAGS_num_gt * FLAGS_num_boxes);
+    caffe::caffe_cpu_iou(SoABoxes(&gt_boxes[0], FLAGS_num_gt),
+        SoABoxes(&boxes[0], FLAGS_num_boxes), &iou[0]);
+  }
+  const float gt_ms = timer.MicroSeconds() / 1000 / FLAGS_iterations;
+  float max_diff = 0;
+  for (int i = 0; i < iou.size(); ++i) {
+    max_diff = std::max(max_diff, std::abs(iou[i] - iou_ref[i]));
+  }
+  LOG(INFO) << FLAGS_num_gt << "x" << FLAGS_num_boxes << " IoU: scalar "
+      << ref_gt_ms << " ms, kernel " << gt_ms << " ms, max diff " << max_diff;
+
+  // All pairs of proposals, as in NMS
+  timer.Start();
+  for (int it = 0; it < FLAGS_iterations; ++it) {
+    reference_iou(boxes, boxes, &iou_ref);
+  }
+  const float ref_all_ms = timer.MicroSeconds() / 1000 / FLAGS_iterations;
+  SoABoxes soa_boxes(&boxes[0], FLAGS_num_boxes);
+  timer.Start();
+  for (int it = 0; it < FLAGS_iterations; ++it) {
+    iou.resize(FLAGS_num_boxes * FLAGS_num_boxes);
+    caffe::caffe_cpu_iou(soa_boxes, soa_boxes, &iou[0]);
+  }
+  const float all_ms = timer.MicroSeconds() / 1000 / FLAGS_iterations;
+  LOG(INFO) << FLAGS_num_boxes << "x" << FLAGS_num_boxes << " IoU: scalar "
+      << ref_all_ms << " ms, kernel " << all_ms << " ms";
+
+  vector<vector<float> > nms_boxes(FLAGS_num_boxes);
+  vector<float> scores(FLAGS_num_boxes);
+  for (int i = 0; i < FLAGS_num_boxes; ++i) {
+    nms_boxes[i].assign(&boxes[4 * i], &boxes[4 * i] + 4);
+    scores[i] = FLAGS_num_boxes - i;
+  }
+  vector<int> keep;
+  timer.Start();
+  for (int it = 0; it < FLAGS_iterations; ++it) {
+    keep.clear();
+    nms_cpu<float>(nms_boxes, scores, keep, FLAGS_nms_thresh);
+  }
+  LOG(INFO) << "NMS of " << FLAGS_num_boxes << " boxes: "
+      << timer.MicroSeconds() / 1000 / FLAGS_iterations << " ms, kept "
+      << keep.size();
+
+  // Class-specific boxes and uniform scores, as output by the detector
+  vector<float> class_boxes;
+  random_boxes(FLAGS_num_boxes * FLAGS_num_classes, rng, &class_boxes);
+  vector<float> class_scores(FLAGS_num_boxes * FLAGS_num_classes);
+  for (int i = 0; i < class_scores.size(); ++i) {
+    class_scores[i] = ((*rng)() % 10000) / 10000.f;
+  }
+  vector<vector<int> > class_keep;
+  timer.Start();
+  for (int it = 0; it < FLAGS_iterations; ++it) {
+    caffe::caffe_cpu_nms_multiclass(&class_boxes[0], &class_scores[0],
+        FLAGS_num_boxes, FLAGS_num_classes, FLAGS_conf_thresh,
+        FLAGS_nms_thresh, &class_keep);
+  }
+  LOG(INFO) << "Multi-class NMS of " << FLAGS_num_boxes << " boxes x "
+      << FLAGS_num_classes << " classes: "
+      << timer.MicroSeconds() / 1000 / FLAGS_iterations << " ms on "
+      << caffe::caffe_get_num_threads() << " threads";
+  return 0;
+}
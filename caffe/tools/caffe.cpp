@@ -13,6 +13,7 @@ namespace bp = boost::python;
 
 #include "boost/algorithm/string.hpp"
 #include "caffe/caffe.hpp"
+#include "caffe/util/pipeline_stats.hpp"
 #include "caffe/util/signal_handler.h"
 
 using caffe::Blob;
@@ -54,6 +55,9 @@ DEFINE_string(sigint_effect, "stop",
 DEFINE_string(sighup_effect, "snapshot",
              "Optional; action to take when a SIGHUP signal is received: "
              "snapshot, stop or none.");
+DEFINE_string(pipeline_stats, "",
+    "Optional; write the data pipeline timings and queue counters as JSON "
+    "to this file when training ends.");
 
 // A simple registry for caffe commands.
 typedef int (*BrewFunction)();
@@ -252,6 +256,10 @@ int train() {
     solver->Solve();
   }
   LOG(INFO) << "Optimization Done.";
+  if (FLAGS_pipeline_stats.size()) {
+    caffe::PipelineStats::Log();
+    caffe::PipelineStats::WriteJSON(FLAGS_pipeline_stats);
+  }
   return 0;
 }
 RegisterBrewFunction(train);
@@ -0,0 +1,284 @@
+// This program compresses InnerProduct layers of a trained net with a
+// truncated SVD, replacing each layer by two smaller ones, as in Fast R-CNN
+// for fc6 and fc7.
+// Usage:
+//    compress_net --model=test.prototxt --weights=net.caffemodel
+//        --layers=fc6,fc7 --ranks=1024,256
+//        --output_model=test_svd.prototxt --output_weights=net_svd.caffemodel
+//
+// A layer computing y = W x + b, with W of m outputs by n inputs, becomes
+// <name>_L computing z = L x with the k x n matrix L = Q^T W, followed by
+// <name>_U computing y = U z + b with the m x k matrix U = Q, where Q spans
+// the top k left singular vectors of W, so that U L is the rank k truncated
+// SVD of W. Q is found by subspace iteration on W W^T, which only needs
+// BLAS. Each layer is reported with the fraction of the energy of W it
+// keeps and the time of its forward pass on --num_rois inputs before and
+// after compression; the detection tool's --eval measures the mAP.
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "boost/algorithm/string.hpp"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/upgrade_proto.hpp"
+
+using caffe::Blob;
+using caffe::CPUTimer;
+using caffe::LayerParameter;
+using caffe::NetParameter;
+using std::string;
+using std::vector;
+
+DEFINE_string(model, "", "The test net definition to compress.");
+DEFINE_string(weights, "", "The trained weights of the net.");
+DEFINE_string(layers, "fc6,fc7", "Comma-separated InnerProduct layers to "
+    "compress.");
+DEFINE_string(ranks, "1024,256", "Comma-separated rank of each layer.");
+DEFINE_string(output_model, "", "Where to write the compressed net "
+    "definition.");
+DEFINE_string(output_weights, "", "Where to write the compressed weights.");
+DEFINE_int32(iterations, 4, "Subspace iterations on W W^T; more iterations "
+    "get closer to the truncated SVD.");
+DEFINE_int32(num_rois, 2000, "Inputs per forward pass in the speed report.");
+
+// Orthonormalizes the k columns of the row-major m x k matrix y in place by
+// two rounds of Cholesky QR: y = y R^-1 where y^T y = R^T R.
+static void orthonormalize(const int m, const int k, vector<float>* y) {
+  vector<float> gram(k * k), r_inv(k * k), q(m * k);
+  vector<double> r(k * k);
+  for (int round = 0; round < 2; ++round) {
+    caffe::caffe_cpu_gemm<float>(CblasTrans, CblasNoTrans, k, k, m, 1.,
+        &(*y)[0], &(*y)[0], 0., &gram[0]);
+    double trace = 0;
+    for (int i = 0; i < k; ++i) {
+      trace += gram[i * k + i];
+    }
+    // Directions lost to rounding get a tiny pivot rather than a NaN
+    const double min_pivot = 1e-12 * std::max(trace, 1e-30) / k;
+    std::fill(r.begin(), r.end(), 0.);
+    for (int i = 0; i < k; ++i) {
+      for (int j = i; j < k; ++j) {
+        double sum = gram[i * k + j];
+        for (int p = 0; p < i; ++p) {
+          sum -= r[p * k + i] * r[p * k + j];
+        }
+        if (i == j) {
+          r[i * k + i] = std::sqrt(std::max(sum, min_pivot));
+        } else {
+          r[i * k + j] = sum / r[i * k + i];
+        }
+      }
+    }
+    // Invert the upper triangular R column by column
+    std::fill(r_inv.begin(), r_inv.end(), 0.f);
+    for (int j = 0; j < k; ++j) {
+      vector<double> column(j + 1);
+      column[j] = 1. / r[j * k + j];
+      for (int i = j - 1; i >= 0; --i) {
+        double sum = 0;
+        for (int p = i + 1; p <= j; ++p) {
+          sum += r[i * k + p] * column[p];
+        }
+        column[i] = -sum / r[i * k + i];
+      }
+      for (int i = 0; i <= j; ++i) {
+        r_inv[i * k + j] = column[i];
+      }
+    }
+    caffe::caffe_cpu_gemm<float>(CblasNoTrans, CblasNoTrans, m, k, k, 1.,
+        &(*y)[0], &r_inv[0], 0., &q[0]);
+    y->swap(q);
+  }
+}
+
+// Factors the m x n matrix w into the m x k matrix u and the k x n matrix
+// l = u^T w, u spanning the top k left singular vectors of w. Returns the
+// fraction of the squared Frobenius norm of w that u l keeps.
+static float truncated_svd(const int m, const int n, const int k,
+    const float* w, vector<float>* u, vector<float>* l) {
+  vector<float> gram(m * m);
+  caffe::caffe_cpu_gemm<float>(CblasNoTrans, CblasTrans, m, m, n, 1., w, w,
+      0., &gram[0]);
+  u->resize(m * k);
+  caffe::caffe_rng_gaussian<float>(m * k, 0., 1., &(*u)[0]);
+  orthonormalize(m, k, u);
+  vector<float> y(m * k);
+  for (int it = 0; it < FLAGS_iterations; ++it) {
+    caffe::caffe_cpu_gemm<float>(CblasNoTrans, CblasNoTrans, m, k, m, 1.,
+        &gram[0], &(*u)[0], 0., &y[0]);
+    u->swap(y);
+    orthonormalize(m, k, u);
+  }
+  l->resize(k * n);
+  caffe::caffe_cpu_gemm<float>(CblasTrans, CblasNoTrans, k, n, m, 1.,
+      &(*u)[0], w, 0., &(*l)[0]);
+  return caffe::caffe_cpu_dot<float>(k * n, &(*l)[0], &(*l)[0]) /
+      caffe::caffe_cpu_dot<float>(m * n, w, w);
+}
+
+// Times the forward pass of the layer before and after compression, as
+// InnerProductLayer computes it, and returns the relative error of the
+// compressed outputs on random inputs.
+static float report_speed(const string& name, const int m, const int n,
+    const int k, const float* w, const vector<float>& u,
+    const vector<float>& l) {
+  const int num = FLAGS_num_rois;
+  vector<float> x(num * n), y(num * m), z(num * k), y_svd(num * m);
+  caffe::caffe_rng_gaussian<float>(num * n, 0., 1., &x[0]);
+  CPUTimer timer;
+  timer.Start();
+  caffe::caffe_cpu_gemm<float>(CblasNoTrans, CblasTrans, num, m, n, 1.,
+      &x[0], w, 0., &y[0]);
+  const float full_ms = timer.MilliSeconds();
+  timer.Start();
+  caffe::caffe_cpu_gemm<float>(CblasNoTrans, CblasTrans, num, k, n, 1.,
+      &x[0], &l[0], 0., &z[0]);
+  caffe::caffe_cpu_gemm<float>(CblasNoTrans, CblasTrans, num, m, k, 1.,
+      &z[0], &u[0], 0., &y_svd[0]);
+  const float svd_ms = timer.MilliSeconds();
+  caffe::caffe_sub<float>(num * m, &y[0], &y_svd[0], &y_svd[0]);
+  const float error = std::sqrt(
+      caffe::caffe_cpu_dot<float>(num * m, &y_svd[0], &y_svd[0]) /
+      caffe::caffe_cpu_dot<float>(num * m, &y[0], &y[0]));
+  LOG(INFO) << name << ": " << num << " inputs in " << full_ms << " ms, "
+      << svd_ms << " ms compressed (" << full_ms / svd_ms << "x); "
+      << m * n << " weights, " << k * (m + n) << " compressed";
+  return error;
+}
+
+static LayerParameter* find_layer(NetParameter* net, const string& name) {
+  for (int i = 0; i < net->layer_size(); ++i) {
+    if (net->layer(i).name() == name) {
+      return net->mutable_layer(i);
+    }
+  }
+  return NULL;
+}
+
+// Replaces the layer at index i of net by its _L and _U halves, keeping
+// the order of the layers.
+static void split_layer(NetParameter* net, const int i, const int rank) {
+  const LayerParameter layer = net->layer(i);
+  LayerParameter lower = layer;
+  lower.set_name(layer.name() + "_L");
+  lower.clear_top();
+  lower.add_top(layer.name() + "_L");
+  lower.clear_blobs();
+  lower.mutable_inner_product_param()->set_num_output(rank);
+  lower.mutable_inner_product_param()->set_bias_term(false);
+  lower.mutable_inner_product_param()->clear_bias_filler();
+  if (lower.param_size() > 1) {
+    lower.mutable_param()->RemoveLast();
+  }
+  LayerParameter upper = layer;
+  upper.set_name(layer.name() + "_U");
+  upper.clear_bottom();
+  upper.add_bottom(lower.top(0));
+  upper.clear_blobs();
+  // Shift the following layers by one to make room
+  net->add_layer();
+  for (int j = net->layer_size() - 1; j > i + 1; --j) {
+    net->mutable_layer(j)->Swap(net->mutable_layer(j - 1));
+  }
+  *net->mutable_layer(i) = lower;
+  *net->mutable_layer(i + 1) = upper;
+}
+
+int main(int argc, char** argv) {
+  FLAGS_alsologtostderr = 1;
+  gflags::SetUsageMessage("Compresses InnerProduct layers of a trained net "
+      "with a truncated SVD.\n"
+      "Usage:\n"
+      "    compress_net --model=... --weights=... --output_model=... "
+      "--output_weights=... [FLAGS]\n");
+  caffe::GlobalInit(&argc, &argv);
+  CHECK_GT(FLAGS_model.size(), 0) << "Need a model definition.";
+  CHECK_GT(FLAGS_weights.size(), 0) << "Need trained weights.";
+  CHECK_GT(FLAGS_output_model.size(), 0) << "Need --output_model.";
+  CHECK_GT(FLAGS_output_weights.size(), 0) << "Need --output_weights.";
+  vector<string> layers, ranks;
+  boost::split(layers, FLAGS_layers, boost::is_any_of(","));
+  boost::split(ranks, FLAGS_ranks, boost::is_any_of(","));
+  CHECK_EQ(layers.size(), ranks.size()) << "Need one rank per layer.";
+
+  NetParameter model, weights;
+  caffe::ReadNetParamsFromTextFileOrDie(FLAGS_model, &model);
+  caffe::ReadNetParamsFromBinaryFileOrDie(FLAGS_weights, &weights);
+  caffe::Caffe::set_random_seed(1701);
+
+  for (int i = 0; i < layers.size(); ++i) {
+    const string& name = layers[i];
+    const int rank = atoi(ranks[i].c_str());
+    LayerParameter* layer = find_layer(&model, name);
+    LayerParameter* trained = find_layer(&weights, name);
+    CHECK(layer && trained) << "No layer " << name;
+    CHECK_EQ(layer->type(), "InnerProduct") << name;
+    CHECK(!layer->inner_product_param().transpose())
+        << "Transposed weights are not supported: " << name;
+    CHECK_GE(trained->blobs_size(), 1) << "No weights for " << name;
+    // Weights of old models are shaped 1 x 1 x m x n
+    Blob<float> weight;
+    weight.FromProto(trained->blobs(0));
+    const int m = layer->inner_product_param().num_output();
+    const int n = weight.count() / m;
+    CHECK_EQ(weight.count(), m * n) << "Weights do not match " << name;
+    CHECK_GT(rank, 0);
+    CHECK_LT(rank, std::min(m, n)) << "Rank too large for " << name;
+    LOG_IF(WARNING, rank * (m + n) >= m * n) << "Rank " << rank
+        << " does not make " << name << " any smaller";
+    LOG(INFO) << "Compressing " << name << " (" << m << "x" << n
+        << ") to rank " << rank;
+
+    vector<float> u, l;
+    const float energy = truncated_svd(m, n, rank, weight.cpu_data(), &u, &l);
+    const float error = report_speed(name, m, n, rank, weight.cpu_data(), u,
+        l);
+    LOG(INFO) << name << ": keeps " << energy * 100 << "% of the energy, "
+        << "relative output error " << error;
+
+    // The trained layer's halves
+    vector<int> lower_shape(2), upper_shape(2);
+    lower_shape[0] = rank;
+    lower_shape[1] = n;
+    upper_shape[0] = m;
+    upper_shape[1] = rank;
+    Blob<float> lower(lower_shape), upper(upper_shape);
+    caffe::caffe_copy(lower.count(), &l[0], lower.mutable_cpu_data());
+    caffe::caffe_copy(upper.count(), &u[0], upper.mutable_cpu_data());
+    LayerParameter trained_lower, trained_upper;
+    trained_lower.set_name(name + "_L");
+    trained_lower.set_type("InnerProduct");
+    lower.ToProto(trained_lower.add_blobs());
+    trained_upper.set_name(name + "_U");
+    trained_upper.set_type("InnerProduct");
+    upper.ToProto(trained_upper.add_blobs());
+    for (int b = 1; b < trained->blobs_size(); ++b) {
+      *trained_upper.add_blobs() = trained->blobs(b);
+    }
+    *trained = trained_lower;
+    *weights.add_layer() = trained_upper;
+
+    for (int j = 0; j < model.layer_size(); ++j) {
+      if (model.layer(j).name() == name) {
+        split_layer(&model, j, rank);
+        break;
+      }
+    }
+  }
+
+  caffe::WriteProtoToTextFile(model, FLAGS_output_model);
+  caffe::WriteProtoToBinaryFile(weights, FLAGS_output_weights);
+  LOG(INFO) << "Wrote " << FLAGS_output_model << " and "
+      << FLAGS_output_weights;
+  return 0;
+}
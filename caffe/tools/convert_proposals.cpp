@@ -0,0 +1,44 @@
+// This program converts selective search object proposals saved as a .mat
+// file to the memory-mapped proposal format read by ROIDataLayer and the
+// detection tool.
+// Usage:
+//   convert_proposals INPUT.mat OUTPUT.proposals
+//
+// where INPUT.mat holds a cell array "boxes" of [n][4] 1-based y1, x1, y2, x2
+// boxes per image. Both readers also convert a .mat file on first use into
+// data/cache; converting ahead of time avoids that pause.
+
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+#include "caffe/util/proposal_store.hpp"
+
+using caffe::ProposalStore;
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  // Print output to stderr (while still logging)
+  FLAGS_alsologtostderr = 1;
+
+#ifndef GFLAGS_GFLAGS_H_
+  namespace gflags = google;
+#endif
+
+  gflags::SetUsageMessage("Convert selective search object proposals to\n"
+        "the memory-mapped format used by Fast R-CNN.\n"
+        "Usage:\n"
+        "    convert_proposals INPUT.mat OUTPUT.proposals\n");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+  if (argc != 3) {
+    gflags::ShowUsageWithFlagsRestrict(argv[0], "tools/convert_proposals");
+    return 1;
+  }
+
+  ProposalStore::convert_mat(argv[1], argv[2]);
+  ProposalStore proposals;
+  proposals.open(argv[2]);
+  LOG(INFO) << "Wrote " << proposals.total_boxes() << " proposals of "
+      << proposals.num_images() << " images to " << argv[2];
+  return 0;
+}
@@ -0,0 +1,142 @@
+// Micro-benchmark of the CPU ROIPooling forward on a VGG16 conv5 sized
+// feature map.
+// Usage:
+//    roi_pooling_benchmark [--num_rois=2000] [--channels=512] [--height=38]
+//        [--width=63] [--iterations=10] [--train]
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <vector>
+
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layers/roi_pooling_layer.hpp"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/rng.hpp"
+
+using caffe::Blob;
+using caffe::CPUTimer;
+using std::vector;
+
+DEFINE_int32(num_rois, 2000, "Number of ROIs.");
+DEFINE_int32(channels, 512, "Channels of the feature map.");
+DEFINE_int32(height, 38, "Height of the feature map.");
+DEFINE_int32(width, 63, "Width of the feature map.");
+DEFINE_int32(pooled, 7, "Height and width of the pooled output.");
+DEFINE_double(spatial_scale, 0.0625, "Scale from image to feature map.");
+DEFINE_int32(iterations, 10, "Number of timed iterations.");
+DEFINE_bool(train, false, "Benchmark the TRAIN phase forward, which also "
+    "records the argmax for backward.");
+
+// The channel-by-channel forward the layer replaces, which computes the
+// bins of every output unit and walks NCHW planes with strided access
+static void reference_roi_pool(const Blob<float>& data,
+    const Blob<float>& rois, const int pooled, const float scale,
+    vector<float>* top) {
+  const int channels = data.channels();
+  const int height = data.height();
+  const int width = data.width();
+  top->resize(rois.num() * channels * pooled * pooled);
+  for (int n = 0; n < rois.num(); ++n) {
+    const float* roi = rois.cpu_data() + n * 5;
+    const int start_w = round(roi[1] * scale);
+    const int start_h = round(roi[2] * scale);
+    const int roi_height = std::max<int>(round(roi[4] * scale) - start_h + 1, 1);
+    const int roi_width = std::max<int>(round(roi[3] * scale) - start_w + 1, 1);
+    const float bin_h = float(roi_height) / pooled;
+    const float bin_w = float(roi_width) / pooled;
+    for (int c = 0; c < channels; ++c) {
+      const float* plane = data.cpu_data() + data.offset(roi[0], c);
+      for (int ph = 0; ph < pooled; ++ph) {
+        for (int pw = 0; pw < pooled; ++pw) {
+          const int hstart = std::min(std::max<int>(
+              floor(ph * bin_h) + start_h, 0), height);
+          const int hend = std::min(std::max<int>(
+              ceil((ph + 1) * bin_h) + start_h, 0), height);
+          const int wstart = std::min(std::max<int>(
+              floor(pw * bin_w) + start_w, 0), width);
+          const int wend = std::min(std::max<int>(
+              ceil((pw + 1) * bin_w) + start_w, 0), width);
+          float maxval = (hend <= hstart || wend <= wstart) ? 0 : -FLT_MAX;
+          for (int h = hstart; h < hend; ++h) {
+            for (int w = wstart; w < wend; ++w) {
+              maxval = std::max(maxval, plane[h * width + w]);
+            }
+          }
+          (*top)[((n * channels + c) * pooled + ph) * pooled + pw] = maxval;
+        }
+      }
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  FLAGS_alsologtostderr = 1;
+  gflags::SetUsageMessage("Benchmarks the CPU ROIPooling forward.\n"
+      "Usage:\n"
+      "    roi_pooling_benchmark [FLAGS]\n");
+  caffe::GlobalInit(&argc, &argv);
+
+  caffe::Caffe::set_random_seed(1701);
+  Blob<float> data(1, FLAGS_channels, FLAGS_height, FLAGS_width);
+  caffe::FillerParameter filler_param;
+  caffe::GaussianFiller<float> filler(filler_param);
+  filler.Fill(&data);
+  // Random proposals inside the image the feature map was computed from
+  caffe::rng_t* rng = caffe::caffe_rng();
+  const int image_height = FLAGS_height / FLAGS_spatial_scale;
+  const int image_width = FLAGS_width / FLAGS_spatial_scale;
+  Blob<float> rois(FLAGS_num_rois, 5, 1, 1);
+  float* roi = rois.mutable_cpu_data();
+  for (int n = 0; n < FLAGS_num_rois; ++n, roi += 5) {
+    roi[0] = 0;
+    roi[1] = (*rng)() % (image_width * 3 / 4);
+    roi[2] = (*rng)() % (image_height * 3 / 4);
+    roi[3] = std::min<float>(roi[1] + 16 + (*rng)() % (image_width / 2),
+        image_width - 1);
+    roi[4] = std::min<float>(roi[2] + 16 + (*rng)() % (image_height / 2),
+        image_height - 1);
+  }
+
+  vector<float> top_ref;
+  CPUTimer timer;
+  timer.Start();
+  for (int it = 0; it < FLAGS_iterations; ++it) {
+    reference_roi_pool(data, rois, FLAGS_pooled, FLAGS_spatial_scale,
+        &top_ref);
+  }
+  const float ref_ms = timer.MicroSeconds() / 1000 / FLAGS_iterations;
+
+  caffe::LayerParameter param;
+  param.mutable_roi_pooling_param()->set_pooled_h(FLAGS_pooled);
+  param.mutable_roi_pooling_param()->set_pooled_w(FLAGS_pooled);
+  param.mutable_roi_pooling_param()->set_spatial_scale(FLAGS_spatial_scale);
+  param.set_phase(FLAGS_train ? caffe::TRAIN : caffe::TEST);
+  caffe::ROIPoolingLayer<float> layer(param);
+  Blob<float> top;
+  vector<Blob<float>*> bottom_vec, top_vec(1, &top);
+  bottom_vec.push_back(&data);
+  bottom_vec.push_back(&rois);
+  layer.SetUp(bottom_vec, top_vec);
+  layer.Forward(bottom_vec, top_vec);
+  timer.Start();
+  for (int it = 0; it < FLAGS_iterations; ++it) {
+    layer.Forward(bottom_vec, top_vec);
+  }
+  const float layer_ms = timer.MicroSeconds() / 1000 / FLAGS_iterations;
+
+  float max_diff = 0;
+  for (int i = 0; i < top.count(); ++i) {
+    max_diff = std::max(max_diff, std::abs(top.cpu_data()[i] - top_ref[i]));
+  }
+  LOG(INFO) << FLAGS_num_rois << " ROIs on " << FLAGS_channels << "x"
+      << FLAGS_height << "x" << FLAGS_width << ": reference " << ref_ms
+      << " ms, layer " << layer_ms << " ms (" << ref_ms / layer_ms
+      << "x), max diff " << max_diff;
+  return 0;
+}